@@ -10,11 +10,21 @@ LOCAL_EXPORT_C_INCLUDES := $(LOCAL_PATH)/include
 LOCAL_CFLAGS := -DVRAW_API_EXPORTS -fvisibility=hidden -std=gnu99
 LOCAL_SRC_FILES := \
 	src/vraw.c \
+	src/vraw_conv.c \
+	src/vraw_decimate.c \
+	src/vraw_delta.c \
+	src/vraw_fanout.c \
 	src/vraw_image.c \
 	src/vraw_psnr.c \
 	src/vraw_reader.c \
-	src/vraw_writer.c
+	src/vraw_uring.c \
+	src/vraw_writer.c \
+	src/vraw_writer_cmp.c \
+	src/vraw_writer_ring.c \
+	src/vraw_writer_segment.c \
+	src/vraw_writer_uring.c
 LOCAL_LIBRARIES := \
+	liblz4 \
 	libulog \
 	libvideo-defs
 LOCAL_CONDITIONAL_LIBRARIES := \
@@ -47,10 +47,20 @@ extern "C" {
 #	define VRAW_API
 #endif /* !VRAW_API_EXPORTS */
 
+/* ABI version: the configuration structures are larger than in version 1,
+ * so the functions taking them are exported under versioned names; this
+ * way binaries built against a previous version fail to load instead of
+ * passing structures of the wrong size */
+#define VRAW_ABI_VERSION 2
+#define vraw_reader_new vraw_reader_new_v2
+#define vraw_reader_get_config vraw_reader_get_config_v2
+#define vraw_writer_new vraw_writer_new_v2
+
 
 /* Forward declarations */
 struct vraw_reader;
 struct vraw_writer;
+struct vraw_fanout;
 
 
 /* Frame data */
@@ -99,6 +109,174 @@ struct vraw_reader_config {
 	unsigned int plane_stride_align[VDEF_RAW_MAX_PLANE_COUNT];
 	unsigned int plane_scanline_align[VDEF_RAW_MAX_PLANE_COUNT];
 	unsigned int plane_size_align[VDEF_RAW_MAX_PLANE_COUNT];
+
+	/* Read only one frame every frame_step frames (if greater than 1,
+	 * otherwise read all frames); the skipped frames are not read but
+	 * seeked over, and the timestamps still reflect the position in
+	 * the file */
+	unsigned int frame_step;
+
+	/* Planes to read, as a bit field of plane indexes, e.g. (1 << 0)
+	 * for luma only (if not 0, otherwise read all planes); the skipped
+	 * planes are seeked over, they are not stored in the buffer and
+	 * their data pointers are NULL in the frames */
+	unsigned int plane_mask;
+
+	/* Spatial subsampling factor, e.g. 2 or 4 for half or quarter
+	 * resolution frames (if greater than 1, otherwise read full
+	 * resolution frames); only one row every subsample rows is read
+	 * from the file, and the rows are decimated horizontally by
+	 * picking samples; only linear formats with byte-aligned samples
+	 * are supported, and the resolution must be a multiple of twice
+	 * the subsampling factor */
+	unsigned int subsample;
+
+	/* Flight recorder ring file, see vraw_writer_config.ring_slots
+	 * (if not 0); the frames are read in recording order from the
+	 * oldest one, with their recorded timestamps; the format and
+	 * resolution are mandatory, y4m files and multiple segments are
+	 * not supported */
+	int ring;
+
+	/* Compressed file written with a compression codec, see
+	 * vraw_writer_config.compression (if not 0); the frames are
+	 * decoded transparently, and the frame table allows seeking to any
+	 * frame directly; the format and resolution are mandatory, y4m
+	 * files and multiple segments are not supported */
+	int compressed;
+
+	/* Timestamp sidecar file, see vraw_writer_config.timestamps (if
+	 * not 0); the file is mapped in memory, the recorded timestamp,
+	 * capture timestamp, flags and index of each frame are restored
+	 * instead of being computed from the framerate, and timestamp
+	 * seeks (see vraw_reader_seek_ts()) are binary searches in the
+	 * recorded timestamps; multiple segments and ring files are not
+	 * supported */
+	int timestamps;
+
+	/* Per-plane split storage, see vraw_writer_config.split_planes (if
+	 * not 0); the file is the manifest, the planes are read from
+	 * their own files and recombined in the frame buffer; only the
+	 * files of the planes selected by plane_mask are opened, so that
+	 * luma-only reads are purely sequential in the luma file; the
+	 * format and resolution are mandatory and must match the
+	 * manifest; y4m, ring and compressed files, multiple segments and
+	 * subsampling are not supported */
+	int split_planes;
+};
+
+
+/* Compression codec */
+enum vraw_compression {
+	/* No compression (default) */
+	VRAW_COMPRESSION_NONE = 0,
+
+	/* LZ4 block format: fast lossless compression */
+	VRAW_COMPRESSION_LZ4,
+};
+
+
+/* Writer I/O backend */
+enum vraw_writer_backend {
+	/* Buffered stdio writes, one write per row (default) */
+	VRAW_WRITER_BACKEND_STDIO = 0,
+
+	/* Unbuffered positional gather writes: all the rows of a frame,
+	 * and the y4m frame header, are written straight from the frame
+	 * buffers with a single pwritev() call (or a few when the number
+	 * of rows exceeds IOV_MAX) */
+	VRAW_WRITER_BACKEND_PWRITEV,
+
+	/* io_uring writes from pre-registered buffers: each frame is
+	 * packed into one of uring_depth registered buffers and written
+	 * with a single request; several frames can be in flight with
+	 * vraw_writer_frame_submit() and vraw_writer_frame_complete();
+	 * when io_uring is not available, the pwritev backend is used
+	 * instead, without these two functions */
+	VRAW_WRITER_BACKEND_IO_URING,
+
+	/* Direct I/O (O_DIRECT) writes bypassing the page cache: the rows
+	 * are packed into a page-aligned staging buffer of buffer_size
+	 * bytes (at least one frame), which is written whenever it is
+	 * full and on flush (only its aligned part, the remainder is kept
+	 * for the next write); the padded tail is written, and the file
+	 * truncated to its real size, by vraw_writer_destroy() */
+	VRAW_WRITER_BACKEND_DIRECT,
+};
+
+
+/* Writer flush policy */
+enum vraw_writer_flush {
+	/* Flush after every frame (default) */
+	VRAW_WRITER_FLUSH_EVERY_FRAME = 0,
+
+	/* Flush every flush_frames frames */
+	VRAW_WRITER_FLUSH_EVERY_N_FRAMES,
+
+	/* Flush once at least flush_bytes bytes have been written since
+	 * the last flush */
+	VRAW_WRITER_FLUSH_EVERY_N_BYTES,
+
+	/* Flush only when the writer is destroyed (data is still written
+	 * whenever the buffer is full) */
+	VRAW_WRITER_FLUSH_ON_DESTROY,
+};
+
+
+/* Writer asynchronous queue full policy */
+enum vraw_writer_queue_full {
+	/* Block until a frame has been written (default) */
+	VRAW_WRITER_QUEUE_FULL_BLOCK = 0,
+
+	/* Drop the frame: vraw_writer_frame_write() fails with -EAGAIN
+	 * and the frame buffers are not referenced by the writer */
+	VRAW_WRITER_QUEUE_FULL_DROP,
+};
+
+
+/* Writer callbacks */
+struct vraw_writer_cbs {
+	/* Frame written callback function (optional, asynchronous mode
+	 * only). Called on the writer thread once a queued frame has been
+	 * written (or has failed to be written); the frame buffers can be
+	 * reused from this point on.
+	 * @param writer: writer instance handle
+	 * @param frame: frame that was written
+	 * @param status: 0 on success, negative errno value in case of
+	 *                error
+	 * @param userdata: user data pointer */
+	void (*frame_done)(struct vraw_writer *writer,
+			   const struct vraw_frame *frame,
+			   int status,
+			   void *userdata);
+};
+
+
+/* Writer output sink, see vraw_writer_new_sink() */
+struct vraw_writer_sink {
+	/* Write function (mandatory). Called with the file data, in
+	 * order; the data is buffered by the writer according to the
+	 * buffer_size and flush configuration.
+	 * @param writer: writer instance handle
+	 * @param buf: data to write
+	 * @param len: data size in bytes
+	 * @param userdata: user data pointer
+	 * @return 0 on success, negative errno value in case of error */
+	int (*write)(struct vraw_writer *writer,
+		     const void *buf,
+		     size_t len,
+		     void *userdata);
+
+	/* Flush function (optional). Called after the buffered data has
+	 * been written, according to the flush configuration and when
+	 * the writer is destroyed.
+	 * @param writer: writer instance handle
+	 * @param userdata: user data pointer
+	 * @return 0 on success, negative errno value in case of error */
+	int (*flush)(struct vraw_writer *writer, void *userdata);
+
+	/* Sink functions user data pointer */
+	void *userdata;
 };
 
 
@@ -112,6 +290,275 @@ struct vraw_writer_config {
 
 	/* Format information */
 	struct vdef_format_info info;
+
+	/* Input frame format (optional, if its data layout is not
+	 * VDEF_RAW_DATA_LAYOUT_UNKNOWN); frames can be written either in
+	 * this format or in the data format, the former being converted
+	 * on write row by row, without an intermediate frame copy; the
+	 * supported conversions are between the planar and semi-planar
+	 * YUV 4:2:0 formats with the same samples, and between their U/V
+	 * orders (e.g. NV12 to I420 or YV12) */
+	struct vdef_raw_format input_format;
+
+	/* I/O backend */
+	enum vraw_writer_backend backend;
+
+	/* Maximum number of frames in flight (io_uring backend only; if
+	 * not 0, otherwise a default value is used) */
+	unsigned int uring_depth;
+
+	/* Flush policy (stdio and direct I/O backends only) */
+	enum vraw_writer_flush flush;
+
+	/* Number of frames between flushes (mandatory with
+	 * VRAW_WRITER_FLUSH_EVERY_N_FRAMES) */
+	unsigned int flush_frames;
+
+	/* Number of bytes between flushes (mandatory with
+	 * VRAW_WRITER_FLUSH_EVERY_N_BYTES) */
+	size_t flush_bytes;
+
+	/* Durability: number of bytes between writeback starts (if not 0);
+	 * each time sync_bytes bytes have been written, the writeback of
+	 * these bytes is started with sync_file_range(), after waiting for
+	 * the writeback of the previous ones, so that at most about twice
+	 * sync_bytes of dirty data are outstanding instead of being written
+	 * back all at once by the kernel; files only, not supported in
+	 * flight recorder mode */
+	size_t sync_bytes;
+
+	/* Durability: number of frames between fdatasync() calls (if not
+	 * 0); files only */
+	unsigned int sync_frames;
+
+	/* Durability: drop the written back data from the page cache with
+	 * POSIX_FADV_DONTNEED (if not 0; with sync_bytes or sync_frames) */
+	int sync_drop_cache;
+
+	/* User-space write buffer size in bytes (if not 0, otherwise the
+	 * default stdio buffer size, or the frame size for the direct I/O
+	 * backend, is used; stdio and direct I/O backends only); a buffer
+	 * at least as large as a frame allows writing each frame with few,
+	 * large writes */
+	size_t buffer_size;
+
+	/* Pipe buffer size in bytes, when writing to a pipe file descriptor
+	 * (if not 0, otherwise 1 MiB); the pipe is enlarged to this size if
+	 * allowed by the system (see /proc/sys/fs/pipe-max-size) */
+	size_t pipe_size;
+
+	/* Expected number of frames (if not 0); the file space is
+	 * preallocated up front to limit fragmentation and block
+	 * allocation stalls, then in large extents if the expectation is
+	 * exceeded; the unused space is released by vraw_writer_destroy() */
+	unsigned int expected_frame_count;
+
+	/* Expected file size in bytes (if not 0); see expected_frame_count,
+	 * the largest of both is preallocated */
+	uint64_t expected_bytes;
+
+	/* Flight recorder mode number of frame slots (if not 0); the file
+	 * is sized and preallocated up front for ring_slots frames and a
+	 * trailer, and the frames are written in a circular fashion, the
+	 * oldest frame being overwritten once all slots are used; the
+	 * trailer records the next slot to write, the number of valid
+	 * slots and the timestamp of each slot, and is updated after each
+	 * frame, so that a process crash can only corrupt the oldest frame
+	 * (the write order is not preserved on power loss); raw
+	 * files only, with the stdio or pwritev backend (frames are always
+	 * written with positional writes) */
+	unsigned int ring_slots;
+
+	/* Timestamp sidecar file (if not 0); the timestamp, capture
+	 * timestamp, flags and index of each frame are written to a
+	 * compact binary file named after the file with a ".timestamps"
+	 * suffix, so that the reader can restore them and seek by
+	 * timestamp (see vraw_reader_config.timestamps); the entries are
+	 * buffered and written on flush. Only when writing to a named
+	 * file; not supported in flight recorder and segmented modes */
+	int timestamps;
+
+	/* Per-plane split storage (if not 0); each plane is written to its
+	 * own file, named after the file with a ".plane<index>" suffix
+	 * (e.g. "video.yuv.plane0" for luma), and the file itself is a
+	 * small manifest giving the geometry of the planes; luma-only
+	 * processing can then read the luma file sequentially, and
+	 * full frames are recombined by the reader (see
+	 * vraw_reader_config.split_planes). Only when writing to a named
+	 * raw file, with the stdio or pwritev backend (frames are always
+	 * written with positional writes); not supported in flight
+	 * recorder, segmented and compressed modes, nor with the
+	 * durability options; no preallocation is done */
+	int split_planes;
+
+	/* Segmented recording maximum number of frames per segment file
+	 * (if not 0). When any of the segment limits is set, the file name
+	 * given to vraw_writer_new() is a pattern with a single "%u"
+	 * conversion (optionally with a zero flag and a width, e.g.
+	 * "rec_%04u.y4m") replaced by the segment index, starting at 0;
+	 * the writer moves to the next segment file before writing a frame
+	 * that would exceed one of the limits, and each segment is a
+	 * complete raw or y4m file. The next segment file is created and
+	 * preallocated, and the previous one closed, by a background
+	 * thread so that switching files does not block on creating or
+	 * closing files; the expected_frame_count and expected_bytes
+	 * values are then ignored, and the pre-created segment file is
+	 * removed by vraw_writer_destroy() if it is unused. Not supported
+	 * in flight recorder mode */
+	unsigned int segment_frames;
+
+	/* Segmented recording maximum segment file size in bytes (if not
+	 * 0; a segment always holds at least one frame) */
+	uint64_t segment_bytes;
+
+	/* Segmented recording maximum segment duration in microseconds,
+	 * computed from the frame timestamps (if not 0) */
+	uint64_t segment_duration_us;
+
+	/* Lossless compression codec; each frame is compressed and written
+	 * with positional writes, and a frame table is appended by
+	 * vraw_writer_destroy() so that the reader can seek to any frame
+	 * directly (see vraw_reader_config.compressed); the bytes in the
+	 * writer statistics are the compressed bytes; 16-bit samples are
+	 * byte-shuffled before compression for better compression ratios.
+	 * Raw files only, with the stdio or pwritev backend; not supported
+	 * in flight recorder and segmented recording modes */
+	enum vraw_compression compression;
+
+	/* Number of compression threads (if not 0, otherwise 1); each frame
+	 * is split into as many chunks, which are compressed independently
+	 * and in parallel */
+	unsigned int compression_threads;
+
+	/* Temporal delta compression keyframe interval (if greater than 1,
+	 * otherwise all frames are keyframes); with a compression codec,
+	 * one frame every keyframe_interval frames is a keyframe,
+	 * compressed on its own, and the other frames are XORed with the
+	 * previous frame before compression, so that the unchanged samples
+	 * of static scenes become runs of zeroes which compress to almost
+	 * nothing. The compression is still lossless; the reader decodes
+	 * the frames from the previous keyframe when seeking, reverse
+	 * reads are therefore slower */
+	unsigned int keyframe_interval;
+
+	/* Asynchronous mode queue depth (if not 0, otherwise frames are
+	 * written synchronously); frames are queued and written by a
+	 * background thread, the frame buffers must remain valid until
+	 * the frame_done callback function is called */
+	unsigned int queue_depth;
+
+	/* Asynchronous mode queue full policy */
+	enum vraw_writer_queue_full queue_full;
+
+	/* Callback functions (asynchronous mode only) */
+	struct vraw_writer_cbs cbs;
+
+	/* Callback functions user data pointer */
+	void *userdata;
+};
+
+
+/* Fan-out writer output */
+struct vraw_fanout_output {
+	/* Output file name; if NULL, the output is the sink if its write
+	 * function is set, or the file descriptor otherwise */
+	const char *filename;
+
+	/* Output file descriptor (see vraw_writer_new_from_fd()) */
+	int fd;
+
+	/* Output sink (see vraw_writer_new_sink()) */
+	struct vraw_writer_sink sink;
+
+	/* YUV4MPEG2 (*.y4m) file format (if not 0) */
+	int y4m;
+
+	/* I/O backend */
+	enum vraw_writer_backend backend;
+};
+
+
+/* Reader statistics; all counters are cumulative since the creation
+ * of the reader instance */
+struct vraw_reader_stats {
+	/* Number of frames read */
+	uint64_t frames;
+
+	/* Number of bytes read from the file(s), including the y4m frame
+	 * headers */
+	uint64_t bytes;
+
+	/* Number of read calls (stdio or positional reads) */
+	uint64_t io_calls;
+
+	/* Number of seeks */
+	uint64_t seeks;
+
+	/* Time spent in read and seek calls, in nanoseconds */
+	uint64_t io_time_ns;
+
+	/* Time spent in per-row copy loops (e.g. decimation when
+	 * subsampling), in nanoseconds */
+	uint64_t copy_time_ns;
+
+	/* Number of loops back to the beginning of the file (loop = 1) */
+	uint64_t loops;
+
+	/* Number of reading direction changes (loop = -1) */
+	uint64_t reversals;
+};
+
+
+/* Writer statistics; all counters are cumulative since the creation
+ * of the writer instance */
+struct vraw_writer_stats {
+	/* Number of frames written */
+	uint64_t frames;
+
+	/* Number of bytes written to the file, including the y4m file
+	 * and frame headers */
+	uint64_t bytes;
+
+	/* Number of write and flush calls (stdio), of pwritev() or pwrite()
+	 * calls, or of io_uring_enter() calls */
+	uint64_t io_calls;
+
+	/* Number of seeks */
+	uint64_t seeks;
+
+	/* Time spent in flush calls (stdio), in pwritev() or pwrite()
+	 * calls, or in io_uring_enter() calls, in nanoseconds */
+	uint64_t io_time_ns;
+
+	/* Time spent in per-row copy loops, in nanoseconds; this includes
+	 * the writes triggered when the stdio buffer is full; with the
+	 * io_uring backend, this is the time spent packing the frames into
+	 * the registered buffers */
+	uint64_t copy_time_ns;
+
+	/* Number of frames currently queued or being written
+	 * (asynchronous mode only) */
+	uint64_t queue_depth;
+
+	/* Maximum number of frames queued (asynchronous mode only) */
+	uint64_t queue_max_depth;
+
+	/* Number of frames dropped because the queue was full
+	 * (asynchronous mode only) */
+	uint64_t dropped;
+
+	/* Time spent blocked waiting for room in the queue, in
+	 * nanoseconds (asynchronous mode only) */
+	uint64_t blocked_time_ns;
+
+	/* Number of segment files started after the first one (segmented
+	 * recording only) */
+	uint64_t segments;
+
+	/* Worst write latency, i.e. longest frame (or batch of frames)
+	 * write, including the flush and durability calls, in nanoseconds;
+	 * in asynchronous mode, this is measured in the writer thread */
+	uint64_t max_write_latency_ns;
 };
 
 
@@ -131,6 +578,47 @@ VRAW_API int vraw_reader_new(const char *filename,
 			     struct vraw_reader **ret_obj);
 
 
+/**
+ * Create a segmented file reader instance.
+ * The segment files must all have the same format; they are read as one
+ * continuous stream, in the given order: the frame indexes, the timestamps
+ * and the file frame count cover all segments. The next segment is opened
+ * and its first frame prefetched before reaching the end of the current
+ * segment. A partial frame at the end of the last segment (e.g. a
+ * recording in progress) is ignored; the other segments must hold whole
+ * frames.
+ * The configuration structure must be filled.
+ * The instance handle is returned through the ret_obj parameter.
+ * When no longer needed, the instance must be freed using the
+ * vraw_reader_destroy() function.
+ * @param filenames: array of segment file names
+ * @param count: number of segment files
+ * @param config: reader configuration
+ * @param ret_obj: reader instance handle (output)
+ * @return 0 on success, negative errno value in case of error
+ */
+VRAW_API int vraw_reader_new_segments(const char *const *filenames,
+				      unsigned int count,
+				      const struct vraw_reader_config *config,
+				      struct vraw_reader **ret_obj);
+
+
+/**
+ * Create a segmented file reader instance from a file name pattern.
+ * The segment files are the files matching the glob(7) pattern, sorted
+ * by name with the numbers compared by value (see strverscmp(3)), so
+ * that "rec_2.yuv" comes before "rec_10.yuv"; see
+ * vraw_reader_new_segments().
+ * @param pattern: segment file name pattern
+ * @param config: reader configuration
+ * @param ret_obj: reader instance handle (output)
+ * @return 0 on success, negative errno value in case of error
+ */
+VRAW_API int vraw_reader_new_glob(const char *pattern,
+				  const struct vraw_reader_config *config,
+				  struct vraw_reader **ret_obj);
+
+
 /**
  * Free a reader instance.
  * This function frees all resources associated with a reader instance.
@@ -153,6 +641,8 @@ VRAW_API int vraw_reader_get_config(struct vraw_reader *self,
 
 /**
  * Get the minimum buffer size for reading a frame.
+ * Only the planes selected by the plane_mask configuration are counted,
+ * at the resolution resulting from the subsample configuration.
  * @param self: reader instance handle
  * @return buffer size on success, negative errno value in case of error
  */
@@ -177,6 +667,36 @@ VRAW_API int vraw_reader_set_framerate(struct vraw_reader *self,
 				       const struct vdef_frac *framerate);
 
 
+/**
+ * Get the reader statistics.
+ * The statistics structure is filled by the function. The counters are
+ * always maintained; they only cost a few clock reads per frame plane.
+ * This function must be called from the reading thread.
+ * @param self: reader instance handle
+ * @param stats: reader statistics (output)
+ * @return 0 on success, negative errno value in case of error
+ */
+VRAW_API int vraw_reader_get_stats(struct vraw_reader *self,
+				   struct vraw_reader_stats *stats);
+
+
+/**
+ * Seek to a timestamp.
+ * The next frame read is the last frame whose timestamp is at or before
+ * the given timestamp (or the first frame if all timestamps are after
+ * it). The frame timestamps are the recorded ones with a timestamp
+ * sidecar file or a ring file, in which case they must be increasing,
+ * and are computed from the framerate otherwise; the search is a binary
+ * search, without reading the file. With a timestamp sidecar file, the
+ * frames after its last entry are not searched; -ENOENT is returned if
+ * there is no frame to seek to.
+ * @param self: reader instance handle
+ * @param timestamp: timestamp in microseconds
+ * @return 0 on success, negative errno value in case of error
+ */
+VRAW_API int vraw_reader_seek_ts(struct vraw_reader *self, uint64_t timestamp);
+
+
 /**
  * Read a frame.
  * Reads a frame from the file into the provided data buffer.
@@ -212,9 +732,62 @@ VRAW_API int vraw_writer_new(const char *filename,
 			     struct vraw_writer **ret_obj);
 
 
+/**
+ * Create a file descriptor writer instance.
+ * The configuration structure must be filled.
+ * The file descriptor can be a regular file, open for writing at offset
+ * 0, or a stream such as a pipe or STDOUT_FILENO (e.g. to feed an encoder
+ * process). Streams support the stdio backend only, without flight
+ * recorder mode or compression, and the expected_frame_count and
+ * expected_bytes values are ignored. Pipes are enlarged to pipe_size
+ * bytes and written with vmsplice(2) from the writer's buffers, so that
+ * the data is handed to the pipe without being copied; as a consequence
+ * the reading end must not splice(2) or tee(2) the data to another pipe,
+ * and the writer waits for the data to be read before reusing or freeing
+ * its buffers, including in vraw_writer_destroy().
+ * Segmented recording and the direct I/O backend are not supported.
+ * The file descriptor is duplicated: it is not closed by the writer.
+ * The instance handle is returned through the ret_obj parameter.
+ * When no longer needed, the instance must be freed using the
+ * vraw_writer_destroy() function.
+ * @param fd: file descriptor
+ * @param config: writer configuration
+ * @param ret_obj: writer instance handle (output)
+ * @return 0 on success, negative errno value in case of error
+ */
+VRAW_API int vraw_writer_new_from_fd(int fd,
+				     const struct vraw_writer_config *config,
+				     struct vraw_writer **ret_obj);
+
+
+/**
+ * Create a sink writer instance.
+ * The configuration structure must be filled.
+ * The file data is passed to the sink functions instead of being
+ * written to a file; only the stdio backend is supported, without flight
+ * recorder mode, segmented recording or compression, and the
+ * expected_frame_count and expected_bytes values are ignored. The sink
+ * write function can be called from this function for the y4m file
+ * headers, and from the writer thread in asynchronous mode.
+ * The instance handle is returned through the ret_obj parameter.
+ * When no longer needed, the instance must be freed using the
+ * vraw_writer_destroy() function.
+ * @param sink: sink functions
+ * @param config: writer configuration
+ * @param ret_obj: writer instance handle (output)
+ * @return 0 on success, negative errno value in case of error
+ */
+VRAW_API int vraw_writer_new_sink(const struct vraw_writer_sink *sink,
+				  const struct vraw_writer_config *config,
+				  struct vraw_writer **ret_obj);
+
+
 /**
  * Free a writer instance.
- * This function frees all resources associated with a writer instance.
+ * This function flushes the pending data and frees all resources
+ * associated with a writer instance. In asynchronous mode, the queued
+ * frames are written first and their frame_done callback functions are
+ * called.
  * @param self: writer instance handle
  * @return 0 on success, negative errno value in case of error
  */
@@ -225,6 +798,20 @@ VRAW_API int vraw_writer_destroy(struct vraw_writer *self);
  * Write a frame.
  * Writes a frame to the file. The profided frame structure must be filled
  * with the frame metadata.
+ * In asynchronous mode, the frame is only queued: the frame buffers must
+ * remain valid until the frame_done callback function is called, and
+ * write errors are reported through the callback function. When the
+ * queue is full, the function either blocks or fails with -EAGAIN,
+ * depending on the queue_full configuration.
+ * With the io_uring backend, the function submits the frame and waits
+ * for the completion of all the frames in flight.
+ * The plane lines and their widths are the plane scanlines and strides
+ * given by vdef_calc_raw_frame_size() without alignment (a line is a row
+ * of tiles for the tiled formats); the frame plane strides must not be
+ * smaller than the line widths.
+ * Planes whose rows are contiguous (plane stride equal to the line width)
+ * are written or copied at once, as well as whole frames whose planes
+ * also follow each other in memory, like the frames from vraw_reader.
  * @param self: writer instance handle
  * @param frame: frame metadata
  * @return 0 on success, negative errno value in case of error
@@ -233,6 +820,169 @@ VRAW_API int vraw_writer_frame_write(struct vraw_writer *self,
 				     const struct vraw_frame *frame);
 
 
+/**
+ * Write a batch of frames.
+ * Writes count frames from an array, as successive calls to
+ * vraw_writer_frame_write() would, but with less per-frame overhead: all
+ * the frames are validated before anything is written, the frames are
+ * gathered in as few vectored writes as possible with the pwritev
+ * backend (or submitted at once with the io_uring backend), and the flush
+ * policy is applied once for the whole batch. In synchronous mode the
+ * array and the frame buffers can be released as soon as the function
+ * returns. In asynchronous mode, the frames are queued (and their
+ * frame_done callback functions called) one by one; with the DROP
+ * queue_full policy, the whole batch is dropped if it does not fit in the
+ * queue. In ring, segmented and compressed modes, the frames are written
+ * one by one.
+ * @param self: writer instance handle
+ * @param frames: array of frame metadata
+ * @param count: number of frames in the array
+ * @return 0 on success, negative errno value in case of error
+ */
+VRAW_API int vraw_writer_frames_write(struct vraw_writer *self,
+				      const struct vraw_frame *frames,
+				      unsigned int count);
+
+
+/**
+ * Write a frame at its slot in the file.
+ * Writes a frame at offset index times the frame size, with positional
+ * writes from the caller's buffers; frames can therefore be written in
+ * any order, and concurrently from several threads (e.g. frame-parallel
+ * encoder or processing workers) without any lock. The slots not written
+ * yet are holes in the file. The frame must be in the data format (no
+ * conversion) and the frame buffers can be reused as soon as the function
+ * returns; the flush and durability policies do not apply.
+ * This function is only available for raw files with the pwritev backend,
+ * in synchronous mode, and not in flight recorder, segmented, compressed
+ * or split planes modes; it must not be mixed with vraw_writer_frame_write()
+ * or vraw_writer_frames_write() on the same writer.
+ * @param self: writer instance handle
+ * @param index: frame index in the file
+ * @param frame: frame metadata
+ * @return 0 on success, negative errno value in case of error
+ */
+VRAW_API int vraw_writer_frame_write_at(struct vraw_writer *self,
+					uint64_t index,
+					const struct vraw_frame *frame);
+
+
+/**
+ * Submit a frame write (io_uring backend only).
+ * The frame is copied into a free registered buffer and queued; the
+ * queued writes are submitted to the kernel by the next call to
+ * vraw_writer_frame_complete(), so that several frames can be submitted
+ * with a single system call. The frame buffers can be reused as soon as
+ * the function returns.
+ * This function cannot be used in asynchronous mode.
+ * @param self: writer instance handle
+ * @param frame: frame metadata
+ * @return 0 on success, -EAGAIN if uring_depth frames are already in
+ *         flight, negative errno value in case of error
+ */
+VRAW_API int vraw_writer_frame_submit(struct vraw_writer *self,
+				      const struct vraw_frame *frame);
+
+
+/**
+ * Complete frame writes (io_uring backend only).
+ * Submits the queued frame writes to the kernel and reaps the completed
+ * ones, waiting until at least min_count frames have completed (or all
+ * the frames in flight if there are fewer).
+ * This function cannot be used in asynchronous mode.
+ * @param self: writer instance handle
+ * @param min_count: minimum number of frame completions to wait for
+ * @return the number of completed frames on success, negative errno
+ *         value in case of error (if any of the completed writes failed)
+ */
+VRAW_API int vraw_writer_frame_complete(struct vraw_writer *self,
+					unsigned int min_count);
+
+
+/**
+ * Get the writer statistics.
+ * The statistics structure is filled by the function. The counters are
+ * always maintained; they only cost a few clock reads per frame.
+ * This function must be called from the writing thread, except in
+ * asynchronous mode where it can be called from any thread; the I/O
+ * counters are then updated after each frame written.
+ * @param self: writer instance handle
+ * @param stats: writer statistics (output)
+ * @return 0 on success, negative errno value in case of error
+ */
+VRAW_API int vraw_writer_get_stats(struct vraw_writer *self,
+				   struct vraw_writer_stats *stats);
+
+
+/**
+ * Create a fan-out writer instance.
+ * A fan-out writer writes the same frames to several outputs: each frame
+ * is packed once into an internal buffer, which is then queued on one
+ * asynchronous writer per output, so that the outputs are written in
+ * parallel, each with a single write per frame when possible.
+ * The configuration structure is used for all outputs, except for the
+ * y4m and backend values which are set per output; the queue_depth is
+ * the number of frames that can be queued for each output (if not 0,
+ * otherwise a default value is used) and the queue_full policy tells
+ * whether a slow output blocks vraw_fanout_frame_write() once its queue
+ * is full, and thus delays all the other outputs, or drops the frame;
+ * VRAW_WRITER_QUEUE_FULL_DROP is therefore recommended to isolate the
+ * outputs from each other. The frame_done callback function must not be
+ * set, and format conversion (input_format) is not supported.
+ * The instance handle is returned through the ret_obj parameter.
+ * When no longer needed, the instance must be freed using the
+ * vraw_fanout_destroy() function.
+ * @param outputs: array of outputs
+ * @param output_count: number of outputs
+ * @param config: writer configuration
+ * @param ret_obj: fan-out writer instance handle (output)
+ * @return 0 on success, negative errno value in case of error
+ */
+VRAW_API int vraw_fanout_new(const struct vraw_fanout_output *outputs,
+			     unsigned int output_count,
+			     const struct vraw_writer_config *config,
+			     struct vraw_fanout **ret_obj);
+
+
+/**
+ * Free a fan-out writer instance.
+ * This function writes the queued frames to all outputs, then frees all
+ * resources associated with a fan-out writer instance.
+ * @param self: fan-out writer instance handle
+ * @return 0 on success, negative errno value in case of error (including
+ *         the errors that occurred when writing frames to an output)
+ */
+VRAW_API int vraw_fanout_destroy(struct vraw_fanout *self);
+
+
+/**
+ * Write a frame to all outputs.
+ * The frame is copied, so the frame buffers can be reused as soon as the
+ * function returns.
+ * @param self: fan-out writer instance handle
+ * @param frame: frame metadata
+ * @return 0 on success, -EAGAIN if the frame was dropped by at least one
+ *         output (the frame is still written to the other outputs),
+ *         negative errno value in case of error
+ */
+VRAW_API int vraw_fanout_frame_write(struct vraw_fanout *self,
+				     const struct vraw_frame *frame);
+
+
+/**
+ * Get the statistics of a fan-out writer output.
+ * See vraw_writer_get_stats(); this function can be called from any
+ * thread.
+ * @param self: fan-out writer instance handle
+ * @param index: output index
+ * @param stats: writer statistics (output)
+ * @return 0 on success, negative errno value in case of error
+ */
+VRAW_API int vraw_fanout_get_stats(struct vraw_fanout *self,
+				   unsigned int index,
+				   struct vraw_writer_stats *stats);
+
+
 /**
  * Compute the Peak Signal to Noise Ratio (PSNR) between 2 frames
  * @param frame1: pointer a structure containing frame1 info.
@@ -0,0 +1,128 @@
+/**
+ * Copyright (c) 2018 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _VRAW_CMP_H_
+#define _VRAW_CMP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vraw_le.h"
+
+
+/* Compressed file layout; all integers are little-endian.
+ *
+ * File header:
+ *   0  magic "VRAWCMPR"
+ *   8  u32 version
+ *  12  u32 codec (enum vraw_compression)
+ *  16  u32 flags (VRAW_CMP_FLAG_*)
+ *  20  u32 chunk_count: number of independently compressed chunks
+ *      per frame
+ *  24  u64 frame_size: uncompressed frame size
+ *  32  u64 chunk_size: uncompressed chunk size (even)
+ *
+ * Frames: chunk_count u32 chunk sizes (with VRAW_CMP_CHUNK_STORED set
+ * for chunks stored uncompressed), then the chunk data; all chunks are
+ * chunk_size bytes when uncompressed, except the last one which holds
+ * the remainder of the frame.
+ *
+ * With VRAW_CMP_FLAG_DELTA, the frames between keyframes are delta
+ * frames: they are XORed with the previous frame before compression,
+ * and VRAW_CMP_CHUNK_DELTA is set in their first chunk size; the first
+ * frame is always a keyframe.
+ *
+ * Frame table, written when the file is closed: frame_count entries of
+ * a u64 frame offset and a u64 frame size (with VRAW_CMP_ENTRY_DELTA set
+ * for delta frames), then the footer:
+ *   0  u64 table offset
+ *   8  u64 frame_count
+ *  16  magic "VRAWCTAB"
+ * Without a valid footer (e.g. after a crash), the frames can still be
+ * found by walking through the frame chunk sizes. */
+#define VRAW_CMP_MAGIC "VRAWCMPR"
+#define VRAW_CMP_TABLE_MAGIC "VRAWCTAB"
+#define VRAW_CMP_MAGIC_SIZE 8
+#define VRAW_CMP_VERSION 1
+#define VRAW_CMP_HEADER_SIZE 40
+#define VRAW_CMP_ENTRY_SIZE 16
+#define VRAW_CMP_FOOTER_SIZE 24
+
+#define VRAW_CMP_OFFSET_VERSION 8
+#define VRAW_CMP_OFFSET_CODEC 12
+#define VRAW_CMP_OFFSET_FLAGS 16
+#define VRAW_CMP_OFFSET_CHUNK_COUNT 20
+#define VRAW_CMP_OFFSET_FRAME_SIZE 24
+#define VRAW_CMP_OFFSET_CHUNK_SIZE 32
+
+/* The samples are 16-bit, and the bytes of each chunk are shuffled
+ * before compression: all low bytes, then all high bytes */
+#define VRAW_CMP_FLAG_SHUFFLE16 (1 << 0)
+
+/* The file holds delta frames (XOR with the previous frame, before the
+ * byte shuffle) between keyframes */
+#define VRAW_CMP_FLAG_DELTA (1 << 1)
+
+#define VRAW_CMP_CHUNK_STORED (1U << 31)
+
+/* Delta frame marker, in the first chunk size; the chunk size is then
+ * less than this value */
+#define VRAW_CMP_CHUNK_DELTA (1U << 30)
+
+/* Delta frame marker, in the frame table frame size */
+#define VRAW_CMP_ENTRY_DELTA (1ULL << 63)
+
+/* Maximum number of chunks per frame */
+#define VRAW_CMP_MAX_CHUNKS 64
+
+
+/* Byte shuffle of 16-bit samples: low bytes first, then high bytes;
+ * len must be even */
+static inline void
+vraw_cmp_shuffle16(uint8_t *dst, const uint8_t *src, size_t len)
+{
+	size_t half = len / 2;
+
+	for (size_t i = 0; i < half; i++) {
+		dst[i] = src[2 * i];
+		dst[half + i] = src[2 * i + 1];
+	}
+}
+
+
+static inline void
+vraw_cmp_unshuffle16(uint8_t *dst, const uint8_t *src, size_t len)
+{
+	size_t half = len / 2;
+
+	for (size_t i = 0; i < half; i++) {
+		dst[2 * i] = src[i];
+		dst[2 * i + 1] = src[half + i];
+	}
+}
+
+
+#endif /* !_VRAW_CMP_H_ */
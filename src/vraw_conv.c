@@ -0,0 +1,257 @@
+/**
+ * Copyright (c) 2018 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if defined(__SSE2__)
+#	include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#	include <arm_neon.h>
+#endif
+
+#include "vraw_conv.h"
+
+
+static void deinterleave8(const uint8_t *src,
+			  uint8_t *dst0,
+			  uint8_t *dst1,
+			  size_t count)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	for (; i + 16 <= count; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+		__m128i b =
+			_mm_loadu_si128((const __m128i *)(src + 2 * i + 16));
+		__m128i e = _mm_packus_epi16(_mm_and_si128(a, mask),
+					     _mm_and_si128(b, mask));
+		__m128i o = _mm_packus_epi16(_mm_srli_epi16(a, 8),
+					     _mm_srli_epi16(b, 8));
+		_mm_storeu_si128((__m128i *)(dst0 + i), e);
+		_mm_storeu_si128((__m128i *)(dst1 + i), o);
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 16 <= count; i += 16) {
+		uint8x16x2_t v = vld2q_u8(src + 2 * i);
+		vst1q_u8(dst0 + i, v.val[0]);
+		vst1q_u8(dst1 + i, v.val[1]);
+	}
+#endif
+	for (; i < count; i++) {
+		dst0[i] = src[2 * i];
+		dst1[i] = src[2 * i + 1];
+	}
+}
+
+
+static void deinterleave16(const uint16_t *src,
+			   uint16_t *dst0,
+			   uint16_t *dst1,
+			   size_t count)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	/* Note: sign extension keeps the 16-bit patterns through the
+	 * signed saturating pack */
+	for (; i + 8 <= count; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+		__m128i b =
+			_mm_loadu_si128((const __m128i *)(src + 2 * i + 8));
+		__m128i e = _mm_packs_epi32(
+			_mm_srai_epi32(_mm_slli_epi32(a, 16), 16),
+			_mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+		__m128i o = _mm_packs_epi32(_mm_srai_epi32(a, 16),
+					    _mm_srai_epi32(b, 16));
+		_mm_storeu_si128((__m128i *)(dst0 + i), e);
+		_mm_storeu_si128((__m128i *)(dst1 + i), o);
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 8 <= count; i += 8) {
+		uint16x8x2_t v = vld2q_u16(src + 2 * i);
+		vst1q_u16(dst0 + i, v.val[0]);
+		vst1q_u16(dst1 + i, v.val[1]);
+	}
+#endif
+	for (; i < count; i++) {
+		dst0[i] = src[2 * i];
+		dst1[i] = src[2 * i + 1];
+	}
+}
+
+
+static void interleave8(const uint8_t *src0,
+			const uint8_t *src1,
+			uint8_t *dst,
+			size_t count)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	for (; i + 16 <= count; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(src0 + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(src1 + i));
+		_mm_storeu_si128((__m128i *)(dst + 2 * i),
+				 _mm_unpacklo_epi8(a, b));
+		_mm_storeu_si128((__m128i *)(dst + 2 * i + 16),
+				 _mm_unpackhi_epi8(a, b));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 16 <= count; i += 16) {
+		uint8x16x2_t v;
+		v.val[0] = vld1q_u8(src0 + i);
+		v.val[1] = vld1q_u8(src1 + i);
+		vst2q_u8(dst + 2 * i, v);
+	}
+#endif
+	for (; i < count; i++) {
+		dst[2 * i] = src0[i];
+		dst[2 * i + 1] = src1[i];
+	}
+}
+
+
+static void interleave16(const uint16_t *src0,
+			 const uint16_t *src1,
+			 uint16_t *dst,
+			 size_t count)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	for (; i + 8 <= count; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(src0 + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(src1 + i));
+		_mm_storeu_si128((__m128i *)(dst + 2 * i),
+				 _mm_unpacklo_epi16(a, b));
+		_mm_storeu_si128((__m128i *)(dst + 2 * i + 8),
+				 _mm_unpackhi_epi16(a, b));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 8 <= count; i += 8) {
+		uint16x8x2_t v;
+		v.val[0] = vld1q_u16(src0 + i);
+		v.val[1] = vld1q_u16(src1 + i);
+		vst2q_u16(dst + 2 * i, v);
+	}
+#endif
+	for (; i < count; i++) {
+		dst[2 * i] = src0[i];
+		dst[2 * i + 1] = src1[i];
+	}
+}
+
+
+static void swap8(const uint8_t *src, uint8_t *dst, size_t count)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	for (; i + 8 <= count; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+		a = _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8));
+		_mm_storeu_si128((__m128i *)(dst + 2 * i), a);
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 8 <= count; i += 8)
+		vst1q_u8(dst + 2 * i, vrev16q_u8(vld1q_u8(src + 2 * i)));
+#endif
+	for (; i < count; i++) {
+		uint8_t tmp = src[2 * i];
+		dst[2 * i] = src[2 * i + 1];
+		dst[2 * i + 1] = tmp;
+	}
+}
+
+
+static void swap16(const uint16_t *src, uint16_t *dst, size_t count)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	for (; i + 4 <= count; i += 4) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+		a = _mm_shufflelo_epi16(a, _MM_SHUFFLE(2, 3, 0, 1));
+		a = _mm_shufflehi_epi16(a, _MM_SHUFFLE(2, 3, 0, 1));
+		_mm_storeu_si128((__m128i *)(dst + 2 * i), a);
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 4 <= count; i += 4)
+		vst1q_u16(dst + 2 * i, vrev32q_u16(vld1q_u16(src + 2 * i)));
+#endif
+	for (; i < count; i++) {
+		uint16_t tmp = src[2 * i];
+		dst[2 * i] = src[2 * i + 1];
+		dst[2 * i + 1] = tmp;
+	}
+}
+
+
+void vraw_conv_deinterleave(const uint8_t *src,
+			    uint8_t *dst0,
+			    uint8_t *dst1,
+			    size_t count,
+			    size_t sample_size)
+{
+	/* Note: the rows of the supported formats are 16-bit aligned */
+	if (sample_size == 2) {
+		deinterleave16((const uint16_t *)src,
+			       (uint16_t *)dst0,
+			       (uint16_t *)dst1,
+			       count);
+	} else {
+		deinterleave8(src, dst0, dst1, count);
+	}
+}
+
+
+void vraw_conv_interleave(const uint8_t *src0,
+			  const uint8_t *src1,
+			  uint8_t *dst,
+			  size_t count,
+			  size_t sample_size)
+{
+	if (sample_size == 2) {
+		interleave16((const uint16_t *)src0,
+			     (const uint16_t *)src1,
+			     (uint16_t *)dst,
+			     count);
+	} else {
+		interleave8(src0, src1, dst, count);
+	}
+}
+
+
+void vraw_conv_swap(const uint8_t *src,
+		    uint8_t *dst,
+		    size_t count,
+		    size_t sample_size)
+{
+	if (sample_size == 2)
+		swap16((const uint16_t *)src, (uint16_t *)dst, count);
+	else
+		swap8(src, dst, count);
+}
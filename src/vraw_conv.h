@@ -0,0 +1,62 @@
+/**
+ * Copyright (c) 2018 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _VRAW_CONV_H_
+#define _VRAW_CONV_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* Chroma row conversion kernels between planar and semi-planar formats;
+ * count is the number of samples of each component, sample_size is 1 or
+ * 2 bytes; SSE2 or NEON is used when available */
+
+
+/* Split interleaved samples: even samples to dst0, odd samples to dst1 */
+void vraw_conv_deinterleave(const uint8_t *src,
+			    uint8_t *dst0,
+			    uint8_t *dst1,
+			    size_t count,
+			    size_t sample_size);
+
+
+/* Interleave samples: src0 to the even samples, src1 to the odd ones */
+void vraw_conv_interleave(const uint8_t *src0,
+			  const uint8_t *src1,
+			  uint8_t *dst,
+			  size_t count,
+			  size_t sample_size);
+
+
+/* Swap the samples of each pair of interleaved samples */
+void vraw_conv_swap(const uint8_t *src,
+		    uint8_t *dst,
+		    size_t count,
+		    size_t sample_size);
+
+
+#endif /* !_VRAW_CONV_H_ */
@@ -0,0 +1,169 @@
+/**
+ * Copyright (c) 2018 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#	include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#	include <arm_neon.h>
+#endif
+
+#include "vraw_decimate.h"
+
+
+#if defined(__SSE2__)
+
+/* Even bytes of a and b */
+static inline __m128i even8(__m128i a, __m128i b)
+{
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	return _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+}
+
+
+/* Even 16-bit words of a and b; note: sign extension keeps the 16-bit
+ * patterns through the signed saturating pack */
+static inline __m128i even16(__m128i a, __m128i b)
+{
+	return _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16),
+			       _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+}
+
+#endif
+
+
+static void decimate8_2(uint8_t *dst, const uint8_t *src, size_t count)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	for (; i + 16 <= count; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+		__m128i b =
+			_mm_loadu_si128((const __m128i *)(src + 2 * i + 16));
+		_mm_storeu_si128((__m128i *)(dst + i), even8(a, b));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 16 <= count; i += 16)
+		vst1q_u8(dst + i, vld2q_u8(src + 2 * i).val[0]);
+#endif
+	for (; i < count; i++)
+		dst[i] = src[2 * i];
+}
+
+
+static void decimate8_4(uint8_t *dst, const uint8_t *src, size_t count)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	for (; i + 16 <= count; i += 16) {
+		const uint8_t *s = src + 4 * i;
+		__m128i a = _mm_loadu_si128((const __m128i *)s);
+		__m128i b = _mm_loadu_si128((const __m128i *)(s + 16));
+		__m128i c = _mm_loadu_si128((const __m128i *)(s + 32));
+		__m128i d = _mm_loadu_si128((const __m128i *)(s + 48));
+		_mm_storeu_si128((__m128i *)(dst + i),
+				 even8(even8(a, b), even8(c, d)));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 16 <= count; i += 16)
+		vst1q_u8(dst + i, vld4q_u8(src + 4 * i).val[0]);
+#endif
+	for (; i < count; i++)
+		dst[i] = src[4 * i];
+}
+
+
+static void decimate16_2(uint16_t *dst, const uint16_t *src, size_t count)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	for (; i + 8 <= count; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+		__m128i b =
+			_mm_loadu_si128((const __m128i *)(src + 2 * i + 8));
+		_mm_storeu_si128((__m128i *)(dst + i), even16(a, b));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 8 <= count; i += 8)
+		vst1q_u16(dst + i, vld2q_u16(src + 2 * i).val[0]);
+#endif
+	for (; i < count; i++)
+		dst[i] = src[2 * i];
+}
+
+
+static void decimate16_4(uint16_t *dst, const uint16_t *src, size_t count)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	for (; i + 8 <= count; i += 8) {
+		const uint16_t *s = src + 4 * i;
+		__m128i a = _mm_loadu_si128((const __m128i *)s);
+		__m128i b = _mm_loadu_si128((const __m128i *)(s + 8));
+		__m128i c = _mm_loadu_si128((const __m128i *)(s + 16));
+		__m128i d = _mm_loadu_si128((const __m128i *)(s + 24));
+		_mm_storeu_si128((__m128i *)(dst + i),
+				 even16(even16(a, b), even16(c, d)));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 8 <= count; i += 8)
+		vst1q_u16(dst + i, vld4q_u16(src + 4 * i).val[0]);
+#endif
+	for (; i < count; i++)
+		dst[i] = src[4 * i];
+}
+
+
+void vraw_decimate(uint8_t *dst,
+		   const uint8_t *src,
+		   size_t count,
+		   size_t elem_size,
+		   unsigned int factor)
+{
+	/* Note: the rows of the 16-bit formats are 16-bit aligned */
+	if ((elem_size == 1) && (factor == 2)) {
+		decimate8_2(dst, src, count);
+	} else if ((elem_size == 1) && (factor == 4)) {
+		decimate8_4(dst, src, count);
+	} else if ((elem_size == 2) && (factor == 2)) {
+		decimate16_2((uint16_t *)dst, (const uint16_t *)src, count);
+	} else if ((elem_size == 2) && (factor == 4)) {
+		decimate16_4((uint16_t *)dst, (const uint16_t *)src, count);
+	} else if (elem_size == 4) {
+		for (size_t x = 0; x < count; x++)
+			memcpy(dst + x * 4, src + x * factor * 4, 4);
+	} else {
+		for (size_t x = 0; x < count; x++)
+			memcpy(dst + x * elem_size,
+			       src + x * factor * elem_size,
+			       elem_size);
+	}
+}
@@ -0,0 +1,65 @@
+/**
+ * Copyright (c) 2018 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if defined(__SSE2__)
+#	include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#	include <arm_neon.h>
+#endif
+
+#include "vraw_delta.h"
+
+
+void vraw_delta_xor(uint8_t *dst,
+		    const uint8_t *src,
+		    const uint8_t *ref,
+		    size_t len)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	for (; i + 32 <= len; i += 32) {
+		__m128i a0 = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i a1 = _mm_loadu_si128((const __m128i *)(src + i + 16));
+		__m128i b0 = _mm_loadu_si128((const __m128i *)(ref + i));
+		__m128i b1 = _mm_loadu_si128((const __m128i *)(ref + i + 16));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(a0, b0));
+		_mm_storeu_si128((__m128i *)(dst + i + 16),
+				 _mm_xor_si128(a1, b1));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 32 <= len; i += 32) {
+		uint8x16_t a0 = vld1q_u8(src + i);
+		uint8x16_t a1 = vld1q_u8(src + i + 16);
+		uint8x16_t b0 = vld1q_u8(ref + i);
+		uint8x16_t b1 = vld1q_u8(ref + i + 16);
+		vst1q_u8(dst + i, veorq_u8(a0, b0));
+		vst1q_u8(dst + i + 16, veorq_u8(a1, b1));
+	}
+#endif
+	for (; i < len; i++)
+		dst[i] = src[i] ^ ref[i];
+}
@@ -0,0 +1,353 @@
+/**
+ * Copyright (c) 2018 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <video-raw/vraw.h>
+
+#define ULOG_TAG vraw
+#include <ulog.h>
+
+
+/* Default number of frames queued per output */
+#define DEFAULT_QUEUE_DEPTH 4
+
+
+/* Packed frame buffer, shared by all outputs; the frame data follows the
+ * structure */
+struct vraw_fanout_buf {
+	unsigned int refs;
+	struct vraw_fanout_buf *next;
+};
+
+
+struct vraw_fanout {
+	struct vraw_writer_config cfg;
+	struct vraw_writer **writers;
+	int *status;
+	unsigned int output_count;
+	unsigned int plane_count;
+	size_t plane_stride[VDEF_RAW_MAX_PLANE_COUNT];
+	size_t plane_size[VDEF_RAW_MAX_PLANE_COUNT];
+	size_t frame_size;
+
+	/* Protected by the mutex: free buffers list and write errors */
+	bool mutex_created;
+	pthread_mutex_t mutex;
+	struct vraw_fanout_buf *free_bufs;
+};
+
+
+static uint8_t *buf_data(struct vraw_fanout_buf *buf)
+{
+	return (uint8_t *)(buf + 1);
+}
+
+
+static struct vraw_fanout_buf *buf_from_data(const uint8_t *data)
+{
+	return (struct vraw_fanout_buf *)data - 1;
+}
+
+
+static void buf_release(struct vraw_fanout *self, struct vraw_fanout_buf *buf)
+{
+	pthread_mutex_lock(&self->mutex);
+	buf->refs--;
+	if (buf->refs == 0) {
+		buf->next = self->free_bufs;
+		self->free_bufs = buf;
+	}
+	pthread_mutex_unlock(&self->mutex);
+}
+
+
+static struct vraw_fanout_buf *buf_get(struct vraw_fanout *self)
+{
+	struct vraw_fanout_buf *buf;
+
+	pthread_mutex_lock(&self->mutex);
+	buf = self->free_bufs;
+	if (buf != NULL)
+		self->free_bufs = buf->next;
+	pthread_mutex_unlock(&self->mutex);
+
+	/* There are at most as many buffers as frames in flight on the
+	 * slowest output */
+	if (buf == NULL) {
+		buf = malloc(sizeof(*buf) + self->frame_size);
+		if (buf == NULL)
+			return NULL;
+	}
+	buf->refs = 0;
+	buf->next = NULL;
+
+	return buf;
+}
+
+
+static void frame_done_cb(struct vraw_writer *writer,
+			  const struct vraw_frame *frame,
+			  int status,
+			  void *userdata)
+{
+	struct vraw_fanout *self = userdata;
+
+	if (status < 0) {
+		/* Keep the first error of each output */
+		pthread_mutex_lock(&self->mutex);
+		for (unsigned int i = 0; i < self->output_count; i++) {
+			if ((self->writers[i] == writer) &&
+			    (self->status[i] == 0))
+				self->status[i] = status;
+		}
+		pthread_mutex_unlock(&self->mutex);
+	}
+
+	buf_release(self, buf_from_data(frame->cdata[0]));
+}
+
+
+static int output_new(struct vraw_fanout *self,
+		      const struct vraw_fanout_output *output,
+		      struct vraw_writer **ret_obj)
+{
+	struct vraw_writer_config config = self->cfg;
+
+	config.y4m = output->y4m;
+	config.backend = output->backend;
+
+	if (output->filename != NULL)
+		return vraw_writer_new(output->filename, &config, ret_obj);
+	else if (output->sink.write != NULL)
+		return vraw_writer_new_sink(&output->sink, &config, ret_obj);
+	else
+		return vraw_writer_new_from_fd(output->fd, &config, ret_obj);
+}
+
+
+int vraw_fanout_new(const struct vraw_fanout_output *outputs,
+		    unsigned int output_count,
+		    const struct vraw_writer_config *config,
+		    struct vraw_fanout **ret_obj)
+{
+	int res;
+	struct vraw_fanout *self = NULL;
+
+	ULOG_ERRNO_RETURN_ERR_IF(outputs == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(output_count == 0, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config == NULL, EINVAL);
+	/* Note: the frames are packed in the file format, without
+	 * conversion */
+	ULOG_ERRNO_RETURN_ERR_IF(
+		(config->input_format.data_layout !=
+		 VDEF_RAW_DATA_LAYOUT_UNKNOWN) &&
+			!vdef_raw_format_cmp(&config->input_format,
+					     &config->format),
+		EINVAL);
+	/* Note: the per-output callback is used internally */
+	ULOG_ERRNO_RETURN_ERR_IF(config->cbs.frame_done != NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(ret_obj == NULL, EINVAL);
+
+	self = calloc(1, sizeof(*self));
+	if (self == NULL)
+		return -ENOMEM;
+
+	self->cfg = *config;
+	if (self->cfg.queue_depth == 0)
+		self->cfg.queue_depth = DEFAULT_QUEUE_DEPTH;
+	self->cfg.cbs.frame_done = &frame_done_cb;
+	self->cfg.userdata = self;
+
+	/* Packed frame geometry */
+	res = vdef_calc_raw_frame_size(&self->cfg.format,
+				       &self->cfg.info.resolution,
+				       self->plane_stride,
+				       NULL,
+				       NULL,
+				       NULL,
+				       self->plane_size,
+				       NULL);
+	if (res < 0) {
+		ULOG_ERRNO("vdef_calc_raw_frame_size", -res);
+		goto error;
+	}
+	self->plane_count = vdef_get_raw_frame_plane_count(&self->cfg.format);
+	for (unsigned int p = 0; p < self->plane_count; p++)
+		self->frame_size += self->plane_size[p];
+
+	res = pthread_mutex_init(&self->mutex, NULL);
+	if (res != 0) {
+		ULOG_ERRNO("pthread_mutex_init", res);
+		res = -res;
+		goto error;
+	}
+	self->mutex_created = true;
+
+	self->writers = calloc(output_count, sizeof(*self->writers));
+	self->status = calloc(output_count, sizeof(*self->status));
+	if ((self->writers == NULL) || (self->status == NULL)) {
+		res = -ENOMEM;
+		goto error;
+	}
+	self->output_count = output_count;
+
+	for (unsigned int i = 0; i < output_count; i++) {
+		res = output_new(self, &outputs[i], &self->writers[i]);
+		if (res < 0) {
+			ULOG_ERRNO("output %u", -res, i);
+			goto error;
+		}
+	}
+
+	*ret_obj = self;
+	return 0;
+
+error:
+	(void)vraw_fanout_destroy(self);
+	*ret_obj = NULL;
+	return res;
+}
+
+
+int vraw_fanout_destroy(struct vraw_fanout *self)
+{
+	int res = 0, err;
+	struct vraw_fanout_buf *buf;
+
+	if (self == NULL)
+		return 0;
+
+	/* Note: destroying the writers writes the queued frames, after
+	 * which all buffers are released */
+	for (unsigned int i = 0; i < self->output_count; i++) {
+		err = vraw_writer_destroy(self->writers[i]);
+		if (res == 0)
+			res = err;
+		if (res == 0)
+			res = self->status[i];
+	}
+
+	while (self->free_bufs != NULL) {
+		buf = self->free_bufs;
+		self->free_bufs = buf->next;
+		free(buf);
+	}
+	if (self->mutex_created)
+		pthread_mutex_destroy(&self->mutex);
+	free(self->writers);
+	free(self->status);
+	free(self);
+	return res;
+}
+
+
+int vraw_fanout_frame_write(struct vraw_fanout *self,
+			    const struct vraw_frame *frame)
+{
+	int res = 0, err;
+	struct vraw_fanout_buf *buf;
+	struct vraw_frame packed;
+	uint8_t *dst;
+	const uint8_t *src;
+	size_t lines;
+
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(frame == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(
+		!vdef_raw_format_cmp(&frame->frame.format, &self->cfg.format),
+		EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF((frame->frame.info.resolution.width != 0) &&
+					 (frame->frame.info.resolution.width !=
+					  self->cfg.info.resolution.width),
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF((frame->frame.info.resolution.height != 0) &&
+					 (frame->frame.info.resolution.height !=
+					  self->cfg.info.resolution.height),
+				 EINVAL);
+	for (unsigned int p = 0; p < self->plane_count; p++) {
+		ULOG_ERRNO_RETURN_ERR_IF(frame->cdata[p] == NULL, EINVAL);
+		ULOG_ERRNO_RETURN_ERR_IF(frame->frame.plane_stride[p] <
+						 self->plane_stride[p],
+					 EINVAL);
+	}
+
+	buf = buf_get(self);
+	if (buf == NULL)
+		return -ENOMEM;
+
+	/* Gather the rows once for all outputs; the packed frame is then
+	 * written with a single write per output */
+	packed = *frame;
+	dst = buf_data(buf);
+	for (unsigned int p = 0; p < self->plane_count; p++) {
+		src = frame->cdata[p];
+		packed.cdata[p] = dst;
+		packed.frame.plane_stride[p] = self->plane_stride[p];
+		if (frame->frame.plane_stride[p] == self->plane_stride[p]) {
+			memcpy(dst, src, self->plane_size[p]);
+			dst += self->plane_size[p];
+			continue;
+		}
+		lines = self->plane_size[p] / self->plane_stride[p];
+		for (size_t i = 0; i < lines; i++) {
+			memcpy(dst, src, self->plane_stride[p]);
+			dst += self->plane_stride[p];
+			src += frame->frame.plane_stride[p];
+		}
+	}
+
+	/* One reference per output, plus one until all the frames are
+	 * queued */
+	buf->refs = self->output_count + 1;
+	for (unsigned int i = 0; i < self->output_count; i++) {
+		err = vraw_writer_frame_write(self->writers[i], &packed);
+		if (err < 0) {
+			/* Not queued: no frame_done callback */
+			buf_release(self, buf);
+			if ((res == 0) || (res == -EAGAIN))
+				res = err;
+		}
+	}
+	buf_release(self, buf);
+
+	return res;
+}
+
+
+int vraw_fanout_get_stats(struct vraw_fanout *self,
+			  unsigned int index,
+			  struct vraw_writer_stats *stats)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(index >= self->output_count, EINVAL);
+
+	return vraw_writer_get_stats(self->writers[index], stats);
+}
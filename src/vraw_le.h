@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) 2018 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _VRAW_LE_H_
+#define _VRAW_LE_H_
+
+#include <stdint.h>
+
+
+/* Little-endian integer encoding of the internal file structures */
+
+
+static inline void vraw_le_put_u32(uint8_t *buf, uint32_t val)
+{
+	for (unsigned int i = 0; i < 4; i++)
+		buf[i] = (val >> (8 * i)) & 0xff;
+}
+
+
+static inline void vraw_le_put_u64(uint8_t *buf, uint64_t val)
+{
+	for (unsigned int i = 0; i < 8; i++)
+		buf[i] = (val >> (8 * i)) & 0xff;
+}
+
+
+static inline uint32_t vraw_le_get_u32(const uint8_t *buf)
+{
+	uint32_t val = 0;
+
+	for (unsigned int i = 0; i < 4; i++)
+		val |= (uint32_t)buf[i] << (8 * i);
+	return val;
+}
+
+
+static inline uint64_t vraw_le_get_u64(const uint8_t *buf)
+{
+	uint64_t val = 0;
+
+	for (unsigned int i = 0; i < 8; i++)
+		val |= (uint64_t)buf[i] << (8 * i);
+	return val;
+}
+
+
+#endif /* !_VRAW_LE_H_ */
@@ -30,16 +30,37 @@
 #	endif /* _FILE_OFFSET_BITS */
 #endif /* ANDROID */
 
+#ifndef _GNU_SOURCE
+#	define _GNU_SOURCE
+#endif /* _GNU_SOURCE */
+
 #include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <limits.h>
 #include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <video-raw/vraw.h>
 
+#include "vraw_cmp.h"
+#include "vraw_decimate.h"
+#include "vraw_delta.h"
+#include "vraw_ring.h"
+#include "vraw_split.h"
+#include "vraw_ts.h"
+
 #define ULOG_TAG vraw
 #include <ulog.h>
 
+#include <lz4.h>
 #include <pthread.h>
 #define NB_SUPPORTED_FORMATS 32
 static struct vdef_raw_format supported_formats[NB_SUPPORTED_FORMATS];
@@ -81,45 +102,107 @@ static void initialize_supported_formats(void)
 }
 
 
+/* Number of frames before the end of a segment at which the next segment is
+ * opened and its first frame prefetched */
+#define SEGMENT_PREFETCH_FRAMES 8
+
+
+struct vraw_reader_segment {
+	char *filename;
+	FILE *file;
+	size_t file_size;
+	size_t header_offset;
+	size_t frame_count;
+	unsigned int first_index;
+};
+
+
 struct vraw_reader {
 	struct vraw_reader_config cfg;
-	char *filename;
+	struct vraw_reader_segment *segments;
+	unsigned int segment_count;
+	unsigned int cur_segment;
 	FILE *file;
 	int reverse;
 	size_t header_offset;
 	size_t frame_header_size;
 	size_t plane_stride[VDEF_RAW_MAX_PLANE_COUNT];
 	size_t plane_size[VDEF_RAW_MAX_PLANE_COUNT];
+	size_t plane_offset[VDEF_RAW_MAX_PLANE_COUNT];
 	size_t frame_size;
+	size_t file_plane_stride[VDEF_RAW_MAX_PLANE_COUNT];
+	size_t file_plane_scanline[VDEF_RAW_MAX_PLANE_COUNT];
+	size_t file_plane_size[VDEF_RAW_MAX_PLANE_COUNT];
+	size_t file_plane_offset[VDEF_RAW_MAX_PLANE_COUNT];
 	size_t file_frame_size;
-	size_t file_size;
+	struct vdef_dim resolution;
+	size_t elem_size[VDEF_RAW_MAX_PLANE_COUNT];
+	uint8_t *row_buf;
 	size_t file_frame_count;
+	unsigned int end_index;
+	unsigned int file_index;
 	uint64_t timestamp;
 	unsigned int index;
 	unsigned int count;
+	struct vraw_reader_stats stats;
+	uint64_t *ring_ts;
+	unsigned int ring_slots;
+	unsigned int ring_head;
+	unsigned int ring_count;
+	unsigned int cmp_chunks;
+	size_t cmp_chunk_size;
+	bool cmp_shuffle;
+	uint64_t *cmp_offsets;
+	uint64_t *cmp_sizes;
+	unsigned int *cmp_keys;
+	size_t cmp_count;
+	bool cmp_delta;
+	uint8_t *cmp_buf;
+	uint8_t *cmp_frame;
+	unsigned int cmp_frame_index;
+	uint8_t *cmp_delta_buf;
+	uint8_t *cmp_scratch;
+	uint8_t *ts_map;
+	size_t ts_map_size;
+	size_t ts_entry_size;
+	size_t ts_count;
+	FILE *split_files[VDEF_RAW_MAX_PLANE_COUNT];
+	unsigned int split_index[VDEF_RAW_MAX_PLANE_COUNT];
+	size_t split_count;
 };
 
 
-static int y4m_header_read(struct vraw_reader *self)
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static int y4m_header_read(struct vraw_reader *self,
+			   struct vraw_reader_segment *seg,
+			   struct vraw_reader_config *cfg)
 {
 	int res;
 	char str[100], *r, *p, *p2, *tmp;
 	off_t off;
 
-	r = fgets(str, sizeof(str), self->file);
+	r = fgets(str, sizeof(str), seg->file);
 	if (r == NULL) {
 		res = -errno;
 		ULOG_ERRNO("fgets", -res);
 		return res;
 	}
 
-	off = ftello(self->file);
+	off = ftello(seg->file);
 	if (off < 0) {
 		res = -errno;
 		ULOG_ERRNO("ftello", -res);
 		return res;
 	}
-	self->header_offset = off;
+	seg->header_offset = off;
 
 	self->frame_header_size = strlen("FRAME\n");
 
@@ -131,7 +214,7 @@ static int y4m_header_read(struct vraw_reader *self)
 		return res;
 	}
 
-	self->cfg.format = vdef_i420;
+	cfg->format = vdef_i420;
 
 	while (p) {
 		if (strlen(p) < 2) {
@@ -141,30 +224,30 @@ static int y4m_header_read(struct vraw_reader *self)
 
 		switch (p[0]) {
 		case 'W':
-			self->cfg.info.resolution.width = atoi(p + 1);
+			cfg->info.resolution.width = atoi(p + 1);
 			break;
 		case 'H':
-			self->cfg.info.resolution.height = atoi(p + 1);
+			cfg->info.resolution.height = atoi(p + 1);
 			break;
 		case 'F':
 			p2 = strchr(p, ':');
 			if (p2) {
-				self->cfg.info.framerate.num = atoi(p + 1);
-				self->cfg.info.framerate.den = atoi(p2 + 1);
+				cfg->info.framerate.num = atoi(p + 1);
+				cfg->info.framerate.den = atoi(p2 + 1);
 			}
 			break;
 		case 'A':
 			p2 = strchr(p, ':');
 			if (p2) {
-				self->cfg.info.sar.width = atoi(p + 1);
-				self->cfg.info.sar.height = atoi(p2 + 1);
+				cfg->info.sar.width = atoi(p + 1);
+				cfg->info.sar.height = atoi(p2 + 1);
 			}
 			break;
 		case 'C':
 			if (strcmp(p + 1, "420") == 0)
-				self->cfg.format = vdef_i420;
+				cfg->format = vdef_i420;
 			else if (strcmp(p + 1, "420p10") == 0)
-				self->cfg.format = vdef_i420_10_16le;
+				cfg->format = vdef_i420_10_16le;
 		default:
 			break;
 		}
@@ -182,289 +265,1164 @@ static int y4m_frame_header_read(struct vraw_reader *self)
 	char str[10], *r;
 
 	r = fgets(str, sizeof(str), self->file);
+	self->stats.io_calls++;
 	if (r == NULL) {
-		res = -errno;
-		if (!feof(self->file))
-			ULOG_ERRNO("fgets", -res);
+		res = feof(self->file) ? -ENODATA : -errno;
+		ULOG_ERRNO("fgets", -res);
 		return res;
 	}
+	self->stats.bytes += strlen(str);
 	if (strcmp(str, "FRAME\n")) {
 		res = -EPROTO;
 		ULOG_ERRNO("failed to read y4m frame header", -res);
-		return -res;
+		return res;
 	}
 
 	return 0;
 }
 
 
-static int seek_to_previous_frame(struct vraw_reader *self)
+static int segment_open(struct vraw_reader_segment *seg)
 {
 	int res;
-	off_t cur_offset;
-	off_t seek_to = (off_t)-2 * self->file_frame_size;
 
-	/* Note: the current position is the beginning of the next frame;
-	 * thus to seek to the beginning of the previous frame, the offset
-	 * is -2 times the frame size */
+	if (seg->file != NULL)
+		return 0;
 
-	cur_offset = ftello(self->file);
-	if (cur_offset < 0) {
+	seg->file = fopen(seg->filename, "rb");
+	if (seg->file == NULL) {
 		res = -errno;
-		ULOG_ERRNO("ftello", -res);
+		ULOG_ERRNO("fopen('%s')", -res, seg->filename);
 		return res;
 	}
 
-	if (cur_offset + seek_to < 0)
-		return -EOVERFLOW;
+	return 0;
+}
 
-	res = fseeko(self->file, seek_to, SEEK_CUR);
-	if (res < 0) {
-		res = -errno;
-		ULOG_ERRNO("fseeko", -res);
-		return res;
+
+static void segment_close(struct vraw_reader_segment *seg)
+{
+	if (seg->file == NULL)
+		return;
+
+	fclose(seg->file);
+	seg->file = NULL;
+}
+
+
+static int segment_find(struct vraw_reader *self, unsigned int index)
+{
+	unsigned int low = 0, high = self->segment_count;
+
+	/* Binary search of the last segment starting before index */
+	while (high - low > 1) {
+		unsigned int mid = (low + high) / 2;
+		if (self->segments[mid].first_index <= index)
+			low = mid;
+		else
+			high = mid;
 	}
 
-	if (self->cfg.y4m) {
-		seek_to = -2 * self->frame_header_size;
+	return low;
+}
 
-		cur_offset = ftello(self->file);
-		if (cur_offset < 0) {
-			res = -errno;
-			ULOG_ERRNO("ftello", -res);
-			return res;
-		}
 
-		if (cur_offset + seek_to < 0)
-			return -EOVERFLOW;
+static void segment_prefetch(struct vraw_reader *self, unsigned int s)
+{
+	int res;
+	struct vraw_reader_segment *seg = &self->segments[s];
+	size_t frame_size = self->file_frame_size + self->frame_header_size;
+	off_t offset = seg->header_offset;
+
+	if (seg->file != NULL)
+		return;
+
+	res = segment_open(seg);
+	if (res < 0)
+		return;
+
+	/* Ask for the readahead of the first frame in reading order */
+	if (self->reverse && seg->frame_count > 0)
+		offset += (off_t)(seg->frame_count - 1) * frame_size;
+	res = posix_fadvise(
+		fileno(seg->file), offset, frame_size, POSIX_FADV_WILLNEED);
+	if (res != 0)
+		ULOG_ERRNO("posix_fadvise", res);
+}
+
 
-		res = fseeko(self->file, seek_to, SEEK_CUR);
-		if (res < 0) {
-			res = -errno;
-			ULOG_ERRNO("fseeko", -res);
+static int segment_select(struct vraw_reader *self,
+			  unsigned int index,
+			  off_t *offset)
+{
+	int res;
+	unsigned int s, local_index, remaining;
+	struct vraw_reader_segment *seg = &self->segments[self->cur_segment];
+
+	if ((index < seg->first_index) ||
+	    (index >= seg->first_index + seg->frame_count)) {
+		s = segment_find(self, index);
+		seg = &self->segments[s];
+
+		res = segment_open(seg);
+		if (res < 0)
 			return res;
+
+		/* Only keep the current segment and its neighbours open */
+		for (unsigned int t = 0; t < self->segment_count; t++) {
+			if ((t + 1 < s) || (t > s + 1))
+				segment_close(&self->segments[t]);
 		}
+
+		self->cur_segment = s;
+		self->file = seg->file;
+		self->header_offset = seg->header_offset;
+		self->file_index = UINT_MAX;
+	}
+
+	/* Open the next segment in reading order and prefetch its first
+	 * frame before reaching the end of the current segment */
+	local_index = index - seg->first_index;
+	remaining = self->reverse ? local_index
+				  : seg->frame_count - 1 - local_index;
+	if (remaining < SEGMENT_PREFETCH_FRAMES * self->cfg.frame_step) {
+		s = self->cur_segment;
+		if (self->reverse && s > 0)
+			segment_prefetch(self, s - 1);
+		else if (!self->reverse && s + 1 < self->segment_count)
+			segment_prefetch(self, s + 1);
 	}
 
-	self->index -= 2;
+	*offset = (off_t)self->header_offset +
+		  (off_t)local_index *
+			  (self->file_frame_size + self->frame_header_size);
 
 	return 0;
 }
 
 
-int vraw_reader_new(const char *filename,
-		    const struct vraw_reader_config *config,
-		    struct vraw_reader **ret_obj)
+static unsigned int ring_slot(struct vraw_reader *self, unsigned int index)
 {
-	int res = 0;
-	struct vraw_reader *self = NULL;
-	unsigned int plane_count;
-	bool align_constrained = false;
-	float file_frame_count;
-	off_t off = 0;
+	/* The oldest frame is count slots before the head */
+	return (self->ring_head + self->ring_slots - self->ring_count +
+		index) %
+	       self->ring_slots;
+}
 
-	(void)pthread_once(&supported_formats_is_init,
-			   initialize_supported_formats);
 
-	ULOG_ERRNO_RETURN_ERR_IF(filename == NULL, EINVAL);
-	ULOG_ERRNO_RETURN_ERR_IF(config == NULL, EINVAL);
-	ULOG_ERRNO_RETURN_ERR_IF(ret_obj == NULL, EINVAL);
-	ULOG_ERRNO_RETURN_ERR_IF(config->start_reversed && config->loop != -1,
-				 EINVAL);
-	if (!config->y4m) {
-		/* Format, bit depth, width and height must be provided */
-		ULOG_ERRNO_RETURN_ERR_IF(config->info.resolution.width == 0,
-					 EINVAL);
-		ULOG_ERRNO_RETURN_ERR_IF(config->info.resolution.height == 0,
-					 EINVAL);
-		ULOG_ERRNO_RETURN_ERR_IF(
-			!vdef_raw_format_intersect(&config->format,
-						   supported_formats,
-						   NB_SUPPORTED_FORMATS),
-			EINVAL);
+static int seek_to_frame(struct vraw_reader *self, unsigned int index)
+{
+	int res;
+	off_t offset;
+
+	/* Note: the file index is a slot index for ring files */
+	if (self->cfg.ring)
+		index = ring_slot(self, index);
+
+	/* Note: all frames (and y4m frame headers) have the same size;
+	 * the offset of any frame can thus be computed directly */
+	res = segment_select(self, index, &offset);
+	if (res < 0)
+		return res;
+
+	if (index == self->file_index)
+		return 0;
+
+	res = fseeko(self->file, offset, SEEK_SET);
+	self->stats.seeks++;
+	if (res < 0) {
+		res = -errno;
+		ULOG_ERRNO("fseeko", -res);
+		return res;
 	}
+	self->file_index = index;
 
-	self = calloc(1, sizeof(*self));
-	if (self == NULL)
-		return -ENOMEM;
+	return 0;
+}
 
-	self->cfg = *config;
 
-	self->filename = strdup(filename);
-	if (self->filename == NULL) {
-		res = -ENOMEM;
-		goto error;
+static int subsample_setup(struct vraw_reader *self)
+{
+	unsigned int plane_count, factor = self->cfg.subsample;
+	size_t row_buf_size = 0;
+
+	/* Only linear formats with byte-aligned samples can be decimated
+	 * by picking samples; both dimensions must be multiples of twice
+	 * the factor for the chroma planes */
+	if ((self->cfg.format.pix_layout != VDEF_RAW_PIX_LAYOUT_LINEAR) ||
+	    (self->cfg.format.data_size % 8 != 0) ||
+	    (self->cfg.info.resolution.width % (2 * factor) != 0) ||
+	    (self->cfg.info.resolution.height % (2 * factor) != 0)) {
+		ULOG_ERRNO("unsupported subsampling by %u for format "
+			   VDEF_RAW_FORMAT_TO_STR_FMT " %ux%u",
+			   EINVAL,
+			   factor,
+			   VDEF_RAW_FORMAT_TO_STR_ARG(&self->cfg.format),
+			   self->cfg.info.resolution.width,
+			   self->cfg.info.resolution.height);
+		return -EINVAL;
 	}
 
-	self->file = fopen(self->filename, "rb");
-	if (self->file == NULL) {
-		res = -errno;
-		ULOG_ERRNO("fopen('%s')", -res, self->filename);
-		goto error;
+	self->resolution.width = self->cfg.info.resolution.width / factor;
+	self->resolution.height = self->cfg.info.resolution.height / factor;
+
+	/* Element size: one sample, or a pair of samples for the
+	 * interleaved chroma plane of semi-planar formats */
+	plane_count = vdef_get_raw_frame_plane_count(&self->cfg.format);
+	for (unsigned int p = 0; p < plane_count; ++p) {
+		self->elem_size[p] = self->cfg.format.data_size / 8;
+		if ((self->cfg.format.data_layout ==
+		     VDEF_RAW_DATA_LAYOUT_SEMI_PLANAR) &&
+		    (p == 1))
+			self->elem_size[p] *= 2;
+		if (self->file_plane_stride[p] > row_buf_size)
+			row_buf_size = self->file_plane_stride[p];
 	}
 
+	self->row_buf = malloc(row_buf_size);
+	if (self->row_buf == NULL)
+		return -ENOMEM;
+
+	return 0;
+}
+
+
+static int segment_init(struct vraw_reader *self,
+			struct vraw_reader_segment *seg,
+			struct vraw_reader_config *cfg)
+{
+	int res;
+	off_t off;
+
+	res = segment_open(seg);
+	if (res < 0)
+		return res;
+
 	/* Seek to the end of file */
-	off = fseeko(self->file, 0L, SEEK_END);
+	off = fseeko(seg->file, 0L, SEEK_END);
 	if (off < 0) {
 		res = -errno;
 		ULOG_ERRNO("fseeko", -res);
-		goto error;
+		return res;
 	}
 
-	off = ftello(self->file);
+	off = ftello(seg->file);
 	if (off < 0) {
 		res = -errno;
 		ULOG_ERRNO("ftello", -res);
-		goto error;
+		return res;
 	}
-	self->file_size = off;
+	seg->file_size = off;
 
 	/* Seek back to the beginning of file */
-	off = fseeko(self->file, 0L, SEEK_SET);
+	off = fseeko(seg->file, 0L, SEEK_SET);
 	if (off < 0) {
 		res = -errno;
 		ULOG_ERRNO("fseeko", -res);
-		goto error;
+		return res;
 	}
 
-	if (self->cfg.y4m) {
-		res = y4m_header_read(self);
+	if (cfg->y4m) {
+		res = y4m_header_read(self, seg, cfg);
 		if (res < 0)
-			goto error;
+			return res;
 	}
 
-	/* Enforce the configuration */
-	if (vdef_frac_is_null(&self->cfg.info.framerate)) {
-		self->cfg.info.framerate.num = 30;
-		self->cfg.info.framerate.den = 1;
-	}
-	if (vdef_dim_is_null(&self->cfg.info.sar)) {
-		self->cfg.info.sar.width = 1;
-		self->cfg.info.sar.height = 1;
+	return 0;
+}
+
+
+static int ring_init(struct vraw_reader *self)
+{
+	int res;
+	ssize_t res1;
+	struct vraw_reader_segment *seg = &self->segments[0];
+	uint8_t *trailer = NULL;
+	size_t trailer_size;
+	off_t offset;
+	unsigned int slots = 0;
+
+	/* The slot count is deduced from the file size, then checked
+	 * against the trailer */
+	if (seg->file_size > VRAW_RING_HEADER_SIZE) {
+		slots = (seg->file_size - VRAW_RING_HEADER_SIZE) /
+			(self->file_frame_size + VRAW_RING_TS_SIZE);
 	}
-	if (vdef_dim_is_null(&self->cfg.info.resolution)) {
+	trailer_size = vraw_ring_trailer_size(slots);
+	offset = (off_t)slots * self->file_frame_size;
+	if ((slots == 0) || (offset + trailer_size != seg->file_size)) {
 		res = -EPROTO;
-		ULOG_ERRNO("invalid video dimensions %dx%d",
+		ULOG_ERRNO("invalid ring file size: %zu ('%s')",
 			   -res,
-			   self->cfg.info.resolution.width,
-			   self->cfg.info.resolution.height);
-		goto error;
+			   seg->file_size,
+			   seg->filename);
+		return res;
 	}
 
-	plane_count = vdef_get_raw_frame_plane_count(&self->cfg.format);
+	trailer = malloc(trailer_size);
+	if (trailer == NULL)
+		return -ENOMEM;
 
-	for (unsigned int p = 0; p < plane_count; ++p) {
-		align_constrained = (self->cfg.plane_stride_align[p] ||
-				     self->cfg.plane_scanline_align[p] ||
-				     self->cfg.plane_size_align[p]);
-		if (align_constrained)
-			break;
+	res1 = pread(fileno(seg->file), trailer, trailer_size, offset);
+	self->stats.io_calls++;
+	if (res1 != (ssize_t)trailer_size) {
+		res = (res1 < 0) ? -errno : -ENODATA;
+		ULOG_ERRNO("pread", -res);
+		goto out;
 	}
-
-	memset(self->plane_stride,
-	       0,
-	       plane_count * sizeof(*self->plane_stride));
-	memset(self->plane_size, 0, plane_count * sizeof(*self->plane_size));
-	if (!align_constrained) {
-		memset(self->cfg.plane_stride_align,
-		       0,
-		       plane_count * sizeof(*self->cfg.plane_stride_align));
-		memset(self->cfg.plane_scanline_align,
-		       0,
-		       plane_count * sizeof(*self->cfg.plane_scanline_align));
-		memset(self->cfg.plane_size_align,
-		       0,
-		       plane_count * sizeof(*self->cfg.plane_size_align));
+	self->stats.bytes += trailer_size;
+
+	self->ring_head = vraw_le_get_u32(trailer + VRAW_RING_OFFSET_HEAD);
+	self->ring_count = vraw_le_get_u32(trailer + VRAW_RING_OFFSET_COUNT);
+	if ((memcmp(trailer, VRAW_RING_MAGIC, VRAW_RING_MAGIC_SIZE) != 0) ||
+	    (vraw_le_get_u32(trailer + VRAW_RING_OFFSET_VERSION) !=
+	     VRAW_RING_VERSION) ||
+	    (vraw_le_get_u32(trailer + VRAW_RING_OFFSET_SLOT_COUNT) !=
+	     slots) ||
+	    (vraw_le_get_u64(trailer + VRAW_RING_OFFSET_SLOT_SIZE) !=
+	     self->file_frame_size) ||
+	    (self->ring_head >= slots) || (self->ring_count > slots)) {
+		res = -EPROTO;
+		ULOG_ERRNO("invalid ring trailer ('%s')", -res, seg->filename);
+		goto out;
 	}
 
-	/* Get non-aligned plane_stride and plane_size */
-	vdef_calc_raw_frame_size(&self->cfg.format,
-				 &self->cfg.info.resolution,
-				 self->plane_stride,
-				 NULL,
-				 NULL,
-				 NULL,
-				 self->plane_size,
-				 NULL);
-
-	self->file_frame_size = 0;
-	for (unsigned int p = 0; p < plane_count; ++p)
-		self->file_frame_size += self->plane_size[p];
-
-	file_frame_count = (self->file_size - self->header_offset) /
-			   (self->file_frame_size + self->frame_header_size);
-	if (rint(file_frame_count) != file_frame_count) {
-		res = -EINVAL;
-		ULOGE("invalid file size: %zu", self->file_size);
-		goto error;
+	self->ring_ts = calloc(slots, sizeof(*self->ring_ts));
+	if (self->ring_ts == NULL) {
+		res = -ENOMEM;
+		goto out;
 	}
-	self->file_frame_count = (size_t)file_frame_count;
-
-	/* Get aligned plane_stride and plane_size */
-	vdef_calc_raw_frame_size(&self->cfg.format,
-				 &self->cfg.info.resolution,
-				 self->plane_stride,
-				 self->cfg.plane_stride_align,
-				 NULL,
-				 self->cfg.plane_scanline_align,
-				 self->plane_size,
-				 self->cfg.plane_size_align);
-
-	self->frame_size = 0;
-	for (unsigned int p = 0; p < plane_count; ++p)
-		self->frame_size += self->plane_size[p];
-
-	if (self->cfg.start_index > 0) {
-		if (self->cfg.start_reversed)
-			self->reverse = 1;
-		res = fseeko(self->file,
-			     (off_t)self->cfg.start_index *
-				     (self->file_frame_size +
-				      self->frame_header_size),
-			     SEEK_CUR);
-		if (res < 0) {
-			res = -errno;
-			ULOG_ERRNO("fseeko", -res);
-			goto error;
-		}
-		self->index = self->cfg.start_index;
+	for (unsigned int i = 0; i < slots; i++) {
+		self->ring_ts[i] =
+			vraw_le_get_u64(trailer + VRAW_RING_HEADER_SIZE +
+					i * VRAW_RING_TS_SIZE);
 	}
+	self->ring_slots = slots;
+	res = 0;
 
-	*ret_obj = self;
-
-	return 0;
-
-error:
-	(void)vraw_reader_destroy(self);
-	*ret_obj = NULL;
+out:
+	free(trailer);
 	return res;
 }
 
 
-int vraw_reader_destroy(struct vraw_reader *self)
+static int split_init(struct vraw_reader *self)
 {
-	if (self == NULL)
-		return 0;
+	int res;
+	ssize_t res1;
+	struct vraw_reader_segment *seg = &self->segments[0];
+	uint8_t manifest[vraw_split_manifest_size(VDEF_RAW_MAX_PLANE_COUNT)];
+	unsigned int plane_count;
+	size_t size, count;
+	char *filename = NULL;
+	struct stat st;
 
-	if (self->file != NULL)
-		fclose(self->file);
+	plane_count = vdef_get_raw_frame_plane_count(&self->cfg.format);
+	size = vraw_split_manifest_size(plane_count);
+	res1 = pread(fileno(seg->file), manifest, size, 0);
+	self->stats.io_calls++;
+	if (res1 != (ssize_t)size) {
+		res = (res1 < 0) ? -errno : -ENODATA;
+		ULOG_ERRNO("pread", -res);
+		return res;
+	}
+	self->stats.bytes += size;
+
+	if ((memcmp(manifest, VRAW_SPLIT_MAGIC, VRAW_SPLIT_MAGIC_SIZE) != 0) ||
+	    (vraw_le_get_u32(manifest + VRAW_SPLIT_OFFSET_VERSION) !=
+	     VRAW_SPLIT_VERSION) ||
+	    (vraw_le_get_u32(manifest + VRAW_SPLIT_OFFSET_PLANE_COUNT) !=
+	     plane_count) ||
+	    (vraw_le_get_u32(manifest + VRAW_SPLIT_OFFSET_WIDTH) !=
+	     self->cfg.info.resolution.width) ||
+	    (vraw_le_get_u32(manifest + VRAW_SPLIT_OFFSET_HEIGHT) !=
+	     self->cfg.info.resolution.height)) {
+		res = -EPROTO;
+		ULOG_ERRNO(
+			"invalid plane manifest ('%s')", -res, seg->filename);
+		return res;
+	}
+	for (unsigned int p = 0; p < plane_count; p++) {
+		if (vraw_le_get_u64(manifest + VRAW_SPLIT_HEADER_SIZE +
+				    p * VRAW_SPLIT_ENTRY_SIZE) !=
+		    self->file_plane_size[p]) {
+			res = -EPROTO;
+			ULOG_ERRNO("plane %u size mismatch ('%s')",
+				   -res,
+				   p,
+				   seg->filename);
+			return res;
+		}
+	}
+
+	/* Only the selected planes are opened; the frame count is the
+	 * smallest one of the plane files */
+	self->split_count = SIZE_MAX;
+	for (unsigned int p = 0; p < plane_count; p++) {
+		if (!(self->cfg.plane_mask & (1 << p)))
+			continue;
+		if (asprintf(&filename,
+			     "%s" VRAW_SPLIT_SUFFIX_FMT,
+			     seg->filename,
+			     p) < 0)
+			return -ENOMEM;
+		self->split_files[p] = fopen(filename, "rb");
+		if (self->split_files[p] == NULL) {
+			res = -errno;
+			ULOG_ERRNO("fopen('%s')", -res, filename);
+			free(filename);
+			return res;
+		}
+		free(filename);
+		if (fstat(fileno(self->split_files[p]), &st) < 0) {
+			res = -errno;
+			ULOG_ERRNO("fstat", -res);
+			return res;
+		}
+		count = (size_t)st.st_size / self->file_plane_size[p];
+		if (count < self->split_count)
+			self->split_count = count;
+
+		/* The plane files are read front to back */
+		res = posix_fadvise(fileno(self->split_files[p]),
+				    0,
+				    0,
+				    POSIX_FADV_SEQUENTIAL);
+		if (res != 0)
+			ULOG_ERRNO("posix_fadvise", res);
+		self->split_index[p] = 0;
+	}
 
-	free(self->filename);
-	free(self);
 	return 0;
 }
 
 
-int vraw_reader_get_config(struct vraw_reader *self,
-			   struct vraw_reader_config *config)
+static int ts_init(struct vraw_reader *self)
 {
-	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
-	ULOG_ERRNO_RETURN_ERR_IF(config == NULL, EINVAL);
-
-	*config = self->cfg;
-
-	return 0;
-}
+	int res, fd = -1;
+	char *filename = NULL;
+	struct stat st;
+	void *map;
+
+	if (asprintf(&filename,
+		     "%s" VRAW_TS_SUFFIX,
+		     self->segments[0].filename) < 0)
+		return -ENOMEM;
+	fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		res = -errno;
+		ULOG_ERRNO("open:'%s'", -res, filename);
+		goto out;
+	}
+	if (fstat(fd, &st) < 0) {
+		res = -errno;
+		ULOG_ERRNO("fstat", -res);
+		goto out;
+	}
+	if ((size_t)st.st_size < VRAW_TS_HEADER_SIZE) {
+		res = -EPROTO;
+		ULOG_ERRNO(
+			"invalid timestamp file size ('%s')", -res, filename);
+		goto out;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		res = -errno;
+		ULOG_ERRNO("mmap", -res);
+		goto out;
+	}
+	self->ts_map = map;
+	self->ts_map_size = st.st_size;
+
+	self->ts_entry_size =
+		vraw_le_get_u32(self->ts_map + VRAW_TS_OFFSET_ENTRY_SIZE);
+	if ((memcmp(self->ts_map, VRAW_TS_MAGIC, VRAW_TS_MAGIC_SIZE) != 0) ||
+	    (vraw_le_get_u32(self->ts_map + VRAW_TS_OFFSET_VERSION) !=
+	     VRAW_TS_VERSION) ||
+	    (self->ts_entry_size < VRAW_TS_ENTRY_SIZE)) {
+		res = -EPROTO;
+		ULOG_ERRNO("invalid timestamp file header ('%s')",
+			   -res,
+			   filename);
+		goto out;
+	}
+
+	/* Only the entries of complete frames are used */
+	self->ts_count = (self->ts_map_size - VRAW_TS_HEADER_SIZE) /
+			 self->ts_entry_size;
+	if (self->ts_count > self->file_frame_count)
+		self->ts_count = self->file_frame_count;
+	res = 0;
+
+out:
+	if (fd >= 0)
+		close(fd);
+	free(filename);
+	return res;
+}
+
+
+static const uint8_t *ts_entry(struct vraw_reader *self, unsigned int index)
+{
+	if (index >= self->ts_count)
+		return NULL;
+	return self->ts_map + VRAW_TS_HEADER_SIZE + index * self->ts_entry_size;
+}
+
+
+/* Timestamp of a frame in microseconds: recorded in the sidecar or the
+ * ring file, or computed from the framerate */
+static uint64_t frame_ts(struct vraw_reader *self, unsigned int index)
+{
+	const uint8_t *entry = ts_entry(self, index);
+
+	if (entry != NULL)
+		return vraw_le_get_u64(entry + VRAW_TS_ENTRY_OFFSET_TIMESTAMP);
+	if (self->cfg.ring)
+		return self->ring_ts[ring_slot(self, index)];
+	return (uint64_t)index * (1000000ULL * self->cfg.info.framerate.den /
+				  self->cfg.info.framerate.num);
+}
+
+
+static int cmp_table_add(struct vraw_reader *self,
+			 uint64_t offset,
+			 uint64_t size,
+			 bool delta,
+			 size_t *max)
+{
+	uint64_t *offsets, *sizes;
+	unsigned int *keys;
+
+	/* A delta frame needs a previous frame, in a delta file */
+	if (delta && (!self->cmp_delta || (self->cmp_count == 0)))
+		return -EPROTO;
+
+	if (self->cmp_count == *max) {
+		*max = (*max > 0) ? 2 * *max : 1024;
+		offsets = realloc(self->cmp_offsets,
+				  *max * sizeof(*self->cmp_offsets));
+		if (offsets == NULL)
+			return -ENOMEM;
+		self->cmp_offsets = offsets;
+		sizes = realloc(self->cmp_sizes,
+				*max * sizeof(*self->cmp_sizes));
+		if (sizes == NULL)
+			return -ENOMEM;
+		self->cmp_sizes = sizes;
+		keys = realloc(self->cmp_keys, *max * sizeof(*self->cmp_keys));
+		if (keys == NULL)
+			return -ENOMEM;
+		self->cmp_keys = keys;
+	}
+
+	/* Keyframe table: the keyframe each frame is decoded from */
+	self->cmp_offsets[self->cmp_count] = offset;
+	self->cmp_sizes[self->cmp_count] = size;
+	self->cmp_keys[self->cmp_count] =
+		delta ? self->cmp_keys[self->cmp_count - 1] : self->cmp_count;
+	self->cmp_count++;
+
+	return 0;
+}
+
+
+static int cmp_table_read(struct vraw_reader *self)
+{
+	int res;
+	ssize_t res1;
+	struct vraw_reader_segment *seg = &self->segments[0];
+	int fd = fileno(seg->file);
+	uint8_t footer[VRAW_CMP_FOOTER_SIZE], *table = NULL;
+	uint64_t table_offset, count, offset, size;
+	size_t table_size, max = 0;
+	bool delta;
+
+	if (seg->file_size < VRAW_CMP_HEADER_SIZE + VRAW_CMP_FOOTER_SIZE)
+		return -EPROTO;
+	res1 = pread(fd,
+		     footer,
+		     sizeof(footer),
+		     seg->file_size - VRAW_CMP_FOOTER_SIZE);
+	self->stats.io_calls++;
+	if (res1 != (ssize_t)sizeof(footer))
+		return (res1 < 0) ? -errno : -ENODATA;
+	self->stats.bytes += sizeof(footer);
+
+	table_offset = vraw_le_get_u64(footer);
+	count = vraw_le_get_u64(footer + 8);
+	if ((memcmp(footer + 16, VRAW_CMP_TABLE_MAGIC, VRAW_CMP_MAGIC_SIZE) !=
+	     0) ||
+	    (table_offset < VRAW_CMP_HEADER_SIZE) ||
+	    (count > (seg->file_size - table_offset) / VRAW_CMP_ENTRY_SIZE) ||
+	    (table_offset + count * VRAW_CMP_ENTRY_SIZE +
+		     VRAW_CMP_FOOTER_SIZE !=
+	     seg->file_size))
+		return -EPROTO;
+
+	table_size = count * VRAW_CMP_ENTRY_SIZE;
+	table = malloc(table_size);
+	if ((table == NULL) && (table_size > 0))
+		return -ENOMEM;
+	res1 = pread(fd, table, table_size, table_offset);
+	self->stats.io_calls++;
+	if (res1 != (ssize_t)table_size) {
+		res = (res1 < 0) ? -errno : -ENODATA;
+		goto out;
+	}
+	self->stats.bytes += table_size;
+
+	for (size_t i = 0; i < count; i++) {
+		offset = vraw_le_get_u64(table + i * VRAW_CMP_ENTRY_SIZE);
+		size = vraw_le_get_u64(table + i * VRAW_CMP_ENTRY_SIZE + 8);
+		delta = (size & VRAW_CMP_ENTRY_DELTA) != 0;
+		size &= ~VRAW_CMP_ENTRY_DELTA;
+		if ((offset < VRAW_CMP_HEADER_SIZE) ||
+		    (size < 4 * self->cmp_chunks) ||
+		    (size > 4 * self->cmp_chunks + self->file_frame_size) ||
+		    (offset + size > table_offset)) {
+			res = -EPROTO;
+			goto out;
+		}
+		res = cmp_table_add(self, offset, size, delta, &max);
+		if (res < 0)
+			goto out;
+	}
+	res = 0;
+
+out:
+	free(table);
+	return res;
+}
+
+
+static int cmp_table_scan(struct vraw_reader *self)
+{
+	int res;
+	ssize_t res1;
+	struct vraw_reader_segment *seg = &self->segments[0];
+	int fd = fileno(seg->file);
+	size_t prefix_size = 4 * self->cmp_chunks, max = 0;
+	uint64_t offset = VRAW_CMP_HEADER_SIZE, size;
+	uint32_t len, mask = VRAW_CMP_CHUNK_STORED;
+	bool delta;
+
+	if (self->cmp_delta)
+		mask |= VRAW_CMP_CHUNK_DELTA;
+
+	/* Walk through the frames; an incomplete last frame is ignored */
+	self->cmp_count = 0;
+	while (offset + prefix_size <= seg->file_size) {
+		res1 = pread(fd, self->cmp_buf, prefix_size, offset);
+		self->stats.io_calls++;
+		if (res1 != (ssize_t)prefix_size)
+			return (res1 < 0) ? -errno : -ENODATA;
+		self->stats.bytes += prefix_size;
+		size = prefix_size;
+		delta = self->cmp_delta &&
+			(vraw_le_get_u32(self->cmp_buf) & VRAW_CMP_CHUNK_DELTA);
+		for (unsigned int c = 0; c < self->cmp_chunks; c++) {
+			len = vraw_le_get_u32(self->cmp_buf + 4 * c) & ~mask;
+			if (len > self->cmp_chunk_size) {
+				/* Not a frame, stop there */
+				return 0;
+			}
+			size += len;
+		}
+		if (offset + size > seg->file_size)
+			break;
+		res = cmp_table_add(self, offset, size, delta, &max);
+		if (res < 0)
+			return res;
+		offset += size;
+	}
+
+	return 0;
+}
+
+
+static int cmp_init(struct vraw_reader *self)
+{
+	int res;
+	ssize_t res1;
+	struct vraw_reader_segment *seg = &self->segments[0];
+	uint8_t header[VRAW_CMP_HEADER_SIZE];
+	uint32_t flags;
+
+	res1 = pread(fileno(seg->file), header, sizeof(header), 0);
+	self->stats.io_calls++;
+	if (res1 != (ssize_t)sizeof(header)) {
+		res = (res1 < 0) ? -errno : -ENODATA;
+		ULOG_ERRNO("pread", -res);
+		return res;
+	}
+	self->stats.bytes += sizeof(header);
+
+	self->cmp_chunks =
+		vraw_le_get_u32(header + VRAW_CMP_OFFSET_CHUNK_COUNT);
+	self->cmp_chunk_size =
+		vraw_le_get_u64(header + VRAW_CMP_OFFSET_CHUNK_SIZE);
+	flags = vraw_le_get_u32(header + VRAW_CMP_OFFSET_FLAGS);
+	self->cmp_shuffle = (flags & VRAW_CMP_FLAG_SHUFFLE16) != 0;
+	self->cmp_delta = (flags & VRAW_CMP_FLAG_DELTA) != 0;
+	if ((memcmp(header, VRAW_CMP_MAGIC, VRAW_CMP_MAGIC_SIZE) != 0) ||
+	    (vraw_le_get_u32(header + VRAW_CMP_OFFSET_VERSION) !=
+	     VRAW_CMP_VERSION) ||
+	    (vraw_le_get_u32(header + VRAW_CMP_OFFSET_CODEC) !=
+	     VRAW_COMPRESSION_LZ4) ||
+	    ((flags & ~(VRAW_CMP_FLAG_SHUFFLE16 | VRAW_CMP_FLAG_DELTA)) !=
+	     0) ||
+	    (self->cmp_delta &&
+	     (self->cmp_chunk_size >= VRAW_CMP_CHUNK_DELTA)) ||
+	    (vraw_le_get_u64(header + VRAW_CMP_OFFSET_FRAME_SIZE) !=
+	     self->file_frame_size) ||
+	    (self->cmp_chunks == 0) ||
+	    (self->cmp_chunks > VRAW_CMP_MAX_CHUNKS) ||
+	    (self->cmp_chunk_size == 0) || (self->cmp_chunk_size & 1) ||
+	    (self->cmp_chunk_size > LZ4_MAX_INPUT_SIZE) ||
+	    ((self->file_frame_size + self->cmp_chunk_size - 1) /
+		     self->cmp_chunk_size !=
+	     self->cmp_chunks)) {
+		res = -EPROTO;
+		ULOG_ERRNO("invalid compressed file header ('%s')",
+			   -res,
+			   seg->filename);
+		return res;
+	}
+
+	/* Note: chunks are stored when they do not compress, a frame is
+	 * thus never larger than its chunk sizes and uncompressed size */
+	self->cmp_buf = malloc(4 * self->cmp_chunks + self->file_frame_size);
+	self->cmp_frame = malloc(self->file_frame_size);
+	if ((self->cmp_buf == NULL) || (self->cmp_frame == NULL))
+		return -ENOMEM;
+	self->cmp_frame_index = UINT_MAX;
+	if (self->cmp_shuffle) {
+		self->cmp_scratch = malloc(self->cmp_chunk_size);
+		if (self->cmp_scratch == NULL)
+			return -ENOMEM;
+	}
+	if (self->cmp_delta) {
+		self->cmp_delta_buf = malloc(self->cmp_chunk_size);
+		if (self->cmp_delta_buf == NULL)
+			return -ENOMEM;
+	}
+
+	res = cmp_table_read(self);
+	if (res == -EPROTO) {
+		ULOGW("invalid frame table ('%s'), scanning the frames",
+		      seg->filename);
+		res = cmp_table_scan(self);
+	}
+	if (res < 0) {
+		ULOG_ERRNO("failed to read the frame table ('%s')",
+			   -res,
+			   seg->filename);
+		return res;
+	}
+
+	return 0;
+}
+
+
+static int segments_init(struct vraw_reader *self)
+{
+	int res;
+	size_t frame_size;
+	struct vraw_reader_config cfg;
+
+	frame_size = self->file_frame_size + self->frame_header_size;
+	self->file_frame_count = 0;
+
+	for (unsigned int s = 0; s < self->segment_count; s++) {
+		struct vraw_reader_segment *seg = &self->segments[s];
+
+		if (s > 0) {
+			/* The first segment is already initialized; all
+			 * segments must have the same format */
+			cfg = self->cfg;
+			res = segment_init(self, seg, &cfg);
+			if (res < 0)
+				return res;
+			if (!vdef_raw_format_cmp(&cfg.format,
+						 &self->cfg.format) ||
+			    !vdef_dim_cmp(&cfg.info.resolution,
+					  &self->cfg.info.resolution)) {
+				res = -EPROTO;
+				ULOG_ERRNO("format mismatch in '%s'",
+					   -res,
+					   seg->filename);
+				return res;
+			}
+			segment_close(seg);
+		}
+
+		if (self->cfg.ring) {
+			/* All slots can be addressed, only the valid ones
+			 * are counted */
+			seg->frame_count = self->ring_slots;
+			self->file_frame_count = self->ring_count;
+			continue;
+		}
+		if (self->cfg.compressed) {
+			seg->frame_count = self->cmp_count;
+			self->file_frame_count = self->cmp_count;
+			continue;
+		}
+		if (self->cfg.split_planes) {
+			seg->frame_count = self->split_count;
+			self->file_frame_count = self->split_count;
+			continue;
+		}
+
+		seg->frame_count =
+			(seg->file_size - seg->header_offset) / frame_size;
+		if ((seg->file_size - seg->header_offset) % frame_size != 0) {
+			/* Only the last segment of a multi-segment recording
+			 * can end with a partial frame (recording in
+			 * progress or interrupted) */
+			if ((self->segment_count == 1) ||
+			    (s < self->segment_count - 1)) {
+				res = -EINVAL;
+				ULOGE("invalid file size: %zu ('%s')",
+				      seg->file_size,
+				      seg->filename);
+				return res;
+			}
+			ULOGW("partial last frame ignored ('%s')",
+			      seg->filename);
+		}
+		seg->first_index = self->file_frame_count;
+		self->file_frame_count += seg->frame_count;
+	}
+
+	return 0;
+}
+
+
+static int reader_new(const char *const *filenames,
+		      unsigned int count,
+		      const struct vraw_reader_config *config,
+		      struct vraw_reader **ret_obj)
+{
+	int res = 0;
+	struct vraw_reader *self = NULL;
+	unsigned int plane_count;
+	bool align_constrained = false;
+
+	(void)pthread_once(&supported_formats_is_init,
+			   initialize_supported_formats);
+
+	ULOG_ERRNO_RETURN_ERR_IF(filenames == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(count == 0, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(ret_obj == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config->start_reversed && config->loop != -1,
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config->ring && (config->y4m || count > 1),
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config->compressed &&
+					 (config->y4m || config->ring ||
+					  count > 1),
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config->timestamps &&
+					 (config->ring || count > 1),
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config->split_planes &&
+					 (config->y4m || config->ring ||
+					  config->compressed || count > 1 ||
+					  config->subsample > 1),
+				 EINVAL);
+	if (!config->y4m) {
+		/* Format, bit depth, width and height must be provided */
+		ULOG_ERRNO_RETURN_ERR_IF(config->info.resolution.width == 0,
+					 EINVAL);
+		ULOG_ERRNO_RETURN_ERR_IF(config->info.resolution.height == 0,
+					 EINVAL);
+		ULOG_ERRNO_RETURN_ERR_IF(
+			!vdef_raw_format_intersect(&config->format,
+						   supported_formats,
+						   NB_SUPPORTED_FORMATS),
+			EINVAL);
+	}
+	for (unsigned int s = 0; s < count; s++)
+		ULOG_ERRNO_RETURN_ERR_IF(filenames[s] == NULL, EINVAL);
+
+	self = calloc(1, sizeof(*self));
+	if (self == NULL)
+		return -ENOMEM;
+
+	self->cfg = *config;
+	if (self->cfg.frame_step == 0)
+		self->cfg.frame_step = 1;
+
+	self->segments = calloc(count, sizeof(*self->segments));
+	if (self->segments == NULL) {
+		res = -ENOMEM;
+		goto error;
+	}
+	self->segment_count = count;
+
+	for (unsigned int s = 0; s < count; s++) {
+		self->segments[s].filename = strdup(filenames[s]);
+		if (self->segments[s].filename == NULL) {
+			res = -ENOMEM;
+			goto error;
+		}
+	}
+
+	/* The first segment gives the format for y4m files */
+	res = segment_init(self, &self->segments[0], &self->cfg);
+	if (res < 0)
+		goto error;
+	self->file = self->segments[0].file;
+	self->header_offset = self->segments[0].header_offset;
+
+	/* Enforce the configuration */
+	if (vdef_frac_is_null(&self->cfg.info.framerate)) {
+		self->cfg.info.framerate.num = 30;
+		self->cfg.info.framerate.den = 1;
+	}
+	if (vdef_dim_is_null(&self->cfg.info.sar)) {
+		self->cfg.info.sar.width = 1;
+		self->cfg.info.sar.height = 1;
+	}
+	if (vdef_dim_is_null(&self->cfg.info.resolution)) {
+		res = -EPROTO;
+		ULOG_ERRNO("invalid video dimensions %dx%d",
+			   -res,
+			   self->cfg.info.resolution.width,
+			   self->cfg.info.resolution.height);
+		goto error;
+	}
+
+	plane_count = vdef_get_raw_frame_plane_count(&self->cfg.format);
+
+	for (unsigned int p = 0; p < plane_count; ++p) {
+		align_constrained = (self->cfg.plane_stride_align[p] ||
+				     self->cfg.plane_scanline_align[p] ||
+				     self->cfg.plane_size_align[p]);
+		if (align_constrained)
+			break;
+	}
+
+	memset(self->plane_stride,
+	       0,
+	       plane_count * sizeof(*self->plane_stride));
+	memset(self->plane_size, 0, plane_count * sizeof(*self->plane_size));
+	if (!align_constrained) {
+		memset(self->cfg.plane_stride_align,
+		       0,
+		       plane_count * sizeof(*self->cfg.plane_stride_align));
+		memset(self->cfg.plane_scanline_align,
+		       0,
+		       plane_count * sizeof(*self->cfg.plane_scanline_align));
+		memset(self->cfg.plane_size_align,
+		       0,
+		       plane_count * sizeof(*self->cfg.plane_size_align));
+	}
+
+	if (self->cfg.plane_mask == 0)
+		self->cfg.plane_mask = (1 << plane_count) - 1;
+	if ((self->cfg.plane_mask & ((1 << plane_count) - 1)) == 0) {
+		res = -EINVAL;
+		ULOG_ERRNO("invalid plane mask 0x%x for %u planes",
+			   -res,
+			   self->cfg.plane_mask,
+			   plane_count);
+		goto error;
+	}
+	self->cfg.plane_mask &= (1 << plane_count) - 1;
+
+	/* Get non-aligned plane geometry (i.e. in the file) */
+	vdef_calc_raw_frame_size(&self->cfg.format,
+				 &self->cfg.info.resolution,
+				 self->file_plane_stride,
+				 NULL,
+				 self->file_plane_scanline,
+				 NULL,
+				 self->file_plane_size,
+				 NULL);
+
+	self->file_frame_size = 0;
+	for (unsigned int p = 0; p < plane_count; ++p) {
+		self->file_plane_offset[p] = self->file_frame_size;
+		self->file_frame_size += self->file_plane_size[p];
+	}
+
+	if (self->cfg.ring) {
+		res = ring_init(self);
+		if (res < 0)
+			goto error;
+	} else if (self->cfg.compressed) {
+		res = cmp_init(self);
+		if (res < 0)
+			goto error;
+	} else if (self->cfg.split_planes) {
+		res = split_init(self);
+		if (res < 0)
+			goto error;
+	}
+
+	res = segments_init(self);
+	if (res < 0)
+		goto error;
+
+	if (self->cfg.timestamps) {
+		res = ts_init(self);
+		if (res < 0)
+			goto error;
+	}
+
+	self->resolution = self->cfg.info.resolution;
+	if (self->cfg.subsample > 1) {
+		res = subsample_setup(self);
+		if (res < 0)
+			goto error;
+	}
+
+	/* Get aligned plane_stride and plane_size */
+	vdef_calc_raw_frame_size(&self->cfg.format,
+				 &self->resolution,
+				 self->plane_stride,
+				 self->cfg.plane_stride_align,
+				 NULL,
+				 self->cfg.plane_scanline_align,
+				 self->plane_size,
+				 self->cfg.plane_size_align);
+
+	/* Only the selected planes are stored in the buffer */
+	self->frame_size = 0;
+	for (unsigned int p = 0; p < plane_count; ++p) {
+		if (!(self->cfg.plane_mask & (1 << p)))
+			continue;
+		self->plane_offset[p] = self->frame_size;
+		self->frame_size += self->plane_size[p];
+	}
+
+	self->end_index = self->file_frame_count;
+	if ((self->cfg.max_count > 0) &&
+	    (self->cfg.max_count < self->end_index))
+		self->end_index = self->cfg.max_count;
+
+	if (self->cfg.start_index > 0) {
+		if (self->cfg.start_reversed)
+			self->reverse = 1;
+		self->index = self->cfg.start_index;
+	}
+
+	*ret_obj = self;
+
+	return 0;
+
+error:
+	(void)vraw_reader_destroy(self);
+	*ret_obj = NULL;
+	return res;
+}
+
+
+int vraw_reader_new(const char *filename,
+		    const struct vraw_reader_config *config,
+		    struct vraw_reader **ret_obj)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(filename == NULL, EINVAL);
+
+	return reader_new(&filename, 1, config, ret_obj);
+}
+
+
+int vraw_reader_new_segments(const char *const *filenames,
+			     unsigned int count,
+			     const struct vraw_reader_config *config,
+			     struct vraw_reader **ret_obj)
+{
+	return reader_new(filenames, count, config, ret_obj);
+}
+
+
+static int path_cmp(const void *a, const void *b)
+{
+	return strverscmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+
+int vraw_reader_new_glob(const char *pattern,
+			 const struct vraw_reader_config *config,
+			 struct vraw_reader **ret_obj)
+{
+	int res;
+	glob_t g;
+
+	ULOG_ERRNO_RETURN_ERR_IF(pattern == NULL, EINVAL);
+
+	res = glob(pattern, GLOB_NOSORT, NULL, &g);
+	if (res == GLOB_NOMATCH) {
+		res = -ENOENT;
+		ULOG_ERRNO("glob('%s')", -res, pattern);
+		return res;
+	} else if (res != 0) {
+		res = (res == GLOB_NOSPACE) ? -ENOMEM : -EIO;
+		ULOG_ERRNO("glob('%s')", -res, pattern);
+		return res;
+	}
+
+	/* Sort the file names with the numbers compared by value, so that
+	 * unpadded segment indexes are in order ("rec_2" before
+	 * "rec_10") */
+	qsort(g.gl_pathv, g.gl_pathc, sizeof(*g.gl_pathv), &path_cmp);
+
+	res = reader_new((const char *const *)g.gl_pathv,
+			 g.gl_pathc,
+			 config,
+			 ret_obj);
+
+	globfree(&g);
+	return res;
+}
+
+
+int vraw_reader_destroy(struct vraw_reader *self)
+{
+	if (self == NULL)
+		return 0;
+
+	for (unsigned int s = 0; s < self->segment_count; s++) {
+		segment_close(&self->segments[s]);
+		free(self->segments[s].filename);
+	}
+	free(self->segments);
+	for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++) {
+		if (self->split_files[p] != NULL)
+			fclose(self->split_files[p]);
+	}
+	free(self->row_buf);
+	free(self->ring_ts);
+	free(self->cmp_offsets);
+	free(self->cmp_sizes);
+	free(self->cmp_keys);
+	free(self->cmp_buf);
+	free(self->cmp_delta_buf);
+	free(self->cmp_frame);
+	free(self->cmp_scratch);
+	if (self->ts_map != NULL)
+		munmap(self->ts_map, self->ts_map_size);
+	free(self);
+	return 0;
+}
+
+
+int vraw_reader_get_config(struct vraw_reader *self,
+			   struct vraw_reader_config *config)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config == NULL, EINVAL);
+
+	*config = self->cfg;
+
+	return 0;
+}
 
 
 ssize_t vraw_reader_get_min_buf_size(struct vraw_reader *self)
@@ -496,97 +1454,401 @@ int vraw_reader_set_framerate(struct vraw_reader *self,
 }
 
 
+int vraw_reader_get_stats(struct vraw_reader *self,
+			  struct vraw_reader_stats *stats)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(stats == NULL, EINVAL);
+
+	*stats = self->stats;
+
+	return 0;
+}
+
+
 static int vraw_reader_frame_read_planes(struct vraw_reader *self,
 					 uint8_t *data)
 {
-	int res = 0;
-	unsigned char *current_addr = data;
-	unsigned int height = self->cfg.info.resolution.height;
-	unsigned int row_bytes = self->cfg.info.resolution.width *
-				 self->cfg.format.data_size / 8;
+	int res;
+	size_t res1;
+	off_t skip = 0;
+	uint8_t *current_addr;
+	unsigned int plane_count;
+	uint64_t start;
 
-	errno = EINVAL;
 	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
 	ULOG_ERRNO_RETURN_ERR_IF(data == NULL, EINVAL);
 
-	/* Read Y */
-	for (unsigned int h = 0; h < height; ++h) {
-		res = fread(current_addr, row_bytes, 1, self->file);
-		if (res == 1) {
-			current_addr += self->plane_stride[0];
+	/* Note: the rows are read directly into the buffer, the time spent
+	 * in the row loops is thus accounted as I/O time */
+	start = get_time_ns();
+
+	res = seek_to_frame(self, self->index);
+	if (res < 0)
+		goto error;
+
+	if (self->cfg.y4m) {
+		/* Read the frame header */
+		res = y4m_frame_header_read(self);
+		if (res < 0)
+			goto error;
+	}
+
+	plane_count = vdef_get_raw_frame_plane_count(&self->cfg.format);
+
+	for (unsigned int p = 0; p < plane_count; ++p) {
+		if (!(self->cfg.plane_mask & (1 << p))) {
+			/* Skip the plane */
+			skip += self->file_plane_size[p];
 			continue;
-		} else if (res < 0) {
-			res = -errno;
-			ULOG_ERRNO("fread Y plane", -res);
 		}
-		goto out;
-	}
-	current_addr = data + self->plane_size[0];
 
-	if (self->cfg.format.data_layout == VDEF_RAW_DATA_LAYOUT_SEMI_PLANAR) {
-		/* Read UV */
-		for (unsigned int h = 0; h < height / 2; ++h) {
-			res = fread(current_addr, row_bytes, 1, self->file);
-			if (res == 1) {
-				current_addr += self->plane_stride[1];
-				continue;
-			} else if (res < 0) {
+		if (skip > 0) {
+			res = fseeko(self->file, skip, SEEK_CUR);
+			self->stats.seeks++;
+			if (res < 0) {
 				res = -errno;
-				ULOG_ERRNO("fread UV plane", -res);
+				ULOG_ERRNO("fseeko", -res);
+				goto error;
 			}
-			goto out;
+			skip = 0;
 		}
-	} else if (self->cfg.format.data_layout ==
-		   VDEF_RAW_DATA_LAYOUT_PLANAR) {
-		/* Read U */
-		for (unsigned int h = 0; h < height / 2; ++h) {
-			res = fread(current_addr, row_bytes / 2, 1, self->file);
-			if (res == 1) {
-				current_addr += self->plane_stride[1];
-				continue;
-			} else if (res < 0) {
-				res = -errno;
-				ULOG_ERRNO("fread U plane", -res);
+
+		current_addr = data + self->plane_offset[p];
+		for (size_t h = 0; h < self->file_plane_scanline[p]; ++h) {
+			res1 = fread(current_addr,
+				     self->file_plane_stride[p],
+				     1,
+				     self->file);
+			if (res1 != 1) {
+				res = ferror(self->file) ? -errno : -ENODATA;
+				ULOG_ERRNO("fread plane %u", -res, p);
+				goto error;
 			}
-			goto out;
+			current_addr += self->plane_stride[p];
 		}
+		self->stats.io_calls += self->file_plane_scanline[p];
+		self->stats.bytes += self->file_plane_size[p];
+	}
+
+	/* Note: trailing skipped planes are not seeked over; the file
+	 * position is then unknown and the next read seeks to the next
+	 * frame directly */
+	if (skip > 0)
+		self->file_index = UINT_MAX;
+	else
+		self->file_index++;
+
+	self->stats.io_time_ns += get_time_ns() - start;
+
+	return 0;
+
+error:
+	/* Unknown file position, force a seek on next read */
+	self->file_index = UINT_MAX;
+	self->stats.io_time_ns += get_time_ns() - start;
+	return res;
+}
+
+
+static int vraw_reader_frame_read_planes_split(struct vraw_reader *self,
+					       uint8_t *data)
+{
+	int res = 0;
+	size_t res1, rows, row_size;
+	uint8_t *current_addr;
+	unsigned int plane_count;
+	uint64_t start;
+	FILE *file;
 
-		/* Read V */
-		current_addr = data + self->plane_size[0] + self->plane_size[1];
-		for (unsigned int h = 0; h < height / 2; ++h) {
-			res = fread(current_addr, row_bytes / 2, 1, self->file);
-			if (res == 1) {
-				current_addr += self->plane_stride[2];
-				continue;
-			} else if (res < 0) {
+	start = get_time_ns();
+
+	plane_count = vdef_get_raw_frame_plane_count(&self->cfg.format);
+
+	for (unsigned int p = 0; p < plane_count; ++p) {
+		file = self->split_files[p];
+		if (file == NULL)
+			continue;
+
+		if (self->split_index[p] != self->index) {
+			res = fseeko(file,
+				     (off_t)self->index *
+					     self->file_plane_size[p],
+				     SEEK_SET);
+			self->stats.seeks++;
+			if (res < 0) {
 				res = -errno;
-				ULOG_ERRNO("fread V plane", -res);
+				ULOG_ERRNO("fseeko", -res);
+				goto out;
 			}
-			goto out;
 		}
-	} else if (self->cfg.format.data_layout ==
-		   VDEF_RAW_DATA_LAYOUT_PACKED) {
-		/* Do nothing */
-	} else {
-		errno = ENOSYS;
-		return -ENOSYS;
+		/* Unknown file position until the plane is read */
+		self->split_index[p] = UINT_MAX;
+
+		/* Contiguous rows in the buffer are read at once */
+		current_addr = data + self->plane_offset[p];
+		if (self->plane_stride[p] == self->file_plane_stride[p]) {
+			rows = 1;
+			row_size = self->file_plane_size[p];
+		} else {
+			rows = self->file_plane_scanline[p];
+			row_size = self->file_plane_stride[p];
+		}
+		for (size_t h = 0; h < rows; ++h) {
+			res1 = fread(current_addr, row_size, 1, file);
+			if (res1 != 1) {
+				res = ferror(file) ? -errno : -ENODATA;
+				ULOG_ERRNO("fread plane %u", -res, p);
+				goto out;
+			}
+			current_addr += self->plane_stride[p];
+		}
+		self->stats.io_calls += rows;
+		self->stats.bytes += self->file_plane_size[p];
+		self->split_index[p] = self->index + 1;
 	}
 
-	self->index++;
-
 out:
+	self->stats.io_time_ns += get_time_ns() - start;
 	return res;
 }
 
 
+static int vraw_reader_frame_read_planes_subsampled(struct vraw_reader *self,
+						    uint8_t *data)
+{
+	int res, fd;
+	ssize_t res1;
+	off_t frame_offset, offset;
+	uint8_t *current_addr;
+	unsigned int plane_count, factor = self->cfg.subsample;
+	char str[10];
+	uint64_t t1, t2, t3;
+	unsigned int index = self->index;
+
+	if (self->cfg.ring)
+		index = ring_slot(self, index);
+	res = segment_select(self, index, &frame_offset);
+	if (res < 0)
+		return res;
+	fd = fileno(self->file);
+
+	if (self->cfg.y4m) {
+		/* Check the frame header */
+		t1 = get_time_ns();
+		res1 = pread(fd, str, self->frame_header_size, frame_offset);
+		self->stats.io_time_ns += get_time_ns() - t1;
+		self->stats.io_calls++;
+		if (res1 != (ssize_t)self->frame_header_size) {
+			res = (res1 < 0) ? -errno : -ENODATA;
+			ULOG_ERRNO("pread", -res);
+			return res;
+		}
+		if (memcmp(str, "FRAME\n", self->frame_header_size) != 0) {
+			res = -EPROTO;
+			ULOG_ERRNO("failed to read y4m frame header", -res);
+			return res;
+		}
+		self->stats.bytes += self->frame_header_size;
+		frame_offset += self->frame_header_size;
+	}
+
+	/* Read only one row every factor rows with positional reads, and
+	 * decimate the rows horizontally into the buffer */
+	plane_count = vdef_get_raw_frame_plane_count(&self->cfg.format);
+	for (unsigned int p = 0; p < plane_count; ++p) {
+		size_t row_bytes = self->file_plane_stride[p];
+		size_t count = row_bytes / self->elem_size[p] / factor;
+
+		if (!(self->cfg.plane_mask & (1 << p)))
+			continue;
+
+		current_addr = data + self->plane_offset[p];
+		offset = frame_offset + self->file_plane_offset[p];
+		t1 = get_time_ns();
+		for (size_t h = 0; h < self->file_plane_scanline[p];
+		     h += factor) {
+			res1 = pread(fd,
+				     self->row_buf,
+				     row_bytes,
+				     offset + h * row_bytes);
+			t2 = get_time_ns();
+			self->stats.io_time_ns += t2 - t1;
+			self->stats.io_calls++;
+			if (res1 != (ssize_t)row_bytes) {
+				res = (res1 < 0) ? -errno : -ENODATA;
+				ULOG_ERRNO("pread plane %u", -res, p);
+				return res;
+			}
+			self->stats.bytes += row_bytes;
+			vraw_decimate(current_addr,
+				      self->row_buf,
+				      count,
+				      self->elem_size[p],
+				      factor);
+			current_addr += self->plane_stride[p];
+			t3 = get_time_ns();
+			self->stats.copy_time_ns += t3 - t2;
+			t1 = t3;
+		}
+	}
+
+	return 0;
+}
+
+
+/* Decode a frame into the frame buffer; a delta frame is applied to
+ * the previous frame, which must be in the frame buffer */
+static int cmp_frame_decode(struct vraw_reader *self, unsigned int index)
+{
+	int res;
+	ssize_t res1;
+	size_t size = self->cmp_sizes[index], prefix_size, len, clen;
+	size_t offset = 0;
+	const uint8_t *src;
+	uint8_t *dst, *out;
+	uint64_t t1, t2;
+	bool delta = (self->cmp_keys[index] != index);
+
+	/* The frame buffer content is unknown until decoded */
+	self->cmp_frame_index = UINT_MAX;
+
+	/* Read the whole compressed frame at once */
+	t1 = get_time_ns();
+	res1 = pread(fileno(self->file),
+		     self->cmp_buf,
+		     size,
+		     self->cmp_offsets[index]);
+	t2 = get_time_ns();
+	self->stats.io_time_ns += t2 - t1;
+	self->stats.io_calls++;
+	if (res1 != (ssize_t)size) {
+		res = (res1 < 0) ? -errno : -ENODATA;
+		ULOG_ERRNO("pread", -res);
+		return res;
+	}
+	self->stats.bytes += size;
+
+	/* Decode the chunks */
+	prefix_size = 4 * self->cmp_chunks;
+	src = self->cmp_buf + prefix_size;
+	size -= prefix_size;
+	for (unsigned int c = 0; c < self->cmp_chunks; c++) {
+		clen = vraw_le_get_u32(self->cmp_buf + 4 * c);
+		if (self->cmp_delta)
+			clen &= ~VRAW_CMP_CHUNK_DELTA;
+		len = self->file_frame_size - offset;
+		if (len > self->cmp_chunk_size)
+			len = self->cmp_chunk_size;
+		out = delta ? self->cmp_delta_buf : self->cmp_frame + offset;
+		dst = self->cmp_shuffle ? self->cmp_scratch : out;
+		if (clen & VRAW_CMP_CHUNK_STORED) {
+			clen &= ~VRAW_CMP_CHUNK_STORED;
+			if ((clen != len) || (clen > size)) {
+				res = -EPROTO;
+			} else {
+				memcpy(dst, src, len);
+				res = 0;
+			}
+		} else if (clen > size) {
+			res = -EPROTO;
+		} else {
+			res = LZ4_decompress_safe((const char *)src,
+						  (char *)dst,
+						  (int)clen,
+						  (int)len);
+			res = ((size_t)res == len) ? 0 : -EPROTO;
+		}
+		if (res < 0) {
+			ULOG_ERRNO("corrupted frame %u", -res, index);
+			return res;
+		}
+		if (self->cmp_shuffle)
+			vraw_cmp_unshuffle16(out, dst, len);
+		if (delta) {
+			vraw_delta_xor(self->cmp_frame + offset,
+				       out,
+				       self->cmp_frame + offset,
+				       len);
+		}
+		src += clen;
+		size -= clen;
+		offset += len;
+	}
+
+	self->cmp_frame_index = index;
+	self->stats.copy_time_ns += get_time_ns() - t2;
+
+	return 0;
+}
+
+
+static int vraw_reader_frame_read_planes_compressed(struct vraw_reader *self,
+						    uint8_t *data)
+{
+	int res;
+	unsigned int plane_count, factor = self->cfg.subsample, first;
+	const uint8_t *row;
+	uint8_t *dst;
+	uint64_t start;
+
+	/* Decode from the keyframe, or from the frame in the frame buffer
+	 * when it is on the way (e.g. sequential reads) */
+	first = self->cmp_keys[self->index];
+	if ((self->cmp_frame_index >= first) &&
+	    (self->cmp_frame_index <= self->index))
+		first = self->cmp_frame_index + 1;
+	for (unsigned int i = first; i <= self->index; i++) {
+		res = cmp_frame_decode(self, i);
+		if (res < 0)
+			return res;
+	}
+
+	start = get_time_ns();
+
+	/* Copy (or decimate) the selected planes into the buffer */
+	plane_count = vdef_get_raw_frame_plane_count(&self->cfg.format);
+	for (unsigned int p = 0; p < plane_count; ++p) {
+		size_t row_bytes = self->file_plane_stride[p];
+
+		if (!(self->cfg.plane_mask & (1 << p)))
+			continue;
+
+		row = self->cmp_frame + self->file_plane_offset[p];
+		dst = data + self->plane_offset[p];
+		if (factor > 1) {
+			for (size_t h = 0; h < self->file_plane_scanline[p];
+			     h += factor) {
+				vraw_decimate(dst,
+					      row + h * row_bytes,
+					      row_bytes / self->elem_size[p] /
+						      factor,
+					      self->elem_size[p],
+					      factor);
+				dst += self->plane_stride[p];
+			}
+		} else {
+			for (size_t h = 0; h < self->file_plane_scanline[p];
+			     h++) {
+				memcpy(dst, row + h * row_bytes, row_bytes);
+				dst += self->plane_stride[p];
+			}
+		}
+	}
+	self->stats.copy_time_ns += get_time_ns() - start;
+
+	return 0;
+}
+
+
 int vraw_reader_frame_read(struct vraw_reader *self,
 			   uint8_t *data,
 			   size_t len,
 			   struct vraw_frame *frame)
 {
 	int res;
-	size_t res1;
-	unsigned int plane_count;
+	unsigned int plane_count, step;
+	const uint8_t *entry;
 
 	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
 	ULOG_ERRNO_RETURN_ERR_IF(data == NULL, EINVAL);
@@ -596,110 +1858,128 @@ int vraw_reader_frame_read(struct vraw_reader *self,
 	ULOG_ERRNO_RETURN_ERR_IF(len < self->frame_size, ENOBUFS);
 	ULOG_ERRNO_RETURN_ERR_IF(self->file == NULL, EPROTO);
 
-	if (self->cfg.y4m) {
-		/* Read the frame header */
-		res = y4m_frame_header_read(self);
-		if (feof(self->file) || (self->cfg.max_count > 0 &&
-					 self->index > self->cfg.max_count)) {
-			if (self->cfg.loop > 0) {
-				self->index = 0;
-				res = fseeko(self->file,
-					     self->header_offset,
-					     SEEK_SET);
-				if (res < 0) {
-					res = -errno;
-					ULOG_ERRNO("fseeko", -res);
-					return res;
-				}
-
-				res = y4m_frame_header_read(self);
-				if (res < 0)
-					return res;
-			} else if (self->cfg.loop < 0) {
-				self->reverse = 1;
-				res = seek_to_previous_frame(self);
-				if (res < 0)
-					return res;
-
-				res = y4m_frame_header_read(self);
-				if (res < 0)
-					return res;
-			} else {
-				return -ENOENT;
-			}
-		} else if (res != -1) {
-			res = -errno;
-			ULOG_ERRNO("y4m_frame_header_read", -res);
-			return res;
-		}
-	}
+	step = self->cfg.frame_step;
+
+	if (self->end_index == 0)
+		return -ENOENT;
 
-	/* Read the YUV data */
-	res1 = vraw_reader_frame_read_planes(self, data);
-	if (feof(self->file) ||
-	    (self->cfg.max_count > 0 && (self->index > self->cfg.max_count))) {
+	if (self->index >= self->end_index) {
 		if (self->cfg.loop > 0) {
 			self->index = 0;
-			res = fseeko(self->file, self->header_offset, SEEK_SET);
-			if (res < 0) {
-				res = -errno;
-				ULOG_ERRNO("fseeko", -res);
-				return res;
-			}
-
-			res = vraw_reader_frame_read(self, data, len, frame);
-			if (res < 0)
-				ULOG_ERRNO("vraw_reader_frame_read", -res);
-			return res;
+			self->stats.loops++;
 		} else if (self->cfg.loop < 0) {
+			/* Bounce back: the last frame read was at
+			 * (index - step), the next one is one step before */
 			self->reverse = 1;
-			res = seek_to_previous_frame(self);
-			if (res < 0)
-				return res;
-
-			res = vraw_reader_frame_read(self, data, len, frame);
-			if (res < 0)
-				ULOG_ERRNO("vraw_reader_frame_read", -res);
-			return res;
+			self->stats.reversals++;
+			self->index = (self->index >= 2 * step)
+					      ? self->index - 2 * step
+					      : 0;
+			if (self->index >= self->end_index)
+				self->index = self->end_index - 1;
 		} else {
 			return -ENOENT;
 		}
-	} else if (res1 != 1) {
-		res = -errno;
-		ULOG_ERRNO("vraw_reader_frame_read_planes", -res);
-		return res;
 	}
 
+	/* Read the frame data */
+	if (self->cfg.compressed)
+		res = vraw_reader_frame_read_planes_compressed(self, data);
+	else if (self->cfg.split_planes)
+		res = vraw_reader_frame_read_planes_split(self, data);
+	else if (self->cfg.subsample > 1)
+		res = vraw_reader_frame_read_planes_subsampled(self, data);
+	else
+		res = vraw_reader_frame_read_planes(self, data);
+	if (res < 0)
+		return res;
 
 	/* Fill the frame info */
 	plane_count = vdef_get_raw_frame_plane_count(&self->cfg.format);
 	for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++) {
-		frame->data[p] = data;
-		data = (p + 1) < plane_count ? data + self->plane_size[p]
-					     : NULL;
+		if ((p < plane_count) && (self->cfg.plane_mask & (1 << p)))
+			frame->data[p] = data + self->plane_offset[p];
+		else
+			frame->data[p] = NULL;
 	}
 	memcpy(frame->frame.plane_stride,
 	       self->plane_stride,
 	       sizeof(self->plane_stride));
 	frame->frame.format = self->cfg.format;
 	vdef_format_to_frame_info(&self->cfg.info, &frame->frame.info);
-	frame->frame.info.timestamp = self->timestamp;
+	frame->frame.info.resolution = self->resolution;
+	entry = ts_entry(self, self->index);
+	if (entry != NULL) {
+		/* Recorded frame information */
+		frame->frame.info.timestamp = vraw_le_get_u64(
+			entry + VRAW_TS_ENTRY_OFFSET_TIMESTAMP);
+		frame->frame.info.capture_timestamp = vraw_le_get_u64(
+			entry + VRAW_TS_ENTRY_OFFSET_CAPTURE_TS);
+		frame->frame.info.flags =
+			vraw_le_get_u64(entry + VRAW_TS_ENTRY_OFFSET_FLAGS);
+		frame->frame.info.index =
+			vraw_le_get_u32(entry + VRAW_TS_ENTRY_OFFSET_INDEX);
+	} else {
+		if (self->cfg.ring) {
+			frame->frame.info.timestamp =
+				self->ring_ts[ring_slot(self, self->index)];
+		} else {
+			frame->frame.info.timestamp = self->timestamp;
+		}
+		frame->frame.info.index = self->count;
+	}
 	frame->frame.info.timescale = 1000000;
-	frame->frame.info.index = self->count;
 
-	self->timestamp += 1000000ULL * self->cfg.info.framerate.den /
-			   self->cfg.info.framerate.num;
+	/* Skipped frames still count in the timeline */
+	self->timestamp += step * (1000000ULL * self->cfg.info.framerate.den /
+				   self->cfg.info.framerate.num);
 
 	self->count++;
+	self->stats.frames++;
 
-	if (self->reverse) {
-		res = seek_to_previous_frame(self);
-		if (res < 0) {
-			if (res != -EOVERFLOW)
-				return res;
-			self->reverse = 0;
-		}
+	/* Move to the next frame to read */
+	if (!self->reverse) {
+		self->index += step;
+	} else if (self->index >= step) {
+		self->index -= step;
+	} else {
+		self->reverse = 0;
+		self->index += step;
+		self->stats.reversals++;
 	}
 
 	return 0;
 }
+
+
+int vraw_reader_seek_ts(struct vraw_reader *self, uint64_t timestamp)
+{
+	unsigned int lo = 0, hi, mid;
+
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+
+	if (self->end_index == 0)
+		return -ENOENT;
+
+	/* Binary search of the first frame after the timestamp; the frame
+	 * before it is the last one at or before the timestamp; with a
+	 * sidecar file, only the frames with an entry are searched */
+	hi = self->end_index;
+	if ((self->ts_map != NULL) && (hi > self->ts_count))
+		hi = self->ts_count;
+	if (hi == 0)
+		return -ENOENT;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (frame_ts(self, mid) <= timestamp)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	self->index = (lo > 0) ? lo - 1 : 0;
+	self->reverse = 0;
+	self->timestamp = frame_ts(self, self->index);
+
+	return 0;
+}
@@ -0,0 +1,68 @@
+/**
+ * Copyright (c) 2018 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _VRAW_RING_H_
+#define _VRAW_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vraw_le.h"
+
+
+/* Flight recorder ring file layout: slot_count frame slots of slot_size
+ * bytes each, followed by a trailer made of a fixed size header and of
+ * the per-slot timestamps; all integers are little-endian.
+ *
+ * Trailer header:
+ *   0  magic "VRAWRING"
+ *   8  u32 version
+ *  12  u32 slot_count
+ *  16  u64 slot_size
+ *  24  u32 head: next slot to be written
+ *  28  u32 count: number of valid slots (the oldest one is at
+ *      head - count, modulo slot_count)
+ * Then slot_count u64 timestamps in microseconds. */
+#define VRAW_RING_MAGIC "VRAWRING"
+#define VRAW_RING_MAGIC_SIZE 8
+#define VRAW_RING_VERSION 1
+#define VRAW_RING_HEADER_SIZE 32
+#define VRAW_RING_TS_SIZE 8
+
+#define VRAW_RING_OFFSET_VERSION 8
+#define VRAW_RING_OFFSET_SLOT_COUNT 12
+#define VRAW_RING_OFFSET_SLOT_SIZE 16
+#define VRAW_RING_OFFSET_HEAD 24
+#define VRAW_RING_OFFSET_COUNT 28
+
+
+static inline size_t vraw_ring_trailer_size(unsigned int slot_count)
+{
+	return VRAW_RING_HEADER_SIZE + (size_t)slot_count * VRAW_RING_TS_SIZE;
+}
+
+
+#endif /* !_VRAW_RING_H_ */
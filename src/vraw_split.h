@@ -0,0 +1,71 @@
+/**
+ * Copyright (c) 2018 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _VRAW_SPLIT_H_
+#define _VRAW_SPLIT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vraw_le.h"
+
+
+/* Per-plane split storage layout; all integers are little-endian.
+ *
+ * The file itself is a manifest:
+ *   0  magic "VRAWPLNS"
+ *   8  u32 version
+ *  12  u32 plane_count
+ *  16  u32 width
+ *  20  u32 height
+ *  24  plane_count u64 plane sizes: size of one frame in each plane
+ *      file
+ *
+ * Each plane is stored in its own file, named after the manifest with
+ * the VRAW_SPLIT_SUFFIX_FMT suffix and the plane index; a plane file
+ * only holds the rows of that plane, frame after frame, as in a raw
+ * file. The frame count is given by the plane file sizes. */
+#define VRAW_SPLIT_MAGIC "VRAWPLNS"
+#define VRAW_SPLIT_MAGIC_SIZE 8
+#define VRAW_SPLIT_VERSION 1
+#define VRAW_SPLIT_HEADER_SIZE 24
+#define VRAW_SPLIT_ENTRY_SIZE 8
+#define VRAW_SPLIT_SUFFIX_FMT ".plane%u"
+
+#define VRAW_SPLIT_OFFSET_VERSION 8
+#define VRAW_SPLIT_OFFSET_PLANE_COUNT 12
+#define VRAW_SPLIT_OFFSET_WIDTH 16
+#define VRAW_SPLIT_OFFSET_HEIGHT 20
+
+
+static inline size_t vraw_split_manifest_size(unsigned int plane_count)
+{
+	return VRAW_SPLIT_HEADER_SIZE +
+	       (size_t)plane_count * VRAW_SPLIT_ENTRY_SIZE;
+}
+
+
+#endif /* !_VRAW_SPLIT_H_ */
@@ -0,0 +1,69 @@
+/**
+ * Copyright (c) 2018 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _VRAW_TS_H_
+#define _VRAW_TS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vraw_le.h"
+
+
+/* Timestamp sidecar file layout, next to the data file and named after
+ * it with the VRAW_TS_SUFFIX suffix; all integers are little-endian.
+ *
+ * Header:
+ *   0  magic "VRAWTIME"
+ *   8  u32 version
+ *  12  u32 entry_size
+ *
+ * Then one entry per frame, in file order:
+ *   0  u64 timestamp in microseconds
+ *   8  u64 capture timestamp in microseconds
+ *  16  u64 frame flags
+ *  24  u32 frame index
+ *  28  u32 reserved (0)
+ * The entries are written after the frames, so after a crash there
+ * may be fewer entries than frames, or entries for frames that are not
+ * complete; the reader only uses the entries of complete frames. */
+#define VRAW_TS_MAGIC "VRAWTIME"
+#define VRAW_TS_MAGIC_SIZE 8
+#define VRAW_TS_VERSION 1
+#define VRAW_TS_HEADER_SIZE 16
+#define VRAW_TS_ENTRY_SIZE 32
+#define VRAW_TS_SUFFIX ".timestamps"
+
+#define VRAW_TS_OFFSET_VERSION 8
+#define VRAW_TS_OFFSET_ENTRY_SIZE 12
+
+#define VRAW_TS_ENTRY_OFFSET_TIMESTAMP 0
+#define VRAW_TS_ENTRY_OFFSET_CAPTURE_TS 8
+#define VRAW_TS_ENTRY_OFFSET_FLAGS 16
+#define VRAW_TS_ENTRY_OFFSET_INDEX 24
+
+
+#endif /* !_VRAW_TS_H_ */
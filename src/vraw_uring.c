@@ -0,0 +1,348 @@
+/**
+ * Copyright (c) 2018 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ANDROID
+#	ifndef _FILE_OFFSET_BITS
+#		define _FILE_OFFSET_BITS 64
+#	endif /* _FILE_OFFSET_BITS */
+#endif /* ANDROID */
+
+#include "vraw_uring.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef VRAW_HAVE_IO_URING
+#	include <linux/io_uring.h>
+#	include <sys/mman.h>
+#	include <sys/syscall.h>
+#	include <unistd.h>
+#endif
+
+#define ULOG_TAG vraw
+#include <ulog.h>
+
+
+#ifdef VRAW_HAVE_IO_URING
+
+
+struct vraw_uring {
+	int fd;
+	unsigned int pending;
+
+	/* Submission ring */
+	void *sq_ptr;
+	size_t sq_size;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int sq_mask;
+	unsigned int sq_entries;
+	unsigned int *sq_array;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	/* Completion ring */
+	void *cq_ptr;
+	size_t cq_size;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int cq_mask;
+	struct io_uring_cqe *cqes;
+};
+
+
+int vraw_uring_new(unsigned int entries, struct vraw_uring **ret_obj)
+{
+	int res;
+	struct vraw_uring *self;
+	struct io_uring_params p;
+	uint8_t *sq, *cq;
+
+	ULOG_ERRNO_RETURN_ERR_IF(entries == 0, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(ret_obj == NULL, EINVAL);
+
+	self = calloc(1, sizeof(*self));
+	if (self == NULL)
+		return -ENOMEM;
+	self->sq_ptr = MAP_FAILED;
+	self->cq_ptr = MAP_FAILED;
+	self->sqes = MAP_FAILED;
+
+	memset(&p, 0, sizeof(p));
+	self->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (self->fd < 0) {
+		res = -errno;
+		ULOG_ERRNO("io_uring_setup", -res);
+		goto error;
+	}
+
+	self->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	self->cq_size =
+		p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (self->cq_size > self->sq_size)
+			self->sq_size = self->cq_size;
+		self->cq_size = 0;
+	}
+
+	self->sq_ptr = mmap(NULL,
+			    self->sq_size,
+			    PROT_READ | PROT_WRITE,
+			    MAP_SHARED | MAP_POPULATE,
+			    self->fd,
+			    IORING_OFF_SQ_RING);
+	if (self->sq_ptr == MAP_FAILED) {
+		res = -errno;
+		ULOG_ERRNO("mmap", -res);
+		goto error;
+	}
+
+	if (self->cq_size > 0) {
+		self->cq_ptr = mmap(NULL,
+				    self->cq_size,
+				    PROT_READ | PROT_WRITE,
+				    MAP_SHARED | MAP_POPULATE,
+				    self->fd,
+				    IORING_OFF_CQ_RING);
+		if (self->cq_ptr == MAP_FAILED) {
+			res = -errno;
+			ULOG_ERRNO("mmap", -res);
+			goto error;
+		}
+	}
+
+	self->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	self->sqes = mmap(NULL,
+			  self->sqes_size,
+			  PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE,
+			  self->fd,
+			  IORING_OFF_SQES);
+	if (self->sqes == MAP_FAILED) {
+		res = -errno;
+		ULOG_ERRNO("mmap", -res);
+		goto error;
+	}
+
+	sq = self->sq_ptr;
+	cq = (self->cq_size > 0) ? self->cq_ptr : self->sq_ptr;
+	self->sq_head = (unsigned int *)(sq + p.sq_off.head);
+	self->sq_tail = (unsigned int *)(sq + p.sq_off.tail);
+	self->sq_mask = *(unsigned int *)(sq + p.sq_off.ring_mask);
+	self->sq_entries = p.sq_entries;
+	self->sq_array = (unsigned int *)(sq + p.sq_off.array);
+	self->cq_head = (unsigned int *)(cq + p.cq_off.head);
+	self->cq_tail = (unsigned int *)(cq + p.cq_off.tail);
+	self->cq_mask = *(unsigned int *)(cq + p.cq_off.ring_mask);
+	self->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+	*ret_obj = self;
+	return 0;
+
+error:
+	vraw_uring_destroy(self);
+	*ret_obj = NULL;
+	return res;
+}
+
+
+void vraw_uring_destroy(struct vraw_uring *self)
+{
+	if (self == NULL)
+		return;
+
+	if (self->sqes != MAP_FAILED)
+		munmap(self->sqes, self->sqes_size);
+	if (self->cq_ptr != MAP_FAILED)
+		munmap(self->cq_ptr, self->cq_size);
+	if (self->sq_ptr != MAP_FAILED)
+		munmap(self->sq_ptr, self->sq_size);
+	if (self->fd >= 0)
+		close(self->fd);
+
+	free(self);
+}
+
+
+int vraw_uring_register_buffers(struct vraw_uring *self,
+				const struct iovec *iov,
+				unsigned int count)
+{
+	int res;
+
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(iov == NULL, EINVAL);
+
+	res = syscall(__NR_io_uring_register,
+		      self->fd,
+		      IORING_REGISTER_BUFFERS,
+		      iov,
+		      count);
+	if (res < 0)
+		return -errno;
+
+	return 0;
+}
+
+
+int vraw_uring_prep_write(struct vraw_uring *self,
+			  int fd,
+			  const void *buf,
+			  size_t len,
+			  off_t offset,
+			  int buf_index,
+			  uint64_t user_data)
+{
+	unsigned int head, tail, index;
+	struct io_uring_sqe *sqe;
+
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+
+	/* The kernel consumes entries from the head */
+	head = __atomic_load_n(self->sq_head, __ATOMIC_ACQUIRE);
+	tail = *self->sq_tail;
+	if (tail - head >= self->sq_entries)
+		return -EBUSY;
+
+	index = tail & self->sq_mask;
+	sqe = &self->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = (buf_index >= 0) ? IORING_OP_WRITE_FIXED
+				       : IORING_OP_WRITE;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t)buf;
+	sqe->len = len;
+	sqe->off = offset;
+	sqe->buf_index = (buf_index >= 0) ? buf_index : 0;
+	sqe->user_data = user_data;
+	self->sq_array[index] = index;
+
+	/* Publish the entry */
+	__atomic_store_n(self->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	self->pending++;
+
+	return 0;
+}
+
+
+int vraw_uring_enter(struct vraw_uring *self, unsigned int wait_nr)
+{
+	int res;
+
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+
+	if ((self->pending == 0) && (wait_nr == 0))
+		return 0;
+
+	res = syscall(__NR_io_uring_enter,
+		      self->fd,
+		      self->pending,
+		      wait_nr,
+		      (wait_nr > 0) ? IORING_ENTER_GETEVENTS : 0,
+		      NULL,
+		      0);
+	if (res < 0)
+		return -errno;
+	self->pending -= res;
+
+	return res;
+}
+
+
+int vraw_uring_reap(struct vraw_uring *self, uint64_t *user_data, int *res)
+{
+	unsigned int head, tail;
+	struct io_uring_cqe *cqe;
+
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(user_data == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(res == NULL, EINVAL);
+
+	/* The kernel produces entries at the tail */
+	head = *self->cq_head;
+	tail = __atomic_load_n(self->cq_tail, __ATOMIC_ACQUIRE);
+	if (head == tail)
+		return 0;
+
+	cqe = &self->cqes[head & self->cq_mask];
+	*user_data = cqe->user_data;
+	*res = cqe->res;
+
+	/* Release the entry */
+	__atomic_store_n(self->cq_head, head + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+
+#else /* !VRAW_HAVE_IO_URING */
+
+
+int vraw_uring_new(unsigned int entries, struct vraw_uring **ret_obj)
+{
+	return -ENOSYS;
+}
+
+
+void vraw_uring_destroy(struct vraw_uring *self)
+{
+}
+
+
+int vraw_uring_register_buffers(struct vraw_uring *self,
+				const struct iovec *iov,
+				unsigned int count)
+{
+	return -ENOSYS;
+}
+
+
+int vraw_uring_prep_write(struct vraw_uring *self,
+			  int fd,
+			  const void *buf,
+			  size_t len,
+			  off_t offset,
+			  int buf_index,
+			  uint64_t user_data)
+{
+	return -ENOSYS;
+}
+
+
+int vraw_uring_enter(struct vraw_uring *self, unsigned int wait_nr)
+{
+	return -ENOSYS;
+}
+
+
+int vraw_uring_reap(struct vraw_uring *self, uint64_t *user_data, int *res)
+{
+	return -ENOSYS;
+}
+
+
+#endif /* !VRAW_HAVE_IO_URING */
@@ -0,0 +1,82 @@
+/**
+ * Copyright (c) 2018 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _VRAW_URING_H_
+#define _VRAW_URING_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#if defined(__linux__) && defined(__has_include)
+#	if __has_include(<linux/io_uring.h>)
+#		define VRAW_HAVE_IO_URING 1
+#	endif
+#endif
+
+
+/* Minimal io_uring submission/completion ring, built directly on the
+ * system calls; only file writes are supported. When io_uring is not
+ * available, all functions fail with -ENOSYS. */
+struct vraw_uring;
+
+
+int vraw_uring_new(unsigned int entries, struct vraw_uring **ret_obj);
+
+
+void vraw_uring_destroy(struct vraw_uring *self);
+
+
+/* Register fixed buffers; buffer indexes in vraw_uring_prep_write()
+ * refer to the registered iovec array */
+int vraw_uring_register_buffers(struct vraw_uring *self,
+				const struct iovec *iov,
+				unsigned int count);
+
+
+/* Queue a write request; buf_index is a registered buffer index, or -1
+ * for a regular write. Returns -EBUSY if the submission ring is full.
+ * The request is only submitted to the kernel by vraw_uring_enter(). */
+int vraw_uring_prep_write(struct vraw_uring *self,
+			  int fd,
+			  const void *buf,
+			  size_t len,
+			  off_t offset,
+			  int buf_index,
+			  uint64_t user_data);
+
+
+/* Submit the queued requests and wait for at least wait_nr completions.
+ * Returns the number of requests submitted. */
+int vraw_uring_enter(struct vraw_uring *self, unsigned int wait_nr);
+
+
+/* Get a completion if any: returns 1 and fills user_data and res if a
+ * completion was reaped, 0 otherwise */
+int vraw_uring_reap(struct vraw_uring *self, uint64_t *user_data, int *res);
+
+
+#endif /* !_VRAW_URING_H_ */
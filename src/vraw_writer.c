@@ -30,11 +30,37 @@
 #	endif /* _FILE_OFFSET_BITS */
 #endif /* ANDROID */
 
+#ifndef _GNU_SOURCE
+#	define _GNU_SOURCE
+#endif /* _GNU_SOURCE */
+
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <video-raw/vraw.h>
 
+#include "vraw_conv.h"
+#include "vraw_split.h"
+#include "vraw_ts.h"
+#include "vraw_uring.h"
+#include "vraw_writer_priv.h"
+
+#ifndef O_DIRECT
+#	define O_DIRECT 0
+#endif /* O_DIRECT */
+
 #define ULOG_TAG vraw
 #include <ulog.h>
 
@@ -79,286 +105,2569 @@ static void initialize_supported_formats(void)
 }
 
 
-struct vraw_writer {
-	struct vraw_writer_config cfg;
-	char *filename;
-	FILE *file;
-	size_t primary_line_width;
-};
+/* Default number of frames in flight with the io_uring backend */
+#define DEFAULT_URING_DEPTH 4
+
+/* Default pipe buffer size for pipe outputs */
+#define DEFAULT_PIPE_SIZE (1024 * 1024)
+
+/* Minimum preallocation extent when the expected size is exceeded */
+#define PREALLOC_EXTENT_MIN (64 * 1024 * 1024)
+#define PREALLOC_EXTENT_MIN_FRAMES 16
+
+/* Maximum number of vectors per pwritev() call for frames written at
+ * their slot (the vectors are on the stack) */
+#define WRITE_AT_IOV_MAX 64
+
+/* Number of timestamp sidecar entries buffered between writes */
+#define TS_BUF_ENTRIES 256
 
 
-static int y4m_header_write(struct vraw_writer *self)
+static int frame_write(struct vraw_writer *self,
+		       const struct vraw_frame *frame);
+
+
+static const struct vraw_writer_ops *
+get_ops(const struct vraw_writer_config *config);
+
+
+static void *writer_thread(void *ptr)
 {
-	const char *fmt = "";
+	int res;
+	struct vraw_writer *self = ptr;
+	struct vraw_frame frame;
 
-	ULOG_ERRNO_RETURN_ERR_IF(
-		!vdef_raw_format_cmp(&self->cfg.format, &vdef_i420) &&
-			!vdef_raw_format_cmp(&self->cfg.format,
-					     &vdef_i420_10_16le),
-		EINVAL);
+	pthread_mutex_lock(&self->mutex);
+	while (1) {
+		while ((self->queue_count == 0) && !self->stop)
+			pthread_cond_wait(&self->cond, &self->mutex);
+		if (self->queue_count == 0)
+			break;
 
-	if (vdef_raw_format_cmp(&self->cfg.format, &vdef_i420))
-		fmt = " C420";
-	else if (vdef_raw_format_cmp(&self->cfg.format, &vdef_i420_10_16le))
-		fmt = " C420p10";
+		/* Note: the frame stays in the queue while being written so
+		 * that it is accounted in the queue depth */
+		frame = self->queue[self->queue_head];
+		pthread_mutex_unlock(&self->mutex);
 
-	fprintf(self->file,
-		"YUV4MPEG2 W%d H%d F%d:%d Ip A%d:%d%s\n",
-		self->cfg.info.resolution.width,
-		self->cfg.info.resolution.height,
-		self->cfg.info.framerate.num,
-		self->cfg.info.framerate.den,
-		self->cfg.info.sar.width,
-		self->cfg.info.sar.height,
-		fmt);
+		res = frame_write(self, &frame);
 
-	return 0;
+		pthread_mutex_lock(&self->mutex);
+		self->queue_head++;
+		if (self->queue_head == self->cfg.queue_depth)
+			self->queue_head = 0;
+		self->queue_count--;
+		self->async_stats.frames = self->stats.frames;
+		self->async_stats.bytes = self->stats.bytes;
+		self->async_stats.io_calls = self->stats.io_calls;
+		self->async_stats.seeks = self->stats.seeks;
+		self->async_stats.io_time_ns = self->stats.io_time_ns;
+		self->async_stats.copy_time_ns = self->stats.copy_time_ns;
+		self->async_stats.segments = self->stats.segments;
+		self->async_stats.max_write_latency_ns =
+			self->stats.max_write_latency_ns;
+		pthread_cond_broadcast(&self->cond);
+		pthread_mutex_unlock(&self->mutex);
+
+		if (self->cfg.cbs.frame_done != NULL)
+			self->cfg.cbs.frame_done(
+				self, &frame, res, self->cfg.userdata);
+
+		pthread_mutex_lock(&self->mutex);
+	}
+	pthread_mutex_unlock(&self->mutex);
+
+	return NULL;
 }
 
 
-int vraw_writer_new(const char *filename,
-		    const struct vraw_writer_config *config,
-		    struct vraw_writer **ret_obj)
+static int async_setup(struct vraw_writer *self)
 {
-	int res = 0;
-	struct vraw_writer *self = NULL;
+	int res;
 
-	(void)pthread_once(&supported_formats_is_init,
-			   initialize_supported_formats);
+	self->queue = calloc(self->cfg.queue_depth, sizeof(*self->queue));
+	if (self->queue == NULL)
+		return -ENOMEM;
 
-	ULOG_ERRNO_RETURN_ERR_IF(filename == NULL, EINVAL);
-	ULOG_ERRNO_RETURN_ERR_IF(config == NULL, EINVAL);
-	ULOG_ERRNO_RETURN_ERR_IF(
-		!vdef_raw_format_intersect(&config->format,
-					   supported_formats,
-					   NB_SUPPORTED_FORMATS),
-		EINVAL);
-	ULOG_ERRNO_RETURN_ERR_IF(config->info.resolution.width == 0, EINVAL);
-	ULOG_ERRNO_RETURN_ERR_IF(config->info.resolution.height == 0, EINVAL);
-	ULOG_ERRNO_RETURN_ERR_IF(
-		vdef_raw_format_cmp(&config->format, &vdef_nv21_10_packed) &&
-			(config->info.resolution.width & 3),
-		EINVAL);
-	ULOG_ERRNO_RETURN_ERR_IF(ret_obj == NULL, EINVAL);
+	res = pthread_mutex_init(&self->mutex, NULL);
+	if (res != 0) {
+		ULOG_ERRNO("pthread_mutex_init", res);
+		return -res;
+	}
+	self->mutex_created = true;
 
-	self = calloc(1, sizeof(*self));
-	if (self == NULL)
-		return -ENOMEM;
+	res = pthread_cond_init(&self->cond, NULL);
+	if (res != 0) {
+		ULOG_ERRNO("pthread_cond_init", res);
+		return -res;
+	}
+	self->cond_created = true;
 
-	self->cfg = *config;
+	self->async_stats = self->stats;
 
-	/* Enforce the configuration */
-	if (vdef_frac_is_null(&self->cfg.info.framerate)) {
-		self->cfg.info.framerate.num = 30;
-		self->cfg.info.framerate.den = 1;
+	res = pthread_create(&self->thread, NULL, writer_thread, self);
+	if (res != 0) {
+		ULOG_ERRNO("pthread_create", res);
+		return -res;
 	}
-	if (vdef_dim_is_null(&self->cfg.info.sar)) {
-		self->cfg.info.sar.width = 1;
-		self->cfg.info.sar.height = 1;
+	self->thread_launched = true;
+
+	return 0;
+}
+
+
+static int async_frames_queue(struct vraw_writer *self,
+			      const struct vraw_frame *frames,
+			      unsigned int count)
+{
+	int res = 0;
+	uint64_t start;
+	unsigned int tail;
+
+	pthread_mutex_lock(&self->mutex);
+
+	/* A batch is either queued or dropped as a whole */
+	if ((self->cfg.queue_full == VRAW_WRITER_QUEUE_FULL_DROP) &&
+	    (self->cfg.queue_depth - self->queue_count < count)) {
+		self->async_stats.dropped += count;
+		res = -EAGAIN;
+		goto out;
 	}
 
-	self->primary_line_width = self->cfg.info.resolution.width *
-				   self->cfg.format.data_size / 8;
+	for (unsigned int i = 0; i < count; i++) {
+		if (self->queue_count == self->cfg.queue_depth) {
+			/* Backpressure: wait for the writer thread */
+			start = get_time_ns();
+			while (self->queue_count == self->cfg.queue_depth)
+				pthread_cond_wait(&self->cond, &self->mutex);
+			self->async_stats.blocked_time_ns +=
+				get_time_ns() - start;
+		}
 
-	self->filename = strdup(filename);
-	if (self->filename == NULL) {
-		res = -ENOMEM;
-		goto error;
+		tail = (self->queue_head + self->queue_count) %
+		       self->cfg.queue_depth;
+		self->queue[tail] = frames[i];
+		self->queue_count++;
+		if (self->queue_count > self->async_stats.queue_max_depth)
+			self->async_stats.queue_max_depth = self->queue_count;
+		pthread_cond_broadcast(&self->cond);
 	}
 
-	self->file = fopen(self->filename, "wb");
-	if (self->file == NULL) {
-		res = -errno;
-		goto error;
+out:
+	pthread_mutex_unlock(&self->mutex);
+	return res;
+}
+
+
+static int pwritev_fd(struct vraw_writer *self,
+		      int fd,
+		      off_t *offset,
+		      struct iovec *iov,
+		      int iovcnt)
+{
+	int res, cnt;
+	ssize_t res1;
+	uint64_t start;
+
+	while (iovcnt > 0) {
+		cnt = (iovcnt > IOV_MAX) ? IOV_MAX : iovcnt;
+		start = get_time_ns();
+		res1 = pwritev(fd, iov, cnt, *offset);
+		self->stats.io_time_ns += get_time_ns() - start;
+		self->stats.io_calls++;
+		if (res1 < 0) {
+			if (errno == EINTR)
+				continue;
+			res = -errno;
+			ULOG_ERRNO("pwritev", -res);
+			return res;
+		} else if (res1 == 0) {
+			res = -EIO;
+			ULOG_ERRNO("pwritev", -res);
+			return res;
+		}
+		*offset += res1;
+		self->stats.bytes += res1;
+
+		/* Skip the fully written vectors and resume a partial
+		 * write where it stopped */
+		while ((iovcnt > 0) && ((size_t)res1 >= iov->iov_len)) {
+			res1 -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (res1 > 0) {
+			iov->iov_base = (uint8_t *)iov->iov_base + res1;
+			iov->iov_len -= res1;
+		}
 	}
 
-	if (self->cfg.y4m) {
-		/* Write YUV4MPEG2 file headers */
-		res = y4m_header_write(self);
-		if (res < 0)
-			goto error;
+	return 0;
+}
+
+
+int vraw_writer_pwritev(struct vraw_writer *self,
+			struct iovec *iov,
+			int iovcnt)
+{
+	return pwritev_fd(self, self->fd, &self->offset, iov, iovcnt);
+}
+
+
+static int direct_write(struct vraw_writer *self, size_t len)
+{
+	int res;
+	ssize_t res1;
+	size_t done = 0;
+	uint64_t start;
+
+	/* Write the beginning of the staging buffer; len is a multiple of
+	 * the alignment, except for the padded tail at destruction */
+	while (done < len) {
+		start = get_time_ns();
+		res1 = pwrite(self->fd,
+			      self->staging + done,
+			      len - done,
+			      self->offset);
+		self->stats.io_time_ns += get_time_ns() - start;
+		self->stats.io_calls++;
+		if (res1 < 0) {
+			if (errno == EINTR)
+				continue;
+			res = -errno;
+			ULOG_ERRNO("pwrite", -res);
+			return res;
+		} else if (res1 == 0) {
+			res = -EIO;
+			ULOG_ERRNO("pwrite", -res);
+			return res;
+		}
+		done += res1;
+		self->offset += res1;
+	}
+
+	/* Keep the unaligned remainder for the next write */
+	if (self->staging_len > len) {
+		memmove(self->staging,
+			self->staging + len,
+			self->staging_len - len);
+		self->staging_len -= len;
+	} else {
+		self->staging_len = 0;
 	}
 
-	*ret_obj = self;
 	return 0;
+}
 
-error:
-	(void)vraw_writer_destroy(self);
-	*ret_obj = NULL;
-	return res;
+
+static int direct_append(struct vraw_writer *self,
+			 const void *buf,
+			 size_t len)
+{
+	int res;
+	size_t n;
+	const uint8_t *src = buf;
+
+	while (len > 0) {
+		n = self->staging_size - self->staging_len;
+		if (n > len)
+			n = len;
+		memcpy(self->staging + self->staging_len, src, n);
+		self->staging_len += n;
+		self->stats.bytes += n;
+		src += n;
+		len -= n;
+		if (self->staging_len == self->staging_size) {
+			res = direct_write(self, self->staging_size);
+			if (res < 0)
+				return res;
+		}
+	}
+
+	return 0;
 }
 
 
-int vraw_writer_destroy(struct vraw_writer *self)
+int vraw_writer_direct_tail_write(struct vraw_writer *self)
 {
-	if (self == NULL)
+	int res;
+	off_t size = self->offset + self->staging_len;
+	size_t len;
+
+	if (self->staging_len == 0)
 		return 0;
 
-	if (self->file != NULL)
-		fclose(self->file);
+	/* Pad the tail to the alignment, then truncate the file to its
+	 * real size */
+	len = (self->staging_len + self->direct_align - 1) &
+	      ~(self->direct_align - 1);
+	memset(self->staging + self->staging_len,
+	       0,
+	       len - self->staging_len);
+	res = direct_write(self, len);
+	if (res < 0)
+		return res;
+
+	if (ftruncate(self->fd, size) < 0) {
+		res = -errno;
+		ULOG_ERRNO("ftruncate", -res);
+		return res;
+	}
+	self->offset = size;
 
-	free(self->filename);
-	free(self);
 	return 0;
 }
 
 
-int vraw_writer_frame_write(struct vraw_writer *self,
-			    const struct vraw_frame *frame)
+static int direct_setup(struct vraw_writer *self)
 {
-	int res = 0;
-	size_t strd, res1;
-	const uint8_t *ptr;
-	unsigned int i;
+	int res;
+	long page_size;
 
-	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
-	ULOG_ERRNO_RETURN_ERR_IF(frame == NULL, EINVAL);
-	ULOG_ERRNO_RETURN_ERR_IF(
-		!vdef_raw_format_cmp(&frame->frame.format, &self->cfg.format),
-		EINVAL);
-	ULOG_ERRNO_RETURN_ERR_IF((frame->frame.info.resolution.width != 0) &&
-					 (frame->frame.info.resolution.width !=
-					  self->cfg.info.resolution.width),
-				 EINVAL);
-	ULOG_ERRNO_RETURN_ERR_IF((frame->frame.info.resolution.height != 0) &&
-					 (frame->frame.info.resolution.height !=
-					  self->cfg.info.resolution.height),
-				 EINVAL);
-	ULOG_ERRNO_RETURN_ERR_IF(self->file == NULL, EPROTO);
+	/* Note: the page size satisfies the O_DIRECT alignment constraints
+	 * of all common filesystems and block devices */
+	page_size = sysconf(_SC_PAGESIZE);
+	if (page_size <= 0)
+		page_size = 4096;
+	self->direct_align = page_size;
 
-	if (self->cfg.y4m) {
-		/* Write YUV4MPEG2 frame header */
-		fprintf(self->file, "FRAME\n");
+	/* The staging buffer holds at least a whole frame */
+	self->staging_size = self->cfg.buffer_size;
+	if (self->staging_size < self->frame_file_size)
+		self->staging_size = self->frame_file_size;
+	self->staging_size = (self->staging_size + self->direct_align - 1) &
+			     ~(self->direct_align - 1);
+
+	res = posix_memalign((void **)&self->staging,
+			     self->direct_align,
+			     self->staging_size);
+	if (res != 0) {
+		self->staging = NULL;
+		ULOG_ERRNO("posix_memalign", res);
+		return -res;
 	}
 
-	/* Write raw data to file */
-	switch (self->cfg.format.data_layout) {
-	case VDEF_RAW_DATA_LAYOUT_PLANAR_Y_U_V:
-		ULOG_ERRNO_RETURN_ERR_IF(frame->cdata[0] == NULL, EINVAL);
-		ULOG_ERRNO_RETURN_ERR_IF(frame->cdata[1] == NULL, EINVAL);
-		ULOG_ERRNO_RETURN_ERR_IF(frame->cdata[2] == NULL, EINVAL);
-		ULOG_ERRNO_RETURN_ERR_IF(frame->frame.plane_stride[0] == 0,
-					 EINVAL);
-		ULOG_ERRNO_RETURN_ERR_IF(frame->frame.plane_stride[1] == 0,
-					 EINVAL);
-		ULOG_ERRNO_RETURN_ERR_IF(frame->frame.plane_stride[2] == 0,
-					 EINVAL);
-		/* Y */
-		ptr = frame->cdata[0];
-		strd = frame->frame.plane_stride[0];
-		for (i = 0; i < self->cfg.info.resolution.height; i++) {
-			res1 = fwrite(
-				ptr, self->primary_line_width, 1, self->file);
-			if (res1 != 1) {
-				res = -errno;
-				ULOG_ERRNO("fwrite", -res);
-				return res;
-			}
-			ptr += strd;
-		}
-
-		/* U/V */
-		ptr = frame->cdata[1];
-		strd = frame->frame.plane_stride[1];
-		for (i = 0; i < self->cfg.info.resolution.height / 2; i++) {
-			res1 = fwrite(ptr,
-				      self->primary_line_width / 2,
-				      1,
-				      self->file);
-			if (res1 != 1) {
-				res = -errno;
-				ULOG_ERRNO("fwrite", -res);
-				return res;
-			}
-			ptr += strd;
-		}
-
-		/* V/U */
-		ptr = frame->cdata[2];
-		strd = frame->frame.plane_stride[2];
-		for (i = 0; i < self->cfg.info.resolution.height / 2; i++) {
-			res1 = fwrite(ptr,
-				      self->primary_line_width / 2,
-				      1,
-				      self->file);
-			if (res1 != 1) {
-				res = -errno;
-				ULOG_ERRNO("fwrite", -res);
-				return res;
+	return 0;
+}
+
+
+/* Hand the pending data of the current pipe buffer half to the pipe */
+static int pipe_out(struct vraw_writer *self)
+{
+	int res;
+	ssize_t res1;
+	struct iovec iov;
+	struct pollfd pfd;
+	uint64_t start;
+	uint8_t *base = self->pipe_buf + self->pipe_half * self->pipe_size;
+
+	while (self->pipe_done < self->pipe_len) {
+		iov.iov_base = base + self->pipe_done;
+		iov.iov_len = self->pipe_len - self->pipe_done;
+		start = get_time_ns();
+#ifdef F_SETPIPE_SZ
+		if (self->pipe_vmsplice)
+			res1 = vmsplice(self->fd, &iov, 1, 0);
+		else
+#endif /* F_SETPIPE_SZ */
+			res1 = write(self->fd, iov.iov_base, iov.iov_len);
+		self->stats.io_time_ns += get_time_ns() - start;
+		self->stats.io_calls++;
+		if (res1 < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN) {
+				/* Non-blocking pipe */
+				pfd.fd = self->fd;
+				pfd.events = POLLOUT;
+				(void)poll(&pfd, 1, -1);
+				continue;
 			}
-			ptr += strd;
-		}
-		break;
-	case VDEF_RAW_DATA_LAYOUT_SEMI_PLANAR_Y_UV:
-		ULOG_ERRNO_RETURN_ERR_IF(frame->cdata[0] == NULL, EINVAL);
-		ULOG_ERRNO_RETURN_ERR_IF(frame->cdata[1] == NULL, EINVAL);
-		ULOG_ERRNO_RETURN_ERR_IF(frame->frame.plane_stride[0] == 0,
-					 EINVAL);
-		ULOG_ERRNO_RETURN_ERR_IF(frame->frame.plane_stride[1] == 0,
-					 EINVAL);
-		/* Y */
-		ptr = frame->cdata[0];
-		strd = frame->frame.plane_stride[0];
-		for (i = 0; i < self->cfg.info.resolution.height; i++) {
-			res1 = fwrite(
-				ptr, self->primary_line_width, 1, self->file);
-			if (res1 != 1) {
-				res = -errno;
-				ULOG_ERRNO("fwrite", -res);
-				return res;
+			if (self->pipe_vmsplice &&
+			    ((errno == EINVAL) || (errno == ENOSYS))) {
+				ULOGW("vmsplice not supported, "
+				      "using regular writes");
+				self->pipe_vmsplice = false;
+				continue;
 			}
-			ptr += strd;
+			res = -errno;
+			ULOG_ERRNO(self->pipe_vmsplice ? "vmsplice" : "write",
+				   -res);
+			return res;
 		}
+		self->pipe_done += res1;
+	}
 
-		/* UV/VU */
-		ptr = frame->cdata[1];
-		strd = frame->frame.plane_stride[1];
-		for (i = 0; i < self->cfg.info.resolution.height / 2; i++) {
-			res1 = fwrite(
-				ptr, self->primary_line_width, 1, self->file);
-			if (res1 != 1) {
-				res = -errno;
-				ULOG_ERRNO("fwrite", -res);
-				return res;
-			}
-			ptr += strd;
+	return 0;
+}
+
+
+/* Wait until the pipe holds at most max bytes; the data being handed in
+ * order, the older data has then been consumed by the reader and its
+ * pages are no longer referenced by the pipe */
+static int pipe_wait(struct vraw_writer *self, size_t max)
+{
+	int res, n;
+	struct pollfd pfd;
+
+	while (1) {
+		if (ioctl(self->fd, FIONREAD, &n) < 0) {
+			res = -errno;
+			ULOG_ERRNO("ioctl:FIONREAD", -res);
+			return res;
 		}
-		break;
-	case VDEF_RAW_DATA_LAYOUT_PACKED:
-		ULOG_ERRNO_RETURN_ERR_IF(frame->cdata[0] == NULL, EINVAL);
-		ULOG_ERRNO_RETURN_ERR_IF(frame->frame.plane_stride[0] == 0,
-					 EINVAL);
-		ptr = frame->cdata[0];
-		strd = frame->frame.plane_stride[0];
-		for (i = 0; i < self->cfg.info.resolution.height; i++) {
-			res1 = fwrite(
-				ptr, self->primary_line_width, 1, self->file);
-			if (res1 != 1) {
-				res = -errno;
-				ULOG_ERRNO("fwrite", -res);
+		if ((size_t)n <= max)
+			return 0;
+		/* Wait a little, unless the reading end is closed */
+		pfd.fd = self->fd;
+		pfd.events = 0;
+		pfd.revents = 0;
+		if ((poll(&pfd, 1, 1) > 0) && (pfd.revents & POLLERR))
+			return 0;
+	}
+}
+
+
+static int pipe_append(struct vraw_writer *self, const void *buf, size_t len)
+{
+	int res;
+	size_t n;
+	const uint8_t *src = buf;
+	uint8_t *base;
+
+	while (len > 0) {
+		base = self->pipe_buf + self->pipe_half * self->pipe_size;
+		n = self->pipe_size - self->pipe_len;
+		if (n > len)
+			n = len;
+		memcpy(base + self->pipe_len, src, n);
+		self->pipe_len += n;
+		self->stats.bytes += n;
+		src += n;
+		len -= n;
+		if (self->pipe_len < self->pipe_size)
+			continue;
+
+		res = pipe_out(self);
+		if (res < 0)
+			return res;
+
+		/* Switch to the other half, once the reader has consumed
+		 * it: only the data of the current half may remain in the
+		 * pipe */
+		if (self->pipe_vmsplice) {
+			res = pipe_wait(self, self->pipe_size);
+			if (res < 0)
 				return res;
-			}
-			ptr += strd;
 		}
-		break;
-	default: {
-		res = -ENOSYS;
-		ULOG_ERRNO("unsupported format: " VDEF_RAW_FORMAT_TO_STR_FMT,
-			   -res,
-			   VDEF_RAW_FORMAT_TO_STR_ARG(&self->cfg.format));
-		break;
+		self->pipe_half ^= 1;
+		self->pipe_len = 0;
+		self->pipe_done = 0;
+	}
+
+	return 0;
+}
+
+
+static int pipe_setup(struct vraw_writer *self)
+{
+#ifdef F_SETPIPE_SZ
+	int res;
+	size_t size = (self->cfg.pipe_size > 0) ? self->cfg.pipe_size
+						: DEFAULT_PIPE_SIZE;
+	void *buf;
+
+	if (size > INT_MAX)
+		size = INT_MAX;
+	if (fcntl(self->fd, F_SETPIPE_SZ, (int)size) < 0) {
+		ULOGW("failed to set the pipe size to %zu bytes: %s",
+		      size,
+		      strerror(errno));
 	}
+	res = fcntl(self->fd, F_GETPIPE_SZ);
+	if (res < 0) {
+		res = -errno;
+		ULOG_ERRNO("fcntl:F_GETPIPE_SZ", -res);
+		return res;
 	}
+	self->pipe_size = res;
 
-	if (res < 0)
+	/* Double buffering, with page-aligned halves of the pipe size: the
+	 * pages are handed to the pipe by reference, so a half is only
+	 * reused, and the buffer unmapped, once the reader has consumed
+	 * its data */
+	buf = mmap(NULL,
+		   2 * self->pipe_size,
+		   PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS,
+		   -1,
+		   0);
+	if (buf == MAP_FAILED) {
+		res = -errno;
+		ULOG_ERRNO("mmap", -res);
 		return res;
+	}
+	self->pipe_buf = buf;
+	self->pipe_vmsplice = true;
 
-	res = fflush(self->file);
+	return 0;
+#else /* !F_SETPIPE_SZ */
+	return -ENOSYS;
+#endif /* !F_SETPIPE_SZ */
+}
+
+
+static int get_fd(struct vraw_writer *self)
+{
+	return (self->file != NULL) ? fileno(self->file) : self->fd;
+}
+
+
+uint64_t vraw_writer_get_data_end(struct vraw_writer *self)
+{
+	/* Note: stdio writes are sequential, all bytes written so far in
+	 * the segment (including the y4m file header) are in the file */
+	uint64_t end, at_end;
+
+	if (self->file != NULL)
+		return self->stats.bytes - self->segment_bytes_start;
+
+	/* Frames written at their slot may end past the sequential data */
+	end = self->offset + self->staging_len;
+	at_end = __atomic_load_n(&self->at_end, __ATOMIC_RELAXED);
+	return (at_end > end) ? at_end : end;
+}
+
+
+int vraw_writer_prealloc(struct vraw_writer *self, uint64_t end)
+{
+#ifdef FALLOC_FL_KEEP_SIZE
+	int res;
+	uint64_t start;
+
+	/* Note: the file size is kept, so that a crashed recording does
+	 * not end with zeroes */
+	start = get_time_ns();
+	res = fallocate(get_fd(self),
+			FALLOC_FL_KEEP_SIZE,
+			self->prealloc_end,
+			end - self->prealloc_end);
+	self->stats.io_time_ns += get_time_ns() - start;
+	self->stats.io_calls++;
 	if (res < 0) {
 		res = -errno;
-		ULOG_ERRNO("fflush", -res);
+		if ((res == -EOPNOTSUPP) || (res == -ENOSYS)) {
+			ULOGW("preallocation not supported for '%s'",
+			      self->filename);
+			self->prealloc_end = 0;
+			return 0;
+		}
+		ULOG_ERRNO("fallocate", -res);
 		return res;
 	}
+	self->prealloc_end = end;
+#else /* !FALLOC_FL_KEEP_SIZE */
+	self->prealloc_end = 0;
+#endif /* !FALLOC_FL_KEEP_SIZE */
 
-	return res;
+	return 0;
+}
+
+
+static int prealloc_ensure(struct vraw_writer *self, unsigned int count)
+{
+	uint64_t end, extent;
+
+	if (self->prealloc_end == 0)
+		return 0;
+
+	end = vraw_writer_get_data_end(self) +
+	      (uint64_t)count * self->frame_file_size;
+	if (end <= self->prealloc_end)
+		return 0;
+
+	/* Past the expected size, preallocate in large extents */
+	extent = PREALLOC_EXTENT_MIN_FRAMES * self->frame_file_size;
+	if (extent < PREALLOC_EXTENT_MIN)
+		extent = PREALLOC_EXTENT_MIN;
+
+	return vraw_writer_prealloc(self, self->prealloc_end + extent);
+}
+
+
+static int prealloc_release(struct vraw_writer *self)
+{
+	int res;
+
+	if (self->prealloc_end == 0)
+		return 0;
+
+	/* Release the preallocated blocks past the end of the data */
+	if (ftruncate(get_fd(self), vraw_writer_get_data_end(self)) < 0) {
+		res = -errno;
+		ULOG_ERRNO("ftruncate", -res);
+		return res;
+	}
+	self->prealloc_end = 0;
+
+	return 0;
+}
+
+
+/* Write entries to the timestamp sidecar, at the position of the first
+ * one; this can be called from any thread */
+static int ts_write(struct vraw_writer *self,
+		    const uint8_t *buf,
+		    unsigned int count,
+		    uint64_t first)
+{
+	int res;
+	ssize_t res1;
+	size_t done = 0, len = (size_t)count * VRAW_TS_ENTRY_SIZE;
+	off_t offset = VRAW_TS_HEADER_SIZE + first * VRAW_TS_ENTRY_SIZE;
+
+	while (done < len) {
+		res1 = pwrite(self->ts_fd,
+			      buf + done,
+			      len - done,
+			      offset + done);
+		if (res1 < 0) {
+			if (errno == EINTR)
+				continue;
+			res = -errno;
+			ULOG_ERRNO("pwrite", -res);
+			return res;
+		} else if (res1 == 0) {
+			res = -EIO;
+			ULOG_ERRNO("pwrite", -res);
+			return res;
+		}
+		done += res1;
+	}
+
+	return 0;
+}
+
+
+static void ts_entry_fill(uint8_t *entry, const struct vraw_frame *frame)
+{
+	vraw_le_put_u64(entry + VRAW_TS_ENTRY_OFFSET_TIMESTAMP,
+			get_frame_ts_us(frame));
+	vraw_le_put_u64(entry + VRAW_TS_ENTRY_OFFSET_CAPTURE_TS,
+			frame->frame.info.capture_timestamp);
+	vraw_le_put_u64(entry + VRAW_TS_ENTRY_OFFSET_FLAGS,
+			frame->frame.info.flags);
+	vraw_le_put_u32(entry + VRAW_TS_ENTRY_OFFSET_INDEX,
+			frame->frame.info.index);
+	vraw_le_put_u32(entry + VRAW_TS_ENTRY_OFFSET_INDEX + 4, 0);
+}
+
+
+static int ts_flush(struct vraw_writer *self)
+{
+	int res;
+
+	if (self->ts_len == 0)
+		return 0;
+
+	res = ts_write(self,
+		       self->ts_buf,
+		       self->ts_len,
+		       self->ts_count - self->ts_len);
+	self->ts_len = 0;
+	return res;
+}
+
+
+static int ts_append(struct vraw_writer *self, const struct vraw_frame *frame)
+{
+	if (self->ts_buf == NULL)
+		return 0;
+
+	ts_entry_fill(self->ts_buf + self->ts_len * VRAW_TS_ENTRY_SIZE, frame);
+	self->ts_len++;
+	self->ts_count++;
+
+	return (self->ts_len == TS_BUF_ENTRIES) ? ts_flush(self) : 0;
+}
+
+
+static int ts_setup(struct vraw_writer *self)
+{
+	int res;
+	ssize_t res1;
+	char *filename = NULL;
+	uint8_t header[VRAW_TS_HEADER_SIZE];
+
+	if (asprintf(&filename, "%s" VRAW_TS_SUFFIX, self->filename) < 0)
+		return -ENOMEM;
+	self->ts_fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+			   0666);
+	if (self->ts_fd < 0) {
+		res = -errno;
+		ULOG_ERRNO("open:'%s'", -res, filename);
+		goto out;
+	}
+
+	memcpy(header, VRAW_TS_MAGIC, VRAW_TS_MAGIC_SIZE);
+	vraw_le_put_u32(header + VRAW_TS_OFFSET_VERSION, VRAW_TS_VERSION);
+	vraw_le_put_u32(header + VRAW_TS_OFFSET_ENTRY_SIZE,
+			VRAW_TS_ENTRY_SIZE);
+	res1 = pwrite(self->ts_fd, header, sizeof(header), 0);
+	if (res1 != (ssize_t)sizeof(header)) {
+		res = (res1 < 0) ? -errno : -EIO;
+		ULOG_ERRNO("pwrite", -res);
+		goto out;
+	}
+
+	self->ts_buf = malloc(TS_BUF_ENTRIES * VRAW_TS_ENTRY_SIZE);
+	res = (self->ts_buf == NULL) ? -ENOMEM : 0;
+
+out:
+	free(filename);
+	return res;
+}
+
+
+int vraw_writer_buf_write(struct vraw_writer *self,
+			  const void *buf,
+			  size_t len)
+{
+	int res;
+	size_t res1;
+	struct iovec iov;
+
+	if (self->staging != NULL)
+		return direct_append(self, buf, len);
+
+	if (self->pipe_buf != NULL)
+		return pipe_append(self, buf, len);
+
+	if (self->file == NULL) {
+		iov.iov_base = (void *)buf;
+		iov.iov_len = len;
+		return vraw_writer_pwritev(self, &iov, 1);
+	}
+
+	res1 = fwrite(buf, len, 1, self->file);
+	self->stats.io_calls++;
+	if (res1 != 1) {
+		res = -errno;
+		ULOG_ERRNO("fwrite", -res);
+		return res;
+	}
+	self->stats.bytes += len;
+
+	return 0;
+}
+
+
+static bool frame_needs_conv(struct vraw_writer *self,
+			     const struct vraw_frame *frame)
+{
+	return self->conv &&
+	       !vdef_raw_format_cmp(&frame->frame.format, &self->cfg.format);
+}
+
+
+/* Convert the chroma planes of a frame in the input format to the file
+ * format into dst, row by row */
+static void conv_chroma(struct vraw_writer *self,
+			const struct vraw_frame *frame,
+			uint8_t *dst)
+{
+	const struct vdef_raw_format *in = &self->cfg.input_format;
+	const struct vdef_raw_format *out = &self->cfg.format;
+	bool in_planar = (in->data_layout == VDEF_RAW_DATA_LAYOUT_PLANAR_Y_U_V);
+	bool out_planar =
+		(out->data_layout == VDEF_RAW_DATA_LAYOUT_PLANAR_Y_U_V);
+	bool swap = (in->pix_order != out->pix_order);
+	size_t ss = self->conv_sample_size;
+	size_t row = self->conv_count * ss;
+	unsigned int lines = self->plane_lines[1];
+	const uint8_t *src0, *src1 = NULL;
+	uint8_t *dst0;
+
+	for (unsigned int i = 0; i < lines; i++) {
+		/* Source rows; for a planar input, src0 is the component
+		 * that comes first in the file format */
+		src0 = frame->cdata[1] + i * frame->frame.plane_stride[1];
+		if (in_planar) {
+			src1 = frame->cdata[2] +
+			       i * frame->frame.plane_stride[2];
+			if (swap) {
+				const uint8_t *tmp = src0;
+				src0 = src1;
+				src1 = tmp;
+			}
+		}
+
+		if (out_planar) {
+			dst0 = dst + i * row;
+			if (in_planar) {
+				memcpy(dst0, src0, row);
+				memcpy(dst0 + lines * row, src1, row);
+			} else if (swap) {
+				vraw_conv_deinterleave(src0,
+						       dst0 + lines * row,
+						       dst0,
+						       self->conv_count,
+						       ss);
+			} else {
+				vraw_conv_deinterleave(src0,
+						       dst0,
+						       dst0 + lines * row,
+						       self->conv_count,
+						       ss);
+			}
+		} else {
+			dst0 = dst + i * 2 * row;
+			if (in_planar) {
+				vraw_conv_interleave(
+					src0, src1, dst0, self->conv_count, ss);
+			} else if (swap) {
+				vraw_conv_swap(
+					src0, dst0, self->conv_count, ss);
+			} else {
+				memcpy(dst0, src0, 2 * row);
+			}
+		}
+	}
+}
+
+
+/* Get the size of a plane if its rows are contiguous in the frame
+ * buffer, 0 otherwise */
+static size_t plane_contiguous_size(struct vraw_writer *self,
+				    const struct vraw_frame *frame,
+				    unsigned int p)
+{
+	if ((self->plane_lines[p] > 1) &&
+	    (frame->frame.plane_stride[p] != self->plane_line_width[p]))
+		return 0;
+
+	return self->plane_line_width[p] * self->plane_lines[p];
+}
+
+
+/* Get the size of the frame if all planes are contiguous and follow each
+ * other in the frame buffer (e.g. a frame from vraw_reader), 0 otherwise */
+static size_t frame_contiguous_size(struct vraw_writer *self,
+				    const struct vraw_frame *frame)
+{
+	size_t size = 0, len;
+
+	if (frame_needs_conv(self, frame))
+		return 0;
+
+	for (unsigned int p = 0; p < self->plane_count; p++) {
+		if ((p > 0) && (frame->cdata[p] != frame->cdata[0] + size))
+			return 0;
+		len = plane_contiguous_size(self, frame, p);
+		if (len == 0)
+			return 0;
+		size += len;
+	}
+
+	return size;
+}
+
+
+/* Write the frame data with a single call for a contiguous frame, one
+ * call per contiguous plane, or one call per row otherwise */
+static int frame_data_write(struct vraw_writer *self,
+			    const struct vraw_frame *frame)
+{
+	int res;
+	size_t len;
+	const uint8_t *ptr;
+
+	len = frame_contiguous_size(self, frame);
+	if (len > 0)
+		return vraw_writer_buf_write(self, frame->cdata[0], len);
+
+	for (unsigned int p = 0; p < self->plane_count; p++) {
+		if ((p == 1) && frame_needs_conv(self, frame)) {
+			/* Converted chroma planes */
+			conv_chroma(self, frame, self->conv_buf);
+			return vraw_writer_buf_write(
+				self, self->conv_buf, self->conv_size);
+		}
+		ptr = frame->cdata[p];
+		len = plane_contiguous_size(self, frame, p);
+		if (len > 0) {
+			res = vraw_writer_buf_write(self, ptr, len);
+			if (res < 0)
+				return res;
+			continue;
+		}
+		for (unsigned int i = 0; i < self->plane_lines[p]; i++) {
+			res = vraw_writer_buf_write(
+				self, ptr, self->plane_line_width[p]);
+			if (res < 0)
+				return res;
+			ptr += frame->frame.plane_stride[p];
+		}
+	}
+
+	return 0;
+}
+
+
+uint8_t *vraw_writer_frame_pack(struct vraw_writer *self,
+				const struct vraw_frame *frame,
+				uint8_t *dst)
+{
+	size_t len;
+	const uint8_t *src;
+
+	len = frame_contiguous_size(self, frame);
+	if (len > 0) {
+		memcpy(dst, frame->cdata[0], len);
+		return dst + len;
+	}
+
+	for (unsigned int p = 0; p < self->plane_count; p++) {
+		if ((p == 1) && frame_needs_conv(self, frame)) {
+			/* Convert the chroma planes in place */
+			conv_chroma(self, frame, dst);
+			return dst + self->conv_size;
+		}
+		src = frame->cdata[p];
+		len = plane_contiguous_size(self, frame, p);
+		if (len > 0) {
+			memcpy(dst, src, len);
+			dst += len;
+			continue;
+		}
+		for (unsigned int i = 0; i < self->plane_lines[p]; i++) {
+			memcpy(dst, src, self->plane_line_width[p]);
+			dst += self->plane_line_width[p];
+			src += frame->frame.plane_stride[p];
+		}
+	}
+
+	return dst;
+}
+
+
+int vraw_writer_y4m_header_write(struct vraw_writer *self)
+{
+	int res;
+	char str[Y4M_FILE_HEADER_MAX_SIZE];
+	const char *fmt = "";
+
+	ULOG_ERRNO_RETURN_ERR_IF(
+		!vdef_raw_format_cmp(&self->cfg.format, &vdef_i420) &&
+			!vdef_raw_format_cmp(&self->cfg.format,
+					     &vdef_i420_10_16le),
+		EINVAL);
+
+	if (vdef_raw_format_cmp(&self->cfg.format, &vdef_i420))
+		fmt = " C420";
+	else if (vdef_raw_format_cmp(&self->cfg.format, &vdef_i420_10_16le))
+		fmt = " C420p10";
+
+	res = snprintf(str,
+		       sizeof(str),
+		       "YUV4MPEG2 W%d H%d F%d:%d Ip A%d:%d%s\n",
+		       self->cfg.info.resolution.width,
+		       self->cfg.info.resolution.height,
+		       self->cfg.info.framerate.num,
+		       self->cfg.info.framerate.den,
+		       self->cfg.info.sar.width,
+		       self->cfg.info.sar.height,
+		       fmt);
+	if ((res < 0) || ((size_t)res >= sizeof(str))) {
+		res = -EOVERFLOW;
+		ULOG_ERRNO("snprintf", -res);
+		return res;
+	}
+
+	return vraw_writer_buf_write(self, str, res);
+}
+
+
+int vraw_writer_file_open(const char *filename, bool direct)
+{
+	int fd, res, flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+	fd = open(filename, flags | (direct ? O_DIRECT : 0), 0666);
+	if (direct && (fd < 0) && (errno == EINVAL)) {
+		/* Not supported by the filesystem (e.g. tmpfs) */
+		ULOGW("O_DIRECT not supported for '%s', "
+		      "using buffered writes",
+		      filename);
+		fd = open(filename, flags, 0666);
+	}
+	if (fd < 0) {
+		res = -errno;
+		ULOG_ERRNO("open:'%s'", -res, filename);
+		return res;
+	}
+
+	return fd;
+}
+
+
+/* Write the manifest to the file, and open the plane files */
+static int split_setup(struct vraw_writer *self)
+{
+	int res;
+	char *filename = NULL;
+	uint8_t manifest[vraw_split_manifest_size(VDEF_RAW_MAX_PLANE_COUNT)];
+	size_t size = vraw_split_manifest_size(self->plane_count);
+
+	memcpy(manifest, VRAW_SPLIT_MAGIC, VRAW_SPLIT_MAGIC_SIZE);
+	vraw_le_put_u32(manifest + VRAW_SPLIT_OFFSET_VERSION,
+			VRAW_SPLIT_VERSION);
+	vraw_le_put_u32(manifest + VRAW_SPLIT_OFFSET_PLANE_COUNT,
+			self->plane_count);
+	vraw_le_put_u32(manifest + VRAW_SPLIT_OFFSET_WIDTH,
+			self->cfg.info.resolution.width);
+	vraw_le_put_u32(manifest + VRAW_SPLIT_OFFSET_HEIGHT,
+			self->cfg.info.resolution.height);
+	for (unsigned int p = 0; p < self->plane_count; p++) {
+		vraw_le_put_u64(manifest + VRAW_SPLIT_HEADER_SIZE +
+					p * VRAW_SPLIT_ENTRY_SIZE,
+				self->plane_line_width[p] *
+					self->plane_lines[p]);
+	}
+	res = vraw_writer_buf_write(self, manifest, size);
+	if (res < 0)
+		return res;
+
+	for (unsigned int p = 0; p < self->plane_count; p++) {
+		if (asprintf(&filename,
+			     "%s" VRAW_SPLIT_SUFFIX_FMT,
+			     self->filename,
+			     p) < 0)
+			return -ENOMEM;
+		res = vraw_writer_file_open(filename, false);
+		free(filename);
+		if (res < 0)
+			return res;
+		self->split_fd[p] = res;
+	}
+
+	return 0;
+}
+
+
+static int stdio_buffer_setup(struct vraw_writer *self)
+{
+	int res;
+
+	if (self->cfg.buffer_size > 0) {
+		/* Note: the buffer must outlive the file, it is freed
+		 * after fclose() */
+		self->buffer = malloc(self->cfg.buffer_size);
+		if (self->buffer == NULL)
+			return -ENOMEM;
+		res = setvbuf(self->file,
+			      self->buffer,
+			      _IOFBF,
+			      self->cfg.buffer_size);
+		if (res != 0) {
+			res = -EINVAL;
+			ULOG_ERRNO("setvbuf", -res);
+			return res;
+		}
+	}
+
+	return 0;
+}
+
+
+int vraw_writer_stdio_attach(struct vraw_writer *self, int fd)
+{
+	int res;
+
+	self->file = fdopen(fd, "wb");
+	if (self->file == NULL) {
+		res = -errno;
+		ULOG_ERRNO("fdopen", -res);
+		close(fd);
+		return res;
+	}
+
+	return stdio_buffer_setup(self);
+}
+
+
+static ssize_t sink_cookie_write(void *cookie, const char *buf, size_t size)
+{
+	int res;
+	struct vraw_writer *self = cookie;
+
+	res = self->sink.write(self, buf, size, self->sink.userdata);
+	if (res < 0) {
+		/* Note: errors are reported by returning 0 */
+		errno = -res;
+		return 0;
+	}
+
+	return size;
+}
+
+
+static int sink_attach(struct vraw_writer *self)
+{
+	int res;
+	cookie_io_functions_t funcs = {
+		.write = &sink_cookie_write,
+	};
+
+	/* The sink is wrapped in a stdio stream to reuse the stdio
+	 * buffering and write paths */
+	self->file = fopencookie(self, "wb", funcs);
+	if (self->file == NULL) {
+		res = -errno;
+		ULOG_ERRNO("fopencookie", -res);
+		return res;
+	}
+
+	return stdio_buffer_setup(self);
+}
+
+
+static bool conv_format_is_supported(const struct vdef_raw_format *format)
+{
+	return (format->pix_layout == VDEF_RAW_PIX_LAYOUT_LINEAR) &&
+	       ((format->pix_order == VDEF_RAW_PIX_ORDER_YUV) ||
+		(format->pix_order == VDEF_RAW_PIX_ORDER_YVU)) &&
+	       ((format->data_layout == VDEF_RAW_DATA_LAYOUT_PLANAR_Y_U_V) ||
+		(format->data_layout ==
+		 VDEF_RAW_DATA_LAYOUT_SEMI_PLANAR_Y_UV)) &&
+	       ((format->data_size == 8) || (format->data_size == 16));
+}
+
+
+/* Conversions between planar and semi-planar YUV 4:2:0 formats, and
+ * between U/V orders, with the same samples */
+static bool conv_is_supported(const struct vdef_raw_format *in,
+			      const struct vdef_raw_format *out)
+{
+	return conv_format_is_supported(in) && conv_format_is_supported(out) &&
+	       (in->pix_size == out->pix_size) &&
+	       (in->data_size == out->data_size) &&
+	       (in->data_pad_low == out->data_pad_low) &&
+	       (in->data_little_endian == out->data_little_endian);
+}
+
+
+static int conv_setup(struct vraw_writer *self)
+{
+	self->conv = true;
+	self->conv_plane_count = (self->cfg.input_format.data_layout ==
+				  VDEF_RAW_DATA_LAYOUT_PLANAR_Y_U_V)
+					 ? 3
+					 : 2;
+	self->conv_sample_size = self->cfg.format.data_size / 8;
+	self->conv_count = self->plane_line_width[1] / self->conv_sample_size;
+	if (self->plane_count == 2)
+		self->conv_count /= 2;
+	self->conv_size = 0;
+	for (unsigned int p = 1; p < self->plane_count; p++) {
+		self->conv_size +=
+			self->plane_line_width[p] * self->plane_lines[p];
+	}
+
+	/* Note: the io_uring and compressed paths convert straight into
+	 * their packed frame buffers */
+	if ((self->cfg.backend == VRAW_WRITER_BACKEND_IO_URING) ||
+	    (self->cfg.compression != VRAW_COMPRESSION_NONE))
+		return 0;
+
+	self->conv_buf = malloc(self->conv_size);
+	if (self->conv_buf == NULL)
+		return -ENOMEM;
+
+	return 0;
+}
+
+
+/* Create a writer to a file (filename), to a file descriptor (fd, if not
+ * negative), or to a sink (if not NULL) */
+static int writer_new(const char *filename,
+		      int fd,
+		      const struct vraw_writer_sink *sink,
+		      const struct vraw_writer_config *config,
+		      struct vraw_writer **ret_obj)
+{
+	int res = 0;
+	struct vraw_writer *self = NULL;
+	size_t plane_stride[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+	size_t plane_scanline[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+	uint64_t expected;
+	bool segmented, stream = false, fifo = false;
+	struct stat st;
+
+	(void)pthread_once(&supported_formats_is_init,
+			   initialize_supported_formats);
+
+	ULOG_ERRNO_RETURN_ERR_IF(config == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(
+		!vdef_raw_format_intersect(&config->format,
+					   supported_formats,
+					   NB_SUPPORTED_FORMATS),
+		EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(
+		(config->input_format.data_layout !=
+		 VDEF_RAW_DATA_LAYOUT_UNKNOWN) &&
+			!vdef_raw_format_cmp(&config->input_format,
+					     &config->format) &&
+			!conv_is_supported(&config->input_format,
+					   &config->format),
+		EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config->info.resolution.width == 0, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config->info.resolution.height == 0, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(
+		vdef_raw_format_cmp(&config->format, &vdef_nv21_10_packed) &&
+			(config->info.resolution.width & 3),
+		EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config->backend > VRAW_WRITER_BACKEND_DIRECT,
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config->flush > VRAW_WRITER_FLUSH_ON_DESTROY,
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(
+		(config->flush == VRAW_WRITER_FLUSH_EVERY_N_FRAMES) &&
+			(config->flush_frames == 0),
+		EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(
+		(config->flush == VRAW_WRITER_FLUSH_EVERY_N_BYTES) &&
+			(config->flush_bytes == 0),
+		EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(
+		config->queue_full > VRAW_WRITER_QUEUE_FULL_DROP, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF((config->ring_slots > 0) && config->y4m,
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(
+		(config->ring_slots > 0) &&
+			(config->backend != VRAW_WRITER_BACKEND_STDIO) &&
+			(config->backend != VRAW_WRITER_BACKEND_PWRITEV),
+		EINVAL);
+	segmented = (config->segment_frames > 0) ||
+		    (config->segment_bytes > 0) ||
+		    (config->segment_duration_us > 0);
+	ULOG_ERRNO_RETURN_ERR_IF(segmented && (config->ring_slots > 0),
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(
+		(config->sync_bytes > 0) && (config->ring_slots > 0), EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config->timestamps &&
+					 ((filename == NULL) || segmented ||
+					  (config->ring_slots > 0)),
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(
+		config->split_planes &&
+			((filename == NULL) || config->y4m || segmented ||
+			 (config->ring_slots > 0) ||
+			 (config->compression != VRAW_COMPRESSION_NONE) ||
+			 (config->sync_bytes > 0) ||
+			 (config->sync_frames > 0) ||
+			 ((config->backend != VRAW_WRITER_BACKEND_STDIO) &&
+			  (config->backend != VRAW_WRITER_BACKEND_PWRITEV))),
+		EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(segmented && (filename == NULL), EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(
+		segmented && !vraw_writer_segment_pattern_is_valid(filename),
+		EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config->compression > VRAW_COMPRESSION_LZ4,
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(
+		(config->compression != VRAW_COMPRESSION_NONE) &&
+			(config->y4m || (config->ring_slots > 0) || segmented ||
+			 ((config->backend != VRAW_WRITER_BACKEND_STDIO) &&
+			  (config->backend != VRAW_WRITER_BACKEND_PWRITEV))),
+		EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(
+		(config->keyframe_interval > 1) &&
+			(config->compression == VRAW_COMPRESSION_NONE),
+		EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(
+		(filename == NULL) &&
+			(config->backend == VRAW_WRITER_BACKEND_DIRECT),
+		EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(ret_obj == NULL, EINVAL);
+
+	if (fd >= 0) {
+		if (fstat(fd, &st) < 0) {
+			res = -errno;
+			ULOG_ERRNO("fstat", -res);
+			return res;
+		}
+		stream = !S_ISREG(st.st_mode);
+#ifdef F_SETPIPE_SZ
+		fifo = S_ISFIFO(st.st_mode);
+#endif /* F_SETPIPE_SZ */
+		/* Positional writes and preallocation start at offset 0 */
+		ULOG_ERRNO_RETURN_ERR_IF(
+			!stream && (lseek(fd, 0, SEEK_CUR) != 0), EINVAL);
+	} else if (sink != NULL) {
+		stream = true;
+	}
+	ULOG_ERRNO_RETURN_ERR_IF(
+		stream && ((config->backend != VRAW_WRITER_BACKEND_STDIO) ||
+			   (config->ring_slots > 0) ||
+			   (config->compression != VRAW_COMPRESSION_NONE) ||
+			   (config->sync_bytes > 0) ||
+			   (config->sync_frames > 0)),
+		EINVAL);
+
+	self = calloc(1, sizeof(*self));
+	if (self == NULL)
+		return -ENOMEM;
+	self->fd = -1;
+	self->segment_job.fd = -1;
+	self->segment_job.next_fd = -1;
+	self->ts_fd = -1;
+	for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++)
+		self->split_fd[p] = -1;
+
+	self->cfg = *config;
+
+	/* Enforce the configuration */
+	if (vdef_frac_is_null(&self->cfg.info.framerate)) {
+		self->cfg.info.framerate.num = 30;
+		self->cfg.info.framerate.den = 1;
+	}
+	if (vdef_dim_is_null(&self->cfg.info.sar)) {
+		self->cfg.info.sar.width = 1;
+		self->cfg.info.sar.height = 1;
+	}
+	if ((self->cfg.backend == VRAW_WRITER_BACKEND_IO_URING) &&
+	    (self->cfg.uring_depth == 0))
+		self->cfg.uring_depth = DEFAULT_URING_DEPTH;
+	if ((self->cfg.ring_slots > 0) ||
+	    (self->cfg.compression != VRAW_COMPRESSION_NONE) ||
+	    self->cfg.split_planes) {
+		/* Frames are written at their slot offset, with their chunk
+		 * sizes, or to the plane files */
+		self->cfg.backend = VRAW_WRITER_BACKEND_PWRITEV;
+	}
+	if (self->cfg.backend == VRAW_WRITER_BACKEND_IO_URING) {
+		/* Note: each slot has at most one request in flight */
+		res = vraw_uring_new(self->cfg.uring_depth, &self->uring);
+		if ((res == -ENOSYS) || (res == -EPERM)) {
+			/* Not supported by the kernel or disabled */
+			ULOGW("io_uring is not available (%s), "
+			      "using pwritev",
+			      strerror(-res));
+			self->cfg.backend = VRAW_WRITER_BACKEND_PWRITEV;
+		} else if (res < 0) {
+			ULOG_ERRNO("vraw_uring_new", -res);
+			goto error;
+		}
+	}
+	self->ops = get_ops(&self->cfg);
+
+	/* Plane geometry in the file, as read back by the reader: a line
+	 * is a row of pixels, or a row of tiles for the tiled formats */
+	res = vdef_calc_raw_frame_size(&self->cfg.format,
+				       &self->cfg.info.resolution,
+				       plane_stride,
+				       NULL,
+				       plane_scanline,
+				       NULL,
+				       NULL,
+				       NULL);
+	if (res < 0) {
+		/* Unsupported, frame writes will fail */
+		ULOG_ERRNO("vdef_calc_raw_frame_size", -res);
+		self->plane_count = 0;
+		res = 0;
+	} else {
+		self->plane_count =
+			vdef_get_raw_frame_plane_count(&self->cfg.format);
+	}
+	for (unsigned int p = 0; p < self->plane_count; p++) {
+		self->plane_line_width[p] = plane_stride[p];
+		self->plane_lines[p] = plane_scanline[p];
+	}
+	self->frame_file_size = self->cfg.y4m ? Y4M_FRAME_HEADER_SIZE : 0;
+	for (unsigned int p = 0; p < self->plane_count; p++) {
+		self->frame_file_size +=
+			self->plane_line_width[p] * self->plane_lines[p];
+	}
+
+	if ((self->cfg.input_format.data_layout !=
+	     VDEF_RAW_DATA_LAYOUT_UNKNOWN) &&
+	    !vdef_raw_format_cmp(&self->cfg.input_format, &self->cfg.format)) {
+		res = conv_setup(self);
+		if (res < 0)
+			goto error;
+	}
+
+	if (segmented) {
+		self->pattern = strdup(filename);
+		if (self->pattern == NULL) {
+			res = -ENOMEM;
+			goto error;
+		}
+		self->filename = vraw_writer_segment_name(self, 0);
+	} else if (filename != NULL) {
+		self->filename = strdup(filename);
+	} else if (fd >= 0) {
+		/* Name used in the logs */
+		if (asprintf(&self->filename, "fd:%d", fd) < 0)
+			self->filename = NULL;
+	} else {
+		self->filename = strdup("sink");
+	}
+	if (self->filename == NULL) {
+		res = -ENOMEM;
+		goto error;
+	}
+
+	if (self->ops->setup != NULL) {
+		res = self->ops->setup(self);
+		if (res < 0)
+			goto error;
+	}
+
+	if (self->cfg.timestamps) {
+		res = ts_setup(self);
+		if (res < 0)
+			goto error;
+	}
+
+	if (self->cfg.backend == VRAW_WRITER_BACKEND_PWRITEV) {
+		/* One vector per row, plus the y4m frame header; or one
+		 * vector per compressed chunk, plus the chunk sizes */
+		self->iov_max = 1;
+		for (unsigned int p = 0; p < self->plane_count; p++)
+			self->iov_max += self->plane_lines[p];
+		if (self->iov_max < self->cmp_chunks + 1)
+			self->iov_max = self->cmp_chunks + 1;
+		/* Batches of frames are gathered up to IOV_MAX vectors */
+		self->iov_size =
+			(self->iov_max > IOV_MAX) ? self->iov_max : IOV_MAX;
+		self->iov = calloc(self->iov_size, sizeof(*self->iov));
+		if (self->iov == NULL) {
+			res = -ENOMEM;
+			goto error;
+		}
+	}
+
+	if (sink != NULL) {
+		self->sink = *sink;
+		res = sink_attach(self);
+		if (res < 0)
+			goto error;
+	} else {
+		if (fd >= 0) {
+			/* The caller keeps ownership of its file descriptor */
+			fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+			if (fd < 0) {
+				res = -errno;
+				ULOG_ERRNO("fcntl:F_DUPFD_CLOEXEC", -res);
+				goto error;
+			}
+		} else {
+			fd = vraw_writer_file_open(self->filename,
+				       self->cfg.backend ==
+					       VRAW_WRITER_BACKEND_DIRECT);
+			if (fd < 0) {
+				res = fd;
+				goto error;
+			}
+		}
+		if (fifo) {
+			self->fd = fd;
+			res = pipe_setup(self);
+			if (res < 0)
+				goto error;
+		} else if (self->cfg.backend == VRAW_WRITER_BACKEND_STDIO) {
+			res = vraw_writer_stdio_attach(self, fd);
+			if (res < 0)
+				goto error;
+		} else {
+			self->fd = fd;
+		}
+	}
+
+	if (segmented) {
+		expected = vraw_writer_segment_prealloc_size(self);
+		if (expected > 0) {
+			res = vraw_writer_prealloc(self, expected);
+			if (res < 0)
+				goto error;
+		}
+	} else if (!stream && !self->cfg.split_planes &&
+		   (self->cfg.ring_slots == 0) &&
+		   ((self->cfg.expected_frame_count > 0) ||
+		    (self->cfg.expected_bytes > 0))) {
+		expected = (uint64_t)self->cfg.expected_frame_count *
+			   self->frame_file_size;
+		if (self->cfg.y4m)
+			expected += Y4M_FILE_HEADER_MAX_SIZE;
+		if (expected < self->cfg.expected_bytes)
+			expected = self->cfg.expected_bytes;
+		res = vraw_writer_prealloc(self, expected);
+		if (res < 0)
+			goto error;
+	}
+
+	if (self->cfg.y4m) {
+		/* Write YUV4MPEG2 file headers */
+		res = vraw_writer_y4m_header_write(self);
+		if (res < 0)
+			goto error;
+	}
+	if (self->ops->start != NULL) {
+		res = self->ops->start(self);
+		if (res < 0)
+			goto error;
+	}
+
+	if (segmented) {
+		res = vraw_writer_segment_prepare(self);
+		if (res < 0)
+			goto error;
+	}
+
+	if (self->cfg.queue_depth > 0) {
+		res = async_setup(self);
+		if (res < 0)
+			goto error;
+	}
+
+	*ret_obj = self;
+	return 0;
+
+error:
+	(void)vraw_writer_destroy(self);
+	*ret_obj = NULL;
+	return res;
+}
+
+
+int vraw_writer_new(const char *filename,
+		    const struct vraw_writer_config *config,
+		    struct vraw_writer **ret_obj)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(filename == NULL, EINVAL);
+
+	return writer_new(filename, -1, NULL, config, ret_obj);
+}
+
+
+int vraw_writer_new_from_fd(int fd,
+			    const struct vraw_writer_config *config,
+			    struct vraw_writer **ret_obj)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(fd < 0, EINVAL);
+
+	return writer_new(NULL, fd, NULL, config, ret_obj);
+}
+
+
+int vraw_writer_new_sink(const struct vraw_writer_sink *sink,
+			 const struct vraw_writer_config *config,
+			 struct vraw_writer **ret_obj)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(sink == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(sink->write == NULL, EINVAL);
+
+	return writer_new(NULL, -1, sink, config, ret_obj);
+}
+
+
+int vraw_writer_flush(struct vraw_writer *self)
+{
+	int res;
+	uint64_t start;
+
+	self->pending_frames = 0;
+	self->pending_bytes = 0;
+
+	if (self->ts_buf != NULL) {
+		res = ts_flush(self);
+		if (res < 0)
+			return res;
+	}
+
+	/* Write the aligned part of the staging buffer */
+	if (self->staging != NULL) {
+		return direct_write(self,
+				    self->staging_len &
+					    ~(self->direct_align - 1));
+	}
+
+	if (self->pipe_buf != NULL)
+		return pipe_out(self);
+
+	/* Note: positional writes are not buffered in user space */
+	if (self->file == NULL)
+		return 0;
+
+	start = get_time_ns();
+	res = fflush(self->file);
+	self->stats.io_time_ns += get_time_ns() - start;
+	self->stats.io_calls++;
+	if (res < 0) {
+		res = -errno;
+		ULOG_ERRNO("fflush", -res);
+		return res;
+	}
+
+	if (self->sink.flush != NULL) {
+		res = self->sink.flush(self, self->sink.userdata);
+		if (res < 0) {
+			ULOG_ERRNO("sink flush", -res);
+			return res;
+		}
+	}
+
+	return 0;
+}
+
+
+int vraw_writer_sync_range(struct vraw_writer *self,
+			   uint64_t start,
+			   uint64_t end,
+			   bool wait)
+{
+	int res;
+	uint64_t t;
+
+	if (end <= start)
+		return 0;
+
+	t = get_time_ns();
+#ifdef SYNC_FILE_RANGE_WRITE
+	res = sync_file_range(get_fd(self),
+			      start,
+			      end - start,
+			      wait ? (SYNC_FILE_RANGE_WAIT_BEFORE |
+				      SYNC_FILE_RANGE_WRITE |
+				      SYNC_FILE_RANGE_WAIT_AFTER)
+				   : SYNC_FILE_RANGE_WRITE);
+#else /* SYNC_FILE_RANGE_WRITE */
+	/* Only the completion can be waited for */
+	res = wait ? fdatasync(get_fd(self)) : 0;
+#endif /* SYNC_FILE_RANGE_WRITE */
+	self->stats.io_time_ns += get_time_ns() - t;
+	self->stats.io_calls++;
+	if (res < 0) {
+		res = -errno;
+		ULOG_ERRNO("sync_file_range", -res);
+		return res;
+	}
+
+	if (wait && self->cfg.sync_drop_cache) {
+		/* The range is clean, drop it from the page cache */
+		res = posix_fadvise(get_fd(self),
+				    start,
+				    end - start,
+				    POSIX_FADV_DONTNEED);
+		if (res != 0) {
+			ULOG_ERRNO("posix_fadvise", res);
+			return -res;
+		}
+	}
+
+	return 0;
+}
+
+
+static int sync_apply(struct vraw_writer *self, unsigned int frames)
+{
+	int res;
+	uint64_t end, start;
+	bool datasync;
+
+	if ((self->cfg.sync_bytes == 0) && (self->cfg.sync_frames == 0))
+		return 0;
+
+	self->sync_pending_frames += frames;
+	datasync = (self->cfg.sync_frames > 0) &&
+		   (self->sync_pending_frames >= self->cfg.sync_frames);
+	if (!datasync &&
+	    ((self->cfg.sync_bytes == 0) ||
+	     (vraw_writer_get_data_end(self) - self->sync_start <
+	      self->cfg.sync_bytes)))
+		return 0;
+
+	/* Hand the buffered data over to the kernel; the unaligned tail of
+	 * the direct I/O staging buffer is not part of the file yet */
+	res = vraw_writer_flush(self);
+	if (res < 0)
+		return res;
+	end = (self->staging != NULL) ? (uint64_t)self->offset
+				      : vraw_writer_get_data_end(self);
+
+	if (datasync) {
+		start = get_time_ns();
+		res = fdatasync(get_fd(self));
+		self->stats.io_time_ns += get_time_ns() - start;
+		self->stats.io_calls++;
+		if (res < 0) {
+			res = -errno;
+			ULOG_ERRNO("fdatasync", -res);
+			return res;
+		}
+		self->sync_pending_frames = 0;
+		if (self->cfg.sync_drop_cache) {
+			res = posix_fadvise(
+				get_fd(self), 0, end, POSIX_FADV_DONTNEED);
+			if (res != 0) {
+				ULOG_ERRNO("posix_fadvise", res);
+				return -res;
+			}
+		}
+		self->sync_start = end;
+		self->sync_prev_start = end;
+		self->sync_prev_end = end;
+		return 0;
+	}
+
+	/* Wait for the writeback of the previous range, which has been
+	 * running while the current range was written, then start the
+	 * writeback of the current range: at most about twice sync_bytes
+	 * of dirty data are outstanding */
+	res = vraw_writer_sync_range(
+		self, self->sync_prev_start, self->sync_prev_end, true);
+	if (res < 0)
+		return res;
+	res = vraw_writer_sync_range(self, self->sync_start, end, false);
+	if (res < 0)
+		return res;
+	self->sync_prev_start = self->sync_start;
+	self->sync_prev_end = end;
+	self->sync_start = end;
+
+	return 0;
+}
+
+
+int vraw_writer_destroy(struct vraw_writer *self)
+{
+	int res = 0, err;
+
+	if (self == NULL)
+		return 0;
+
+	if (self->thread_launched) {
+		/* Let the writer thread drain the queue */
+		pthread_mutex_lock(&self->mutex);
+		self->stop = true;
+		pthread_cond_broadcast(&self->cond);
+		pthread_mutex_unlock(&self->mutex);
+		pthread_join(self->thread, NULL);
+	}
+	if (self->cond_created)
+		pthread_cond_destroy(&self->cond);
+	if (self->mutex_created)
+		pthread_mutex_destroy(&self->mutex);
+
+	vraw_writer_segment_cleanup(self);
+
+	if ((self->ops != NULL) && (self->ops->drain != NULL)) {
+		/* Wait for the frames in flight */
+		res = self->ops->drain(self);
+	}
+
+	if ((self->staging != NULL) && (self->fd >= 0)) {
+		res = vraw_writer_flush(self);
+		if (res == 0)
+			res = vraw_writer_direct_tail_write(self);
+	}
+
+	if (self->file != NULL) {
+		res = vraw_writer_flush(self);
+		if (res == 0)
+			res = prealloc_release(self);
+		if (fclose(self->file) < 0 && res == 0) {
+			res = -errno;
+			ULOG_ERRNO("fclose", -res);
+		}
+	}
+
+	if ((self->pipe_buf != NULL) && (self->fd >= 0)) {
+		res = vraw_writer_flush(self);
+		/* The pages handed to the pipe must not be unmapped before
+		 * the reader has consumed them */
+		if ((res == 0) && self->pipe_vmsplice)
+			res = pipe_wait(self, 0);
+	}
+
+	if ((self->ops != NULL) && (self->ops->finish != NULL) &&
+	    (self->fd >= 0)) {
+		err = self->ops->finish(self);
+		if (res == 0)
+			res = err;
+	}
+
+	if (self->fd >= 0) {
+		if (res == 0)
+			res = prealloc_release(self);
+		if ((close(self->fd) < 0) && (res >= 0)) {
+			res = -errno;
+			ULOG_ERRNO("close", -res);
+		}
+	}
+
+	for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++) {
+		if (self->split_fd[p] < 0)
+			continue;
+		if ((close(self->split_fd[p]) < 0) && (res >= 0)) {
+			res = -errno;
+			ULOG_ERRNO("close", -res);
+		}
+	}
+
+	if (self->ts_fd >= 0) {
+		err = (self->ts_buf != NULL) ? ts_flush(self) : 0;
+		if (res == 0)
+			res = err;
+		close(self->ts_fd);
+	}
+	free(self->ts_buf);
+
+	if ((self->ops != NULL) && (self->ops->cleanup != NULL))
+		self->ops->cleanup(self);
+	if (self->pipe_buf != NULL)
+		munmap(self->pipe_buf, 2 * self->pipe_size);
+	free(self->staging);
+	free(self->conv_buf);
+	free(self->queue);
+	free(self->iov);
+	free(self->buffer);
+	free(self->filename);
+	free(self->pattern);
+	free(self);
+	return res;
+}
+
+
+static int frame_write_stdio(struct vraw_writer *self,
+			     const struct vraw_frame *frame)
+{
+	int res;
+	uint64_t start;
+
+	start = get_time_ns();
+
+	if (self->cfg.y4m) {
+		/* Write YUV4MPEG2 frame header */
+		res = vraw_writer_buf_write(
+			self, Y4M_FRAME_HEADER, Y4M_FRAME_HEADER_SIZE);
+		if (res < 0)
+			goto out;
+	}
+
+	/* Write raw data to file */
+	res = frame_data_write(self, frame);
+	if (res == 0)
+		self->stats.frames++;
+
+out:
+	self->stats.copy_time_ns += get_time_ns() - start;
+	return res;
+}
+
+
+static int frame_write_direct(struct vraw_writer *self,
+			      const struct vraw_frame *frame)
+{
+	int res = 0;
+	uint64_t start;
+
+	/* Pack the data into the staging buffer; the buffer is written
+	 * whenever it is full, and on flush */
+	start = get_time_ns();
+	if (self->cfg.y4m) {
+		res = direct_append(
+			self, Y4M_FRAME_HEADER, Y4M_FRAME_HEADER_SIZE);
+		if (res < 0)
+			goto out;
+	}
+	res = frame_data_write(self, frame);
+	if (res == 0)
+		self->stats.frames++;
+
+out:
+	self->stats.copy_time_ns += get_time_ns() - start;
+	return res;
+}
+
+
+static void iov_append(struct vraw_writer *self,
+		       int *iovcnt,
+		       const uint8_t *ptr,
+		       size_t len)
+{
+	struct iovec *prev = (*iovcnt > 0) ? &self->iov[*iovcnt - 1] : NULL;
+
+	/* Contiguous data is merged into the previous vector */
+	if ((prev != NULL) &&
+	    ((uint8_t *)prev->iov_base + prev->iov_len == ptr)) {
+		prev->iov_len += len;
+	} else {
+		self->iov[*iovcnt].iov_base = (void *)ptr;
+		self->iov[*iovcnt].iov_len = len;
+		(*iovcnt)++;
+	}
+}
+
+
+void vraw_writer_frame_iov_fill(struct vraw_writer *self,
+				const struct vraw_frame *frame,
+				int *iovcnt)
+{
+	size_t len;
+	const uint8_t *ptr;
+
+	/* Build the list of rows straight from the caller's buffers, with
+	 * a single vector for a contiguous frame or plane */
+	if (self->cfg.y4m) {
+		iov_append(self,
+			   iovcnt,
+			   (const uint8_t *)Y4M_FRAME_HEADER,
+			   Y4M_FRAME_HEADER_SIZE);
+	}
+	len = frame_contiguous_size(self, frame);
+	if (len > 0) {
+		iov_append(self, iovcnt, frame->cdata[0], len);
+		return;
+	}
+	for (unsigned int p = 0; p < self->plane_count; p++) {
+		if ((p == 1) && frame_needs_conv(self, frame)) {
+			/* Converted chroma planes */
+			conv_chroma(self, frame, self->conv_buf);
+			iov_append(
+				self, iovcnt, self->conv_buf, self->conv_size);
+			break;
+		}
+		ptr = frame->cdata[p];
+		len = plane_contiguous_size(self, frame, p);
+		if (len > 0) {
+			iov_append(self, iovcnt, ptr, len);
+			continue;
+		}
+		for (unsigned int i = 0; i < self->plane_lines[p]; i++) {
+			iov_append(
+				self, iovcnt, ptr, self->plane_line_width[p]);
+			ptr += frame->frame.plane_stride[p];
+		}
+	}
+}
+
+
+static int frame_write_vectored(struct vraw_writer *self,
+				const struct vraw_frame *frame)
+{
+	int res, iovcnt = 0;
+
+	vraw_writer_frame_iov_fill(self, frame, &iovcnt);
+
+	res = vraw_writer_pwritev(self, self->iov, iovcnt);
+	if (res == 0)
+		self->stats.frames++;
+
+	return res;
+}
+
+
+static int frames_write_vectored(struct vraw_writer *self,
+				 const struct vraw_frame *frames,
+				 unsigned int count)
+{
+	int res, iovcnt = 0;
+	bool conv, conv_used = false;
+
+	for (unsigned int i = 0; i < count; i++) {
+		/* Write the gathered frames when the next one may not fit,
+		 * or before the conversion buffer is reused */
+		conv = frame_needs_conv(self, &frames[i]);
+		if ((iovcnt + self->iov_max > self->iov_size) ||
+		    (conv && conv_used)) {
+			res = vraw_writer_pwritev(self, self->iov, iovcnt);
+			if (res < 0)
+				return res;
+			iovcnt = 0;
+			conv_used = false;
+		}
+		vraw_writer_frame_iov_fill(self, &frames[i], &iovcnt);
+		conv_used = conv_used || conv;
+	}
+
+	res = vraw_writer_pwritev(self, self->iov, iovcnt);
+	if (res == 0)
+		self->stats.frames += count;
+
+	return res;
+}
+
+
+/* Write each plane to its own file; the converted chroma planes follow
+ * each other in the conversion buffer */
+static int frame_write_split(struct vraw_writer *self,
+			     const struct vraw_frame *frame)
+{
+	int res, iovcnt;
+	size_t len, conv_offset = 0;
+	const uint8_t *ptr;
+	bool conv = frame_needs_conv(self, frame);
+
+	if (conv)
+		conv_chroma(self, frame, self->conv_buf);
+
+	for (unsigned int p = 0; p < self->plane_count; p++) {
+		iovcnt = 0;
+		ptr = frame->cdata[p];
+		if ((p > 0) && conv) {
+			ptr = self->conv_buf + conv_offset;
+			len = self->plane_line_width[p] * self->plane_lines[p];
+			conv_offset += len;
+		} else {
+			len = plane_contiguous_size(self, frame, p);
+		}
+		if (len > 0) {
+			iov_append(self, &iovcnt, ptr, len);
+		} else {
+			for (unsigned int i = 0; i < self->plane_lines[p];
+			     i++) {
+				iov_append(self,
+					   &iovcnt,
+					   ptr,
+					   self->plane_line_width[p]);
+				ptr += frame->frame.plane_stride[p];
+			}
+		}
+		res = pwritev_fd(self,
+				 self->split_fd[p],
+				 &self->split_offset[p],
+				 self->iov,
+				 iovcnt);
+		if (res < 0)
+			return res;
+	}
+	self->stats.frames++;
+
+	return 0;
+}
+
+
+static int frames_write_each(struct vraw_writer *self,
+			     const struct vraw_frame *frames,
+			     unsigned int count)
+{
+	int res = 0;
+
+	for (unsigned int i = 0; (i < count) && (res == 0); i++)
+		res = self->ops->frame_write(self, &frames[i]);
+
+	return res;
+}
+
+
+static const struct vraw_writer_ops stdio_ops = {
+	.frame_write = &frame_write_stdio,
+	.frames_write = &frames_write_each,
+};
+
+
+static const struct vraw_writer_ops direct_ops = {
+	.setup = &direct_setup,
+	.frame_write = &frame_write_direct,
+	.frames_write = &frames_write_each,
+};
+
+
+static const struct vraw_writer_ops vectored_ops = {
+	.frame_write = &frame_write_vectored,
+	.frames_write = &frames_write_vectored,
+};
+
+
+/* Frames are written one by one to the plane files */
+static const struct vraw_writer_ops split_ops = {
+	.start = &split_setup,
+	.frame_write = &frame_write_split,
+};
+
+
+static const struct vraw_writer_ops *
+get_ops(const struct vraw_writer_config *config)
+{
+	if (config->ring_slots > 0)
+		return &vraw_writer_ring_ops;
+	if (config->compression != VRAW_COMPRESSION_NONE)
+		return &vraw_writer_cmp_ops;
+	if (config->split_planes)
+		return &split_ops;
+
+	switch (config->backend) {
+	case VRAW_WRITER_BACKEND_PWRITEV:
+		return &vectored_ops;
+	case VRAW_WRITER_BACKEND_IO_URING:
+		return &vraw_writer_uring_ops;
+	case VRAW_WRITER_BACKEND_DIRECT:
+		return &direct_ops;
+	case VRAW_WRITER_BACKEND_STDIO:
+	default:
+		return &stdio_ops;
+	}
+}
+
+
+static void latency_update(struct vraw_writer *self, uint64_t start)
+{
+	uint64_t latency = get_time_ns() - start;
+
+	if (latency > self->stats.max_write_latency_ns)
+		self->stats.max_write_latency_ns = latency;
+}
+
+
+static int flush_policy_apply(struct vraw_writer *self)
+{
+	bool flush;
+
+	switch (self->cfg.flush) {
+	case VRAW_WRITER_FLUSH_EVERY_N_FRAMES:
+		flush = (self->pending_frames >= self->cfg.flush_frames);
+		break;
+	case VRAW_WRITER_FLUSH_EVERY_N_BYTES:
+		flush = (self->pending_bytes >= self->cfg.flush_bytes);
+		break;
+	case VRAW_WRITER_FLUSH_ON_DESTROY:
+		flush = false;
+		break;
+	case VRAW_WRITER_FLUSH_EVERY_FRAME:
+	default:
+		flush = true;
+		break;
+	}
+
+	return flush ? vraw_writer_flush(self) : 0;
+}
+
+
+static int frame_write(struct vraw_writer *self,
+		       const struct vraw_frame *frame)
+{
+	int res = 0;
+	uint64_t bytes, start;
+
+	start = get_time_ns();
+
+	res = vraw_writer_segment_check(self, frame);
+	if (res < 0)
+		goto out;
+	if ((self->file == NULL) && (self->fd < 0)) {
+		/* Previous segment rotation failure */
+		res = -EPROTO;
+		ULOG_ERRNO("no file", -res);
+		goto out;
+	}
+
+	res = prealloc_ensure(self, 1);
+	if (res < 0)
+		goto out;
+
+	bytes = self->stats.bytes;
+
+	res = self->ops->frame_write(self, frame);
+	if (res < 0)
+		goto out;
+
+	res = ts_append(self, frame);
+	if (res < 0)
+		goto out;
+
+	self->pending_frames++;
+	self->pending_bytes += self->stats.bytes - bytes;
+
+	res = flush_policy_apply(self);
+	if (res == 0)
+		res = sync_apply(self, 1);
+
+out:
+	latency_update(self, start);
+	return res;
+}
+
+
+static int frames_write(struct vraw_writer *self,
+			const struct vraw_frame *frames,
+			unsigned int count)
+{
+	int res = 0;
+	uint64_t bytes, start;
+
+	if ((self->pattern != NULL) || (self->ops->frames_write == NULL)) {
+		/* Frames are written one by one at segment boundaries, or
+		 * when the mode does not write batches */
+		for (unsigned int i = 0; i < count; i++) {
+			res = frame_write(self, &frames[i]);
+			if (res < 0)
+				return res;
+		}
+		return 0;
+	}
+
+	start = get_time_ns();
+
+	res = prealloc_ensure(self, count);
+	if (res < 0)
+		goto out;
+
+	bytes = self->stats.bytes;
+
+	res = self->ops->frames_write(self, frames, count);
+	if (res < 0)
+		goto out;
+
+	for (unsigned int i = 0; (i < count) && (res == 0); i++)
+		res = ts_append(self, &frames[i]);
+	if (res < 0)
+		goto out;
+
+	/* The flush and durability policies are applied once for the
+	 * whole batch */
+	self->pending_frames += count;
+	self->pending_bytes += self->stats.bytes - bytes;
+
+	res = flush_policy_apply(self);
+	if (res == 0)
+		res = sync_apply(self, count);
+
+out:
+	latency_update(self, start);
+	return res;
+}
+
+
+/* Positional write at *offset, without any shared state other than the
+ * atomic counters */
+static int pwritev_at(struct vraw_writer *self,
+		      struct iovec *iov,
+		      int iovcnt,
+		      off_t *offset)
+{
+	int res;
+	ssize_t res1;
+	uint64_t start;
+
+	while (iovcnt > 0) {
+		start = get_time_ns();
+		res1 = pwritev(self->fd, iov, iovcnt, *offset);
+		__atomic_fetch_add(&self->at_io_time_ns,
+				   get_time_ns() - start,
+				   __ATOMIC_RELAXED);
+		__atomic_fetch_add(&self->at_io_calls, 1, __ATOMIC_RELAXED);
+		if (res1 < 0) {
+			if (errno == EINTR)
+				continue;
+			res = -errno;
+			ULOG_ERRNO("pwritev", -res);
+			return res;
+		} else if (res1 == 0) {
+			res = -EIO;
+			ULOG_ERRNO("pwritev", -res);
+			return res;
+		}
+		*offset += res1;
+		__atomic_fetch_add(&self->at_bytes, res1, __ATOMIC_RELAXED);
+
+		while ((iovcnt > 0) && ((size_t)res1 >= iov->iov_len)) {
+			res1 -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (res1 > 0) {
+			iov->iov_base = (uint8_t *)iov->iov_base + res1;
+			iov->iov_len -= res1;
+		}
+	}
+
+	return 0;
+}
+
+
+static int frame_write_at(struct vraw_writer *self,
+			  const struct vraw_frame *frame,
+			  off_t offset)
+{
+	int res, iovcnt = 0;
+	struct iovec iov[WRITE_AT_IOV_MAX];
+	size_t len, width;
+	unsigned int lines;
+	const uint8_t *ptr;
+
+	/* The vectors are on the stack, the rows being written in groups
+	 * of WRITE_AT_IOV_MAX */
+	len = frame_contiguous_size(self, frame);
+	if (len > 0) {
+		iov[0].iov_base = (void *)frame->cdata[0];
+		iov[0].iov_len = len;
+		return pwritev_at(self, iov, 1, &offset);
+	}
+	for (unsigned int p = 0; p < self->plane_count; p++) {
+		ptr = frame->cdata[p];
+		len = plane_contiguous_size(self, frame, p);
+		lines = (len > 0) ? 1 : self->plane_lines[p];
+		width = (len > 0) ? len : self->plane_line_width[p];
+		for (unsigned int i = 0; i < lines; i++) {
+			if (iovcnt == WRITE_AT_IOV_MAX) {
+				res = pwritev_at(self, iov, iovcnt, &offset);
+				if (res < 0)
+					return res;
+				iovcnt = 0;
+			}
+			iov[iovcnt].iov_base = (void *)ptr;
+			iov[iovcnt].iov_len = width;
+			iovcnt++;
+			ptr += frame->frame.plane_stride[p];
+		}
+	}
+
+	return pwritev_at(self, iov, iovcnt, &offset);
+}
+
+
+static void atomic_max(uint64_t *ptr, uint64_t value)
+{
+	uint64_t cur = __atomic_load_n(ptr, __ATOMIC_RELAXED);
+
+	while ((value > cur) &&
+	       !__atomic_compare_exchange_n(ptr,
+					    &cur,
+					    value,
+					    true,
+					    __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED))
+		;
+}
+
+
+static int frame_check(struct vraw_writer *self,
+		       const struct vraw_frame *frame)
+{
+	int res;
+	unsigned int plane_count = self->plane_count;
+	bool conv = frame_needs_conv(self, frame);
+
+	if (conv) {
+		ULOG_ERRNO_RETURN_ERR_IF(
+			!vdef_raw_format_cmp(&frame->frame.format,
+					     &self->cfg.input_format),
+			EINVAL);
+		plane_count = self->conv_plane_count;
+	} else {
+		ULOG_ERRNO_RETURN_ERR_IF(
+			!vdef_raw_format_cmp(&frame->frame.format,
+					     &self->cfg.format),
+			EINVAL);
+	}
+	ULOG_ERRNO_RETURN_ERR_IF((frame->frame.info.resolution.width != 0) &&
+					 (frame->frame.info.resolution.width !=
+					  self->cfg.info.resolution.width),
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF((frame->frame.info.resolution.height != 0) &&
+					 (frame->frame.info.resolution.height !=
+					  self->cfg.info.resolution.height),
+				 EINVAL);
+	/* Note: in asynchronous mode, the file is owned by the writer
+	 * thread (segment rotation) and checked in frame_write() */
+	ULOG_ERRNO_RETURN_ERR_IF((self->cfg.queue_depth == 0) &&
+					 (self->file == NULL) && (self->fd < 0),
+				 EPROTO);
+
+	if (self->plane_count == 0) {
+		res = -ENOSYS;
+		ULOG_ERRNO("unsupported format: " VDEF_RAW_FORMAT_TO_STR_FMT,
+			   -res,
+			   VDEF_RAW_FORMAT_TO_STR_ARG(&self->cfg.format));
+		return res;
+	}
+	for (unsigned int p = 0; p < plane_count; p++) {
+		/* The input chroma rows of converted frames hold both
+		 * components when semi-planar, one when planar */
+		size_t width = self->plane_line_width[p];
+		if (conv && (p > 0)) {
+			width = self->conv_count * self->conv_sample_size;
+			if (plane_count == 2)
+				width *= 2;
+		}
+		ULOG_ERRNO_RETURN_ERR_IF(frame->cdata[p] == NULL, EINVAL);
+		ULOG_ERRNO_RETURN_ERR_IF(frame->frame.plane_stride[p] == 0,
+					 EINVAL);
+		ULOG_ERRNO_RETURN_ERR_IF(frame->frame.plane_stride[p] < width,
+					 EINVAL);
+	}
+
+	return 0;
+}
+
+
+int vraw_writer_frame_write(struct vraw_writer *self,
+			    const struct vraw_frame *frame)
+{
+	int res;
+
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(frame == NULL, EINVAL);
+
+	res = frame_check(self, frame);
+	if (res < 0)
+		return res;
+
+	if (self->cfg.queue_depth > 0)
+		return async_frames_queue(self, frame, 1);
+
+	return frame_write(self, frame);
+}
+
+
+int vraw_writer_frames_write(struct vraw_writer *self,
+			     const struct vraw_frame *frames,
+			     unsigned int count)
+{
+	int res;
+
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(frames == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(count == 0, EINVAL);
+
+	/* Nothing is written unless all the frames are valid */
+	for (unsigned int i = 0; i < count; i++) {
+		res = frame_check(self, &frames[i]);
+		if (res < 0)
+			return res;
+	}
+
+	if (self->cfg.queue_depth > 0)
+		return async_frames_queue(self, frames, count);
+
+	return frames_write(self, frames, count);
+}
+
+
+int vraw_writer_frame_write_at(struct vraw_writer *self,
+			       uint64_t index,
+			       const struct vraw_frame *frame)
+{
+	int res;
+	uint64_t start;
+	off_t offset;
+	uint8_t entry[VRAW_TS_ENTRY_SIZE];
+
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(frame == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(
+		(self->cfg.backend != VRAW_WRITER_BACKEND_PWRITEV) ||
+			self->cfg.y4m || (self->cfg.ring_slots > 0) ||
+			(self->cmp_src != NULL) || (self->pattern != NULL) ||
+			self->cfg.split_planes || (self->cfg.queue_depth > 0),
+		EPROTO);
+
+	res = frame_check(self, frame);
+	if (res < 0)
+		return res;
+	/* Note: the conversion buffer is shared */
+	ULOG_ERRNO_RETURN_ERR_IF(frame_needs_conv(self, frame), EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(
+		index >= (uint64_t)INT64_MAX / self->frame_file_size, EINVAL);
+
+	start = get_time_ns();
+	offset = (off_t)(index * self->frame_file_size);
+	res = frame_write_at(self, frame, offset);
+	if ((res == 0) && (self->ts_buf != NULL)) {
+		/* The entry is written at its position right away */
+		ts_entry_fill(entry, frame);
+		res = ts_write(self, entry, 1, index);
+	}
+	if (res == 0) {
+		__atomic_fetch_add(&self->at_frames, 1, __ATOMIC_RELAXED);
+		atomic_max(&self->at_end, offset + self->frame_file_size);
+	}
+	atomic_max(&self->at_max_latency_ns, get_time_ns() - start);
+
+	return res;
+}
+
+
+int vraw_writer_frame_submit(struct vraw_writer *self,
+			     const struct vraw_frame *frame)
+{
+	int res;
+
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(frame == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(
+		self->cfg.backend != VRAW_WRITER_BACKEND_IO_URING, EPROTO);
+	ULOG_ERRNO_RETURN_ERR_IF(self->cfg.queue_depth > 0, EPROTO);
+
+	res = frame_check(self, frame);
+	if (res < 0)
+		return res;
+
+	/* Note: the frame must not be accounted in the segment if it is
+	 * not submitted */
+	if (self->inflight == self->cfg.uring_depth)
+		return -EAGAIN;
+
+	res = vraw_writer_segment_check(self, frame);
+	if (res < 0)
+		return res;
+
+	res = prealloc_ensure(self, 1);
+	if (res < 0)
+		return res;
+
+	res = vraw_writer_uring_frame_submit(self, frame);
+	if (res < 0)
+		return res;
+
+	return ts_append(self, frame);
+}
+
+
+int vraw_writer_frame_complete(struct vraw_writer *self,
+			       unsigned int min_count)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(
+		self->cfg.backend != VRAW_WRITER_BACKEND_IO_URING, EPROTO);
+	ULOG_ERRNO_RETURN_ERR_IF(self->cfg.queue_depth > 0, EPROTO);
+
+	return vraw_writer_uring_complete(self, min_count);
+}
+
+
+int vraw_writer_get_stats(struct vraw_writer *self,
+			  struct vraw_writer_stats *stats)
+{
+	uint64_t latency;
+
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(stats == NULL, EINVAL);
+
+	if (self->cfg.queue_depth == 0) {
+		*stats = self->stats;
+		/* Add the frames written at their slot */
+		stats->frames +=
+			__atomic_load_n(&self->at_frames, __ATOMIC_RELAXED);
+		stats->bytes +=
+			__atomic_load_n(&self->at_bytes, __ATOMIC_RELAXED);
+		stats->io_calls +=
+			__atomic_load_n(&self->at_io_calls, __ATOMIC_RELAXED);
+		stats->io_time_ns += __atomic_load_n(&self->at_io_time_ns,
+						     __ATOMIC_RELAXED);
+		latency = __atomic_load_n(&self->at_max_latency_ns,
+					  __ATOMIC_RELAXED);
+		if (latency > stats->max_write_latency_ns)
+			stats->max_write_latency_ns = latency;
+		return 0;
+	}
+
+	pthread_mutex_lock(&self->mutex);
+	*stats = self->async_stats;
+	stats->queue_depth = self->queue_count;
+	pthread_mutex_unlock(&self->mutex);
+
+	return 0;
 }
@@ -0,0 +1,389 @@
+/**
+ * Copyright (c) 2018 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ANDROID
+#	ifndef _FILE_OFFSET_BITS
+#		define _FILE_OFFSET_BITS 64
+#	endif /* _FILE_OFFSET_BITS */
+#endif /* ANDROID */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vraw_cmp.h"
+#include "vraw_delta.h"
+#include "vraw_writer_priv.h"
+
+#define ULOG_TAG vraw
+#include <ulog.h>
+
+#include <lz4.h>
+
+
+static void cmp_chunk_compress(struct vraw_writer *self, unsigned int c)
+{
+	size_t offset = (size_t)c * self->cmp_chunk_size;
+	size_t len = self->frame_file_size - offset;
+	const uint8_t *src = self->cmp_src + offset;
+	int res;
+
+	if (len > self->cmp_chunk_size)
+		len = self->cmp_chunk_size;
+	if (self->cmp_delta) {
+		/* Unchanged samples become zeroes */
+		vraw_delta_xor(self->cmp_xor + offset,
+			       src,
+			       self->cmp_prev + offset,
+			       len);
+		src = self->cmp_xor + offset;
+	}
+	if (self->cmp_shuffle) {
+		vraw_cmp_shuffle16(self->cmp_scratch + offset, src, len);
+		src = self->cmp_scratch + offset;
+	}
+
+	/* Chunks that do not compress are stored */
+	res = LZ4_compress_fast_extState(
+		self->cmp_state + (size_t)c * self->cmp_state_size,
+		(const char *)src,
+		(char *)self->cmp_dst + offset,
+		(int)len,
+		(int)len,
+		1);
+	if ((res <= 0) || ((size_t)res >= len)) {
+		self->cmp_data[c] = src;
+		self->cmp_len[c] = len;
+		vraw_le_put_u32(self->cmp_prefix + 4 * c,
+				len | VRAW_CMP_CHUNK_STORED);
+	} else {
+		self->cmp_data[c] = self->cmp_dst + offset;
+		self->cmp_len[c] = res;
+		vraw_le_put_u32(self->cmp_prefix + 4 * c, res);
+	}
+}
+
+
+static void *cmp_thread(void *ptr)
+{
+	struct vraw_writer_cmp_worker *worker = ptr;
+	struct vraw_writer *self = worker->writer;
+	unsigned int gen = 0;
+
+	pthread_mutex_lock(&self->cmp_mutex);
+	while (true) {
+		while (!self->cmp_stop && (self->cmp_gen == gen))
+			pthread_cond_wait(&self->cmp_cond, &self->cmp_mutex);
+		if (self->cmp_stop)
+			break;
+		gen = self->cmp_gen;
+		pthread_mutex_unlock(&self->cmp_mutex);
+
+		cmp_chunk_compress(self, worker->chunk);
+
+		pthread_mutex_lock(&self->cmp_mutex);
+		self->cmp_pending--;
+		if (self->cmp_pending == 0)
+			pthread_cond_signal(&self->cmp_done_cond);
+	}
+	pthread_mutex_unlock(&self->cmp_mutex);
+
+	return NULL;
+}
+
+
+static int cmp_setup(struct vraw_writer *self)
+{
+	int res;
+	unsigned int threads = self->cfg.compression_threads;
+	size_t size;
+
+	if (self->frame_file_size == 0) {
+		/* Unsupported format, frame writes will fail */
+		return 0;
+	}
+
+	if (threads == 0)
+		threads = 1;
+	else if (threads > VRAW_CMP_MAX_CHUNKS)
+		threads = VRAW_CMP_MAX_CHUNKS;
+	size = (self->frame_file_size + threads - 1) / threads;
+	self->cmp_chunk_size = (size + 63) & ~(size_t)63;
+	if (self->cmp_chunk_size >= ((self->cfg.keyframe_interval > 1)
+					     ? VRAW_CMP_CHUNK_DELTA
+					     : VRAW_CMP_CHUNK_STORED) ||
+	    (self->cmp_chunk_size > LZ4_MAX_INPUT_SIZE))
+		return -EINVAL;
+	self->cmp_chunks = (self->frame_file_size + self->cmp_chunk_size - 1) /
+			   self->cmp_chunk_size;
+	self->cmp_shuffle = (self->cfg.format.data_size == 16);
+
+	/* Note: a chunk is stored when it is not smaller once compressed,
+	 * the compressed chunks thus fit in the frame size */
+	size = (size_t)self->cmp_chunks * self->cmp_chunk_size;
+	self->cmp_src = malloc(self->frame_file_size);
+	self->cmp_dst = malloc(size);
+	self->cmp_prefix = malloc(4 * self->cmp_chunks);
+	self->cmp_data = calloc(self->cmp_chunks, sizeof(*self->cmp_data));
+	self->cmp_len = calloc(self->cmp_chunks, sizeof(*self->cmp_len));
+	/* Note: the state size is a multiple of the pointer size, so that
+	 * all states are suitably aligned */
+	self->cmp_state_size = LZ4_sizeofState();
+	self->cmp_state = malloc(self->cmp_chunks * self->cmp_state_size);
+	if ((self->cmp_src == NULL) || (self->cmp_dst == NULL) ||
+	    (self->cmp_prefix == NULL) || (self->cmp_data == NULL) ||
+	    (self->cmp_len == NULL) || (self->cmp_state == NULL))
+		return -ENOMEM;
+	if (self->cmp_shuffle) {
+		self->cmp_scratch = malloc(size);
+		if (self->cmp_scratch == NULL)
+			return -ENOMEM;
+	}
+	if (self->cfg.keyframe_interval > 1) {
+		/* The previous frame is kept, packed */
+		self->cmp_prev = malloc(self->frame_file_size);
+		self->cmp_xor = malloc(self->frame_file_size);
+		if ((self->cmp_prev == NULL) || (self->cmp_xor == NULL))
+			return -ENOMEM;
+	}
+
+	if (self->cmp_chunks == 1)
+		return 0;
+
+	/* The first chunk is compressed by the calling thread */
+	res = pthread_mutex_init(&self->cmp_mutex, NULL);
+	if (res != 0)
+		return -res;
+	self->cmp_mutex_created = true;
+	res = pthread_cond_init(&self->cmp_cond, NULL);
+	if (res != 0)
+		return -res;
+	self->cmp_cond_created = true;
+	res = pthread_cond_init(&self->cmp_done_cond, NULL);
+	if (res != 0)
+		return -res;
+	self->cmp_done_cond_created = true;
+
+	self->cmp_workers =
+		calloc(self->cmp_chunks, sizeof(*self->cmp_workers));
+	if (self->cmp_workers == NULL)
+		return -ENOMEM;
+	for (unsigned int c = 1; c < self->cmp_chunks; c++) {
+		struct vraw_writer_cmp_worker *worker = &self->cmp_workers[c];
+		worker->writer = self;
+		worker->chunk = c;
+		res = pthread_create(&worker->thread, NULL, cmp_thread, worker);
+		if (res != 0) {
+			ULOG_ERRNO("pthread_create", res);
+			return -res;
+		}
+		worker->launched = true;
+	}
+
+	return 0;
+}
+
+
+static void cmp_teardown(struct vraw_writer *self)
+{
+	if (self->cmp_workers != NULL) {
+		pthread_mutex_lock(&self->cmp_mutex);
+		self->cmp_stop = true;
+		pthread_cond_broadcast(&self->cmp_cond);
+		pthread_mutex_unlock(&self->cmp_mutex);
+		for (unsigned int c = 1; c < self->cmp_chunks; c++) {
+			if (self->cmp_workers[c].launched)
+				pthread_join(self->cmp_workers[c].thread, NULL);
+		}
+		free(self->cmp_workers);
+	}
+	if (self->cmp_done_cond_created)
+		pthread_cond_destroy(&self->cmp_done_cond);
+	if (self->cmp_cond_created)
+		pthread_cond_destroy(&self->cmp_cond);
+	if (self->cmp_mutex_created)
+		pthread_mutex_destroy(&self->cmp_mutex);
+
+	free(self->cmp_src);
+	free(self->cmp_prev);
+	free(self->cmp_xor);
+	free(self->cmp_dst);
+	free(self->cmp_scratch);
+	free(self->cmp_state);
+	free(self->cmp_prefix);
+	free(self->cmp_data);
+	free(self->cmp_len);
+	free(self->cmp_table);
+}
+
+
+static int cmp_header_write(struct vraw_writer *self)
+{
+	uint8_t header[VRAW_CMP_HEADER_SIZE];
+
+	memcpy(header, VRAW_CMP_MAGIC, VRAW_CMP_MAGIC_SIZE);
+	vraw_le_put_u32(header + VRAW_CMP_OFFSET_VERSION, VRAW_CMP_VERSION);
+	vraw_le_put_u32(header + VRAW_CMP_OFFSET_CODEC, self->cfg.compression);
+	vraw_le_put_u32(header + VRAW_CMP_OFFSET_FLAGS,
+			(self->cmp_shuffle ? VRAW_CMP_FLAG_SHUFFLE16 : 0) |
+				((self->cmp_prev != NULL) ? VRAW_CMP_FLAG_DELTA
+							  : 0));
+	vraw_le_put_u32(header + VRAW_CMP_OFFSET_CHUNK_COUNT,
+			self->cmp_chunks);
+	vraw_le_put_u64(header + VRAW_CMP_OFFSET_FRAME_SIZE,
+			self->frame_file_size);
+	vraw_le_put_u64(header + VRAW_CMP_OFFSET_CHUNK_SIZE,
+			self->cmp_chunk_size);
+
+	return vraw_writer_buf_write(self, header, sizeof(header));
+}
+
+
+static int cmp_table_add(struct vraw_writer *self,
+			 uint64_t offset,
+			 uint64_t size,
+			 bool delta)
+{
+	size_t max;
+	uint8_t *table, *entry;
+
+	if (self->cmp_table_count == self->cmp_table_max) {
+		max = (self->cmp_table_max > 0) ? 2 * self->cmp_table_max
+						: 1024;
+		table = realloc(self->cmp_table, max * VRAW_CMP_ENTRY_SIZE);
+		if (table == NULL)
+			return -ENOMEM;
+		self->cmp_table = table;
+		self->cmp_table_max = max;
+	}
+
+	entry = self->cmp_table + self->cmp_table_count * VRAW_CMP_ENTRY_SIZE;
+	vraw_le_put_u64(entry, offset);
+	vraw_le_put_u64(entry + 8, delta ? size | VRAW_CMP_ENTRY_DELTA : size);
+	self->cmp_table_count++;
+
+	return 0;
+}
+
+
+static int cmp_table_write(struct vraw_writer *self)
+{
+	uint8_t footer[VRAW_CMP_FOOTER_SIZE];
+	struct iovec iov[2];
+
+	vraw_le_put_u64(footer, self->offset);
+	vraw_le_put_u64(footer + 8, self->cmp_table_count);
+	memcpy(footer + 16, VRAW_CMP_TABLE_MAGIC, VRAW_CMP_MAGIC_SIZE);
+
+	iov[0].iov_base = self->cmp_table;
+	iov[0].iov_len = self->cmp_table_count * VRAW_CMP_ENTRY_SIZE;
+	iov[1].iov_base = footer;
+	iov[1].iov_len = sizeof(footer);
+
+	return vraw_writer_pwritev(self, iov, 2);
+}
+
+
+static int frame_write_compressed(struct vraw_writer *self,
+				  const struct vraw_frame *frame)
+{
+	uint64_t start, offset;
+	int res;
+	uint8_t *tmp;
+
+	start = get_time_ns();
+
+	/* Pack the rows */
+	(void)vraw_writer_frame_pack(self, frame, self->cmp_src);
+
+	/* Keyframes are compressed on their own, the other frames relative
+	 * to the previous one */
+	self->cmp_delta = (self->cmp_prev != NULL) &&
+			  (self->cmp_table_count %
+				   self->cfg.keyframe_interval !=
+			   0);
+
+	/* Compress the chunks in parallel */
+	if (self->cmp_chunks > 1) {
+		pthread_mutex_lock(&self->cmp_mutex);
+		self->cmp_pending = self->cmp_chunks - 1;
+		self->cmp_gen++;
+		pthread_cond_broadcast(&self->cmp_cond);
+		pthread_mutex_unlock(&self->cmp_mutex);
+	}
+	cmp_chunk_compress(self, 0);
+	if (self->cmp_chunks > 1) {
+		pthread_mutex_lock(&self->cmp_mutex);
+		while (self->cmp_pending > 0)
+			pthread_cond_wait(&self->cmp_done_cond,
+					  &self->cmp_mutex);
+		pthread_mutex_unlock(&self->cmp_mutex);
+	}
+
+	self->stats.copy_time_ns += get_time_ns() - start;
+
+	if (self->cmp_delta) {
+		vraw_le_put_u32(self->cmp_prefix,
+				vraw_le_get_u32(self->cmp_prefix) |
+					VRAW_CMP_CHUNK_DELTA);
+	}
+
+	/* Write the chunk sizes and the chunks */
+	self->iov[0].iov_base = self->cmp_prefix;
+	self->iov[0].iov_len = 4 * self->cmp_chunks;
+	for (unsigned int c = 0; c < self->cmp_chunks; c++) {
+		self->iov[c + 1].iov_base = (void *)self->cmp_data[c];
+		self->iov[c + 1].iov_len = self->cmp_len[c];
+	}
+	offset = self->offset;
+	res = vraw_writer_pwritev(self, self->iov, self->cmp_chunks + 1);
+	if (res < 0)
+		return res;
+
+	if (self->cmp_prev != NULL) {
+		/* The frame is the reference for the next one */
+		tmp = self->cmp_prev;
+		self->cmp_prev = self->cmp_src;
+		self->cmp_src = tmp;
+	}
+
+	res = cmp_table_add(
+		self, offset, self->offset - offset, self->cmp_delta);
+	if (res == 0)
+		self->stats.frames++;
+
+	return res;
+}
+
+
+/* Frames are written one by one, with their own chunk sizes */
+const struct vraw_writer_ops vraw_writer_cmp_ops = {
+	.setup = &cmp_setup,
+	.start = &cmp_header_write,
+	.frame_write = &frame_write_compressed,
+	.finish = &cmp_table_write,
+	.cleanup = &cmp_teardown,
+};
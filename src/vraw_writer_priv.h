@@ -0,0 +1,376 @@
+/**
+ * Copyright (c) 2018 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _VRAW_WRITER_PRIV_H_
+#define _VRAW_WRITER_PRIV_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#include <video-raw/vraw.h>
+
+#include "vraw_uring.h"
+
+
+/* Y4M frame header */
+#define Y4M_FRAME_HEADER "FRAME\n"
+#define Y4M_FRAME_HEADER_SIZE (sizeof(Y4M_FRAME_HEADER) - 1)
+#define Y4M_FILE_HEADER_MAX_SIZE 100
+
+
+/* Writer mode operations; the mode is selected on creation from the
+ * configuration (backend, flight recorder, compression...) */
+struct vraw_writer_ops {
+	/* Allocate the mode resources, before the output is opened
+	 * (optional) */
+	int (*setup)(struct vraw_writer *self);
+
+	/* Write the file header, once the output is opened (optional) */
+	int (*start)(struct vraw_writer *self);
+
+	/* Write a frame; the written frames are accounted by the mode */
+	int (*frame_write)(struct vraw_writer *self,
+			   const struct vraw_frame *frame);
+
+	/* Write a batch of frames, the flush and durability policies
+	 * being applied once for the whole batch (optional, otherwise the
+	 * frames are written one by one) */
+	int (*frames_write)(struct vraw_writer *self,
+			    const struct vraw_frame *frames,
+			    unsigned int count);
+
+	/* Complete the writes in flight, before the file is switched or
+	 * closed (optional) */
+	int (*drain)(struct vraw_writer *self);
+
+	/* Complete the file, before it is closed (optional) */
+	int (*finish)(struct vraw_writer *self);
+
+	/* Free the mode resources (optional) */
+	void (*cleanup)(struct vraw_writer *self);
+};
+
+
+struct vraw_writer_slot {
+	uint8_t *buf;
+	bool busy;
+	size_t done;
+	off_t offset;
+};
+
+
+struct vraw_writer_cmp_worker {
+	struct vraw_writer *writer;
+	unsigned int chunk;
+	pthread_t thread;
+	bool launched;
+};
+
+
+struct vraw_writer_segment_job {
+	/* Previous segment file to close, truncated to size if truncate
+	 * is set */
+	FILE *file;
+	int fd;
+	char *buffer;
+	bool truncate;
+	uint64_t size;
+
+	/* Next segment file to create and preallocate */
+	char *filename;
+	bool direct;
+	uint64_t prealloc_size;
+	int next_fd;
+	uint64_t prealloc_end;
+	int res;
+};
+
+
+struct vraw_writer {
+	struct vraw_writer_config cfg;
+	const struct vraw_writer_ops *ops;
+	char *filename;
+	FILE *file;
+	int fd;
+	char *buffer;
+	off_t offset;
+	unsigned int plane_count;
+	size_t plane_line_width[VDEF_RAW_MAX_PLANE_COUNT];
+	unsigned int plane_lines[VDEF_RAW_MAX_PLANE_COUNT];
+	struct iovec *iov;
+	unsigned int iov_max;
+	unsigned int iov_size;
+	size_t frame_file_size;
+	struct vraw_uring *uring;
+	bool uring_fixed;
+	struct vraw_writer_slot *slots;
+	unsigned int inflight;
+	uint8_t *staging;
+	size_t staging_size;
+	size_t staging_len;
+	size_t direct_align;
+	uint64_t prealloc_end;
+	uint8_t *ring_trailer;
+	unsigned int ring_head;
+	unsigned int ring_count;
+	unsigned int pending_frames;
+	size_t pending_bytes;
+	unsigned int sync_pending_frames;
+	uint64_t sync_start;
+	uint64_t sync_prev_start;
+	uint64_t sync_prev_end;
+	struct vraw_writer_stats stats;
+
+	/* Frames written at their slot, from any thread (atomic) */
+	uint64_t at_end;
+	uint64_t at_frames;
+	uint64_t at_bytes;
+	uint64_t at_io_calls;
+	uint64_t at_io_time_ns;
+	uint64_t at_max_latency_ns;
+
+	/* Timestamp sidecar */
+	int ts_fd;
+	uint8_t *ts_buf;
+	unsigned int ts_len;
+	uint64_t ts_count;
+
+	/* Per-plane split storage */
+	int split_fd[VDEF_RAW_MAX_PLANE_COUNT];
+	off_t split_offset[VDEF_RAW_MAX_PLANE_COUNT];
+
+	/* Format conversion */
+	bool conv;
+	unsigned int conv_plane_count;
+	size_t conv_sample_size;
+	size_t conv_count;
+	uint8_t *conv_buf;
+	size_t conv_size;
+
+	/* Pipe and sink outputs */
+	uint8_t *pipe_buf;
+	size_t pipe_size;
+	size_t pipe_len;
+	size_t pipe_done;
+	unsigned int pipe_half;
+	bool pipe_vmsplice;
+	struct vraw_writer_sink sink;
+
+	/* Compression */
+	unsigned int cmp_chunks;
+	size_t cmp_chunk_size;
+	bool cmp_shuffle;
+	uint8_t *cmp_src;
+	uint8_t *cmp_prev;
+	uint8_t *cmp_xor;
+	bool cmp_delta;
+	uint8_t *cmp_dst;
+	uint8_t *cmp_scratch;
+	/* LZ4 compression state (hash table) of each chunk */
+	uint8_t *cmp_state;
+	size_t cmp_state_size;
+	uint8_t *cmp_prefix;
+	const uint8_t **cmp_data;
+	size_t *cmp_len;
+	uint8_t *cmp_table;
+	size_t cmp_table_count;
+	size_t cmp_table_max;
+	struct vraw_writer_cmp_worker *cmp_workers;
+	bool cmp_mutex_created;
+	bool cmp_cond_created;
+	bool cmp_done_cond_created;
+	pthread_mutex_t cmp_mutex;
+	pthread_cond_t cmp_cond;
+	pthread_cond_t cmp_done_cond;
+	unsigned int cmp_gen;
+	unsigned int cmp_pending;
+	bool cmp_stop;
+
+	/* Segmented recording */
+	char *pattern;
+	unsigned int segment_index;
+	unsigned int segment_frame_count;
+	uint64_t segment_bytes_start;
+	uint64_t segment_ts_start;
+	struct vraw_writer_segment_job segment_job;
+	pthread_t segment_thread;
+	bool segment_thread_launched;
+
+	/* Asynchronous mode */
+	pthread_t thread;
+	bool thread_launched;
+	bool mutex_created;
+	bool cond_created;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool stop;
+	struct vraw_frame *queue;
+	unsigned int queue_head;
+	unsigned int queue_count;
+	/* Protected by the mutex: snapshot of the thread statistics and
+	 * queue statistics */
+	struct vraw_writer_stats async_stats;
+};
+
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static inline uint64_t get_frame_ts_us(const struct vraw_frame *frame)
+{
+	unsigned int timescale = frame->frame.info.timescale;
+	uint64_t ts = frame->frame.info.timestamp;
+
+	if ((timescale != 0) && (timescale != 1000000))
+		ts = ts * 1000000 / timescale;
+	return ts;
+}
+
+
+/* Pack the frame data into a buffer, returns the end of the data */
+uint8_t *vraw_writer_frame_pack(struct vraw_writer *self,
+				const struct vraw_frame *frame,
+				uint8_t *dst);
+
+
+/* Open or create a file for writing, with O_DIRECT if direct is set
+ * and supported; returns the file descriptor */
+int vraw_writer_file_open(const char *filename, bool direct);
+
+
+/* Attach a stdio stream to the file descriptor, which is closed on
+ * failure */
+int vraw_writer_stdio_attach(struct vraw_writer *self, int fd);
+
+
+int vraw_writer_y4m_header_write(struct vraw_writer *self);
+
+
+/* Sequential write, through the stdio stream, the pipe buffer, the
+ * direct I/O staging buffer or a positional write */
+int vraw_writer_buf_write(struct vraw_writer *self,
+			  const void *buf,
+			  size_t len);
+
+
+/* Hand the buffered data over to the kernel */
+int vraw_writer_flush(struct vraw_writer *self);
+
+
+/* Write the unaligned tail of the direct I/O staging buffer */
+int vraw_writer_direct_tail_write(struct vraw_writer *self);
+
+
+/* Start the writeback of a file range, and wait for it if wait is set */
+int vraw_writer_sync_range(struct vraw_writer *self,
+			   uint64_t start,
+			   uint64_t end,
+			   bool wait);
+
+
+/* End of the data written to the current file */
+uint64_t vraw_writer_get_data_end(struct vraw_writer *self);
+
+
+/* Append the vectors of a frame to the list, at most iov_max */
+void vraw_writer_frame_iov_fill(struct vraw_writer *self,
+				const struct vraw_frame *frame,
+				int *iovcnt);
+
+
+/* Positional write of the vectors at the current offset */
+int vraw_writer_pwritev(struct vraw_writer *self,
+			struct iovec *iov,
+			int iovcnt);
+
+
+/* Preallocate the file space up to end, without changing the file size */
+int vraw_writer_prealloc(struct vraw_writer *self, uint64_t end);
+
+
+/* io_uring backend (see vraw_writer_uring.c) */
+extern const struct vraw_writer_ops vraw_writer_uring_ops;
+
+
+/* Submit a frame without waiting for its completion; returns -EAGAIN
+ * if all the slots are in flight */
+int vraw_writer_uring_frame_submit(struct vraw_writer *self,
+				   const struct vraw_frame *frame);
+
+
+/* Reap at least min_count completions (at most the number of frames in
+ * flight); returns the number of completions */
+int vraw_writer_uring_complete(struct vraw_writer *self,
+			       unsigned int min_count);
+
+
+/* Compressed storage (see vraw_writer_cmp.c) */
+extern const struct vraw_writer_ops vraw_writer_cmp_ops;
+
+
+/* Flight recorder ring (see vraw_writer_ring.c) */
+extern const struct vraw_writer_ops vraw_writer_ring_ops;
+
+
+/* Segmented recording (see vraw_writer_segment.c); the segments are
+ * written with the mode of the writer, the file being switched between
+ * frames */
+bool vraw_writer_segment_pattern_is_valid(const char *pattern);
+
+
+char *vraw_writer_segment_name(struct vraw_writer *self, unsigned int index);
+
+
+/* Size to preallocate for a segment file, 0 if unknown */
+uint64_t vraw_writer_segment_prealloc_size(struct vraw_writer *self);
+
+
+/* Create and preallocate the next segment file in the background */
+int vraw_writer_segment_prepare(struct vraw_writer *self);
+
+
+/* Switch to the next segment file if the frame would exceed one of the
+ * segment limits, and account the frame in the segment */
+int vraw_writer_segment_check(struct vraw_writer *self,
+			      const struct vraw_frame *frame);
+
+
+/* Close the previous segment file, and remove the unused next one */
+void vraw_writer_segment_cleanup(struct vraw_writer *self);
+
+
+#endif /* !_VRAW_WRITER_PRIV_H_ */
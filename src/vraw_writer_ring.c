@@ -0,0 +1,168 @@
+/**
+ * Copyright (c) 2018 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ANDROID
+#	ifndef _FILE_OFFSET_BITS
+#		define _FILE_OFFSET_BITS 64
+#	endif /* _FILE_OFFSET_BITS */
+#endif /* ANDROID */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vraw_ring.h"
+#include "vraw_writer_priv.h"
+
+#define ULOG_TAG vraw
+#include <ulog.h>
+
+
+/* Write a part of the ring trailer, from its position pos */
+static int ring_trailer_write(struct vraw_writer *self, size_t pos, size_t len)
+{
+	int res;
+	ssize_t res1;
+	size_t done = 0;
+	off_t offset;
+	uint64_t start;
+
+	offset = (off_t)self->cfg.ring_slots * self->frame_file_size + pos;
+	while (done < len) {
+		start = get_time_ns();
+		res1 = pwrite(self->fd,
+			      self->ring_trailer + pos + done,
+			      len - done,
+			      offset + done);
+		self->stats.io_time_ns += get_time_ns() - start;
+		self->stats.io_calls++;
+		if (res1 < 0) {
+			if (errno == EINTR)
+				continue;
+			res = -errno;
+			ULOG_ERRNO("pwrite", -res);
+			return res;
+		} else if (res1 == 0) {
+			res = -EIO;
+			ULOG_ERRNO("pwrite", -res);
+			return res;
+		}
+		done += res1;
+	}
+	self->stats.bytes += len;
+
+	return 0;
+}
+
+
+static int ring_setup(struct vraw_writer *self)
+{
+	int res;
+	size_t trailer_size;
+	uint64_t size;
+
+	trailer_size = vraw_ring_trailer_size(self->cfg.ring_slots);
+	self->ring_trailer = calloc(1, trailer_size);
+	if (self->ring_trailer == NULL)
+		return -ENOMEM;
+	memcpy(self->ring_trailer, VRAW_RING_MAGIC, VRAW_RING_MAGIC_SIZE);
+	vraw_le_put_u32(self->ring_trailer + VRAW_RING_OFFSET_VERSION,
+			VRAW_RING_VERSION);
+	vraw_le_put_u32(self->ring_trailer + VRAW_RING_OFFSET_SLOT_COUNT,
+			self->cfg.ring_slots);
+	vraw_le_put_u64(self->ring_trailer + VRAW_RING_OFFSET_SLOT_SIZE,
+			self->frame_file_size);
+
+	/* The file has its final size from the start, and all its blocks
+	 * are allocated so that no allocation happens while recording */
+	size = (uint64_t)self->cfg.ring_slots * self->frame_file_size +
+	       trailer_size;
+	if (ftruncate(self->fd, size) < 0) {
+		res = -errno;
+		ULOG_ERRNO("ftruncate", -res);
+		return res;
+	}
+	res = vraw_writer_prealloc(self, size);
+	if (res < 0)
+		return res;
+	/* Note: the file must not be truncated on destruction */
+	self->prealloc_end = 0;
+
+	return ring_trailer_write(self, 0, trailer_size);
+}
+
+
+static int frame_write_ring(struct vraw_writer *self,
+			    const struct vraw_frame *frame)
+{
+	int res, iovcnt = 0;
+	unsigned int head = self->ring_head;
+	size_t ts_pos = VRAW_RING_HEADER_SIZE + head * VRAW_RING_TS_SIZE;
+
+	/* Write the frame over the oldest one */
+	self->offset = (off_t)head * self->frame_file_size;
+	vraw_writer_frame_iov_fill(self, frame, &iovcnt);
+	res = vraw_writer_pwritev(self, self->iov, iovcnt);
+	if (res < 0)
+		return res;
+
+	/* Then commit it in the trailer: its timestamp first, then the
+	 * header with the new head and count */
+	vraw_le_put_u64(self->ring_trailer + ts_pos, get_frame_ts_us(frame));
+	res = ring_trailer_write(self, ts_pos, VRAW_RING_TS_SIZE);
+	if (res < 0)
+		return res;
+	self->ring_head++;
+	if (self->ring_head == self->cfg.ring_slots)
+		self->ring_head = 0;
+	if (self->ring_count < self->cfg.ring_slots)
+		self->ring_count++;
+	vraw_le_put_u32(self->ring_trailer + VRAW_RING_OFFSET_HEAD,
+			self->ring_head);
+	vraw_le_put_u32(self->ring_trailer + VRAW_RING_OFFSET_COUNT,
+			self->ring_count);
+
+	res = ring_trailer_write(self, 0, VRAW_RING_HEADER_SIZE);
+	if (res == 0)
+		self->stats.frames++;
+
+	return res;
+}
+
+
+static void ring_cleanup(struct vraw_writer *self)
+{
+	free(self->ring_trailer);
+}
+
+
+/* Frames are written one by one at their slot */
+const struct vraw_writer_ops vraw_writer_ring_ops = {
+	.start = &ring_setup,
+	.frame_write = &frame_write_ring,
+	.cleanup = &ring_cleanup,
+};
@@ -0,0 +1,340 @@
+/**
+ * Copyright (c) 2018 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ANDROID
+#	ifndef _FILE_OFFSET_BITS
+#		define _FILE_OFFSET_BITS 64
+#	endif /* _FILE_OFFSET_BITS */
+#endif /* ANDROID */
+
+#ifndef _GNU_SOURCE
+#	define _GNU_SOURCE
+#endif /* _GNU_SOURCE */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vraw_writer_priv.h"
+
+#define ULOG_TAG vraw
+#include <ulog.h>
+
+
+bool vraw_writer_segment_pattern_is_valid(const char *pattern)
+{
+	unsigned int count = 0;
+	const char *p = pattern;
+
+	/* Only a single "%u" conversion, with an optional zero flag and
+	 * width, is allowed; "%%" is a literal '%' */
+	while ((p = strchr(p, '%')) != NULL) {
+		p++;
+		if (*p == '%') {
+			p++;
+			continue;
+		}
+		while ((*p >= '0') && (*p <= '9'))
+			p++;
+		if (*p != 'u')
+			return false;
+		count++;
+	}
+
+	return (count == 1);
+}
+
+
+char *vraw_writer_segment_name(struct vraw_writer *self, unsigned int index)
+{
+	int len;
+	char *name;
+
+	len = snprintf(NULL, 0, self->pattern, index);
+	if (len < 0)
+		return NULL;
+	name = malloc(len + 1);
+	if (name == NULL)
+		return NULL;
+	snprintf(name, len + 1, self->pattern, index);
+
+	return name;
+}
+
+
+uint64_t vraw_writer_segment_prealloc_size(struct vraw_writer *self)
+{
+	uint64_t size = 0, frames;
+	struct vdef_frac *fr = &self->cfg.info.framerate;
+
+	/* Smallest of the segment limits, if known */
+	if (self->cfg.segment_frames > 0)
+		size = (uint64_t)self->cfg.segment_frames *
+		       self->frame_file_size;
+	if ((self->cfg.segment_bytes > 0) &&
+	    ((size == 0) || (self->cfg.segment_bytes < size)))
+		size = self->cfg.segment_bytes;
+	if (self->cfg.segment_duration_us > 0) {
+		frames = self->cfg.segment_duration_us * fr->num /
+				 ((uint64_t)fr->den * 1000000) +
+			 1;
+		if ((size == 0) || (frames * self->frame_file_size < size))
+			size = frames * self->frame_file_size;
+	}
+	if ((size > 0) && self->cfg.y4m)
+		size += Y4M_FILE_HEADER_MAX_SIZE;
+
+	return size;
+}
+
+
+static void segment_job_run(struct vraw_writer_segment_job *job)
+{
+	int res;
+
+	/* Close the previous segment file */
+	if (job->truncate && (ftruncate(job->fd, job->size) < 0))
+		ULOG_ERRNO("ftruncate", errno);
+	if (job->file != NULL) {
+		if (fclose(job->file) < 0)
+			ULOG_ERRNO("fclose", errno);
+	} else if (job->fd >= 0) {
+		if (close(job->fd) < 0)
+			ULOG_ERRNO("close", errno);
+	}
+	free(job->buffer);
+	job->file = NULL;
+	job->fd = -1;
+	job->buffer = NULL;
+	job->truncate = false;
+
+	/* Create and preallocate the next segment file */
+	job->prealloc_end = 0;
+	job->next_fd = vraw_writer_file_open(job->filename, job->direct);
+	if (job->next_fd < 0) {
+		job->res = job->next_fd;
+		return;
+	}
+#ifdef FALLOC_FL_KEEP_SIZE
+	if (job->prealloc_size > 0) {
+		res = fallocate(job->next_fd,
+				FALLOC_FL_KEEP_SIZE,
+				0,
+				job->prealloc_size);
+		if (res == 0)
+			job->prealloc_end = job->prealloc_size;
+		else if ((errno != EOPNOTSUPP) && (errno != ENOSYS))
+			ULOG_ERRNO("fallocate", errno);
+	}
+#else /* !FALLOC_FL_KEEP_SIZE */
+	(void)res;
+#endif /* !FALLOC_FL_KEEP_SIZE */
+	job->res = 0;
+}
+
+
+static void *segment_thread(void *ptr)
+{
+	segment_job_run(ptr);
+	return NULL;
+}
+
+
+int vraw_writer_segment_prepare(struct vraw_writer *self)
+{
+	int res;
+	struct vraw_writer_segment_job *job = &self->segment_job;
+
+	free(job->filename);
+	job->filename = vraw_writer_segment_name(self, self->segment_index + 1);
+	if (job->filename == NULL)
+		return -ENOMEM;
+	job->direct = (self->cfg.backend == VRAW_WRITER_BACKEND_DIRECT);
+	job->prealloc_size = vraw_writer_segment_prealloc_size(self);
+	job->next_fd = -1;
+	job->res = 0;
+
+	res = pthread_create(&self->segment_thread, NULL, segment_thread, job);
+	if (res != 0) {
+		/* Do the job synchronously */
+		ULOG_ERRNO("pthread_create", res);
+		segment_job_run(job);
+		return 0;
+	}
+	self->segment_thread_launched = true;
+
+	return 0;
+}
+
+
+static void segment_wait(struct vraw_writer *self)
+{
+	if (!self->segment_thread_launched)
+		return;
+	pthread_join(self->segment_thread, NULL);
+	self->segment_thread_launched = false;
+}
+
+
+static int segment_rotate(struct vraw_writer *self)
+{
+	int res, err, fd;
+	struct vraw_writer_segment_job *job = &self->segment_job;
+
+	/* Get the next segment file, prepared in the background */
+	segment_wait(self);
+	if (job->res < 0) {
+		/* Try again on the next frame */
+		res = job->res;
+		(void)vraw_writer_segment_prepare(self);
+		return res;
+	}
+
+	/* Complete the current segment file */
+	if (self->ops->drain != NULL) {
+		res = self->ops->drain(self);
+		if (res < 0)
+			return res;
+	}
+	res = vraw_writer_flush(self);
+	if ((res == 0) && (self->staging != NULL))
+		res = vraw_writer_direct_tail_write(self);
+	if ((res == 0) && (self->cfg.sync_bytes > 0)) {
+		/* Start the writeback of the remaining data */
+		res = vraw_writer_sync_range(self,
+					     self->sync_start,
+					     vraw_writer_get_data_end(self),
+					     false);
+	}
+	if (res < 0)
+		return res;
+
+	/* Hand it over to the background thread to be closed */
+	job->file = self->file;
+	job->fd = self->fd;
+	job->buffer = self->buffer;
+	job->truncate = (self->prealloc_end != 0);
+	job->size = vraw_writer_get_data_end(self);
+	self->file = NULL;
+	self->fd = -1;
+	self->buffer = NULL;
+
+	/* Switch to the next segment file */
+	free(self->filename);
+	self->filename = job->filename;
+	job->filename = NULL;
+	fd = job->next_fd;
+	job->next_fd = -1;
+	self->segment_index++;
+	self->segment_frame_count = 0;
+	self->segment_bytes_start = self->stats.bytes;
+	self->offset = 0;
+	self->staging_len = 0;
+	self->sync_start = 0;
+	self->sync_prev_start = 0;
+	self->sync_prev_end = 0;
+	self->prealloc_end = job->prealloc_end;
+	self->stats.segments++;
+	if (self->cfg.backend == VRAW_WRITER_BACKEND_STDIO) {
+		res = vraw_writer_stdio_attach(self, fd);
+	} else {
+		self->fd = fd;
+		res = 0;
+	}
+
+	err = vraw_writer_segment_prepare(self);
+	if (res == 0)
+		res = err;
+	if ((res == 0) && self->cfg.y4m)
+		res = vraw_writer_y4m_header_write(self);
+
+	return res;
+}
+
+
+int vraw_writer_segment_check(struct vraw_writer *self,
+			      const struct vraw_frame *frame)
+{
+	int res;
+	uint64_t ts;
+	bool rotate = false;
+
+	if (self->pattern == NULL)
+		return 0;
+
+	/* Note: a segment holds at least one frame */
+	ts = get_frame_ts_us(frame);
+	if (self->segment_frame_count > 0) {
+		if ((self->cfg.segment_frames > 0) &&
+		    (self->segment_frame_count >= self->cfg.segment_frames))
+			rotate = true;
+		if ((self->cfg.segment_bytes > 0) &&
+		    (vraw_writer_get_data_end(self) + self->frame_file_size >
+		     self->cfg.segment_bytes))
+			rotate = true;
+		if ((self->cfg.segment_duration_us > 0) &&
+		    (ts >= self->segment_ts_start) &&
+		    (ts - self->segment_ts_start >=
+		     self->cfg.segment_duration_us))
+			rotate = true;
+	}
+
+	if (rotate) {
+		res = segment_rotate(self);
+		if (res < 0)
+			return res;
+	}
+
+	if (self->segment_frame_count == 0)
+		self->segment_ts_start = ts;
+	self->segment_frame_count++;
+
+	return 0;
+}
+
+
+void vraw_writer_segment_cleanup(struct vraw_writer *self)
+{
+	/* Close the previous segment file if not done yet, and remove the
+	 * unused next segment file */
+	segment_wait(self);
+	if (self->segment_job.file != NULL)
+		fclose(self->segment_job.file);
+	else if (self->segment_job.fd >= 0)
+		close(self->segment_job.fd);
+	free(self->segment_job.buffer);
+	if (self->segment_job.next_fd >= 0) {
+		close(self->segment_job.next_fd);
+		if (unlink(self->segment_job.filename) < 0) {
+			ULOG_ERRNO("unlink:'%s'",
+				   errno,
+				   self->segment_job.filename);
+		}
+	}
+	free(self->segment_job.filename);
+}
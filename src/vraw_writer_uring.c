@@ -0,0 +1,283 @@
+/**
+ * Copyright (c) 2018 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ANDROID
+#	ifndef _FILE_OFFSET_BITS
+#		define _FILE_OFFSET_BITS 64
+#	endif /* _FILE_OFFSET_BITS */
+#endif /* ANDROID */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vraw_writer_priv.h"
+
+#define ULOG_TAG vraw
+#include <ulog.h>
+
+
+static int uring_setup(struct vraw_writer *self)
+{
+	int res;
+	long page_size;
+	struct iovec *iov;
+	unsigned int depth = self->cfg.uring_depth;
+
+	page_size = sysconf(_SC_PAGESIZE);
+	if (page_size <= 0)
+		page_size = 4096;
+
+	self->slots = calloc(depth, sizeof(*self->slots));
+	iov = calloc(depth, sizeof(*iov));
+	if ((self->slots == NULL) || (iov == NULL)) {
+		res = -ENOMEM;
+		goto out;
+	}
+
+	for (unsigned int i = 0; i < depth; i++) {
+		res = posix_memalign((void **)&self->slots[i].buf,
+				     page_size,
+				     self->frame_file_size);
+		if (res != 0) {
+			self->slots[i].buf = NULL;
+			res = -res;
+			ULOG_ERRNO("posix_memalign", -res);
+			goto out;
+		}
+		iov[i].iov_base = self->slots[i].buf;
+		iov[i].iov_len = self->frame_file_size;
+	}
+
+	/* Registering the buffers can fail because of the locked memory
+	 * limit; regular writes are used in that case */
+	res = vraw_uring_register_buffers(self->uring, iov, depth);
+	if (res < 0) {
+		ULOGW("failed to register the io_uring buffers (%s), "
+		      "using regular writes",
+		      strerror(-res));
+		res = 0;
+	} else {
+		self->uring_fixed = true;
+	}
+
+out:
+	free(iov);
+	return res;
+}
+
+
+static int uring_slot_submit(struct vraw_writer *self, unsigned int index)
+{
+	int res;
+	struct vraw_writer_slot *slot = &self->slots[index];
+
+	res = vraw_uring_prep_write(self->uring,
+				    self->fd,
+				    slot->buf + slot->done,
+				    self->frame_file_size - slot->done,
+				    slot->offset + slot->done,
+				    self->uring_fixed ? (int)index : -1,
+				    index);
+	if (res < 0)
+		ULOG_ERRNO("vraw_uring_prep_write", -res);
+
+	return res;
+}
+
+
+int vraw_writer_uring_complete(struct vraw_writer *self,
+			       unsigned int min_count)
+{
+	int res, err = 0, cres;
+	unsigned int count = 0;
+	uint64_t start, index;
+	struct vraw_writer_slot *slot;
+
+	if (min_count > self->inflight)
+		min_count = self->inflight;
+
+	do {
+		/* Submit the pending requests, and wait if needed */
+		start = get_time_ns();
+		res = vraw_uring_enter(self->uring,
+				       (count < min_count) ? 1 : 0);
+		self->stats.io_time_ns += get_time_ns() - start;
+		self->stats.io_calls++;
+		if ((res < 0) && (res != -EINTR)) {
+			ULOG_ERRNO("vraw_uring_enter", -res);
+			return res;
+		}
+
+		while (vraw_uring_reap(self->uring, &index, &cres) > 0) {
+			slot = &self->slots[index];
+			if (cres > 0) {
+				slot->done += cres;
+				self->stats.bytes += cres;
+				if (slot->done < self->frame_file_size) {
+					/* Short write, resume it */
+					res = uring_slot_submit(self, index);
+					if (res == 0)
+						continue;
+					cres = res;
+				}
+			} else if (cres == 0) {
+				cres = -EIO;
+			}
+			if (cres < 0) {
+				ULOG_ERRNO("io_uring write", -cres);
+				if (err == 0)
+					err = cres;
+			} else {
+				self->stats.frames++;
+			}
+			slot->busy = false;
+			self->inflight--;
+			count++;
+		}
+	} while (count < min_count);
+
+	return (err < 0) ? err : (int)count;
+}
+
+
+int vraw_writer_uring_frame_submit(struct vraw_writer *self,
+				   const struct vraw_frame *frame)
+{
+	int res;
+	unsigned int index;
+	struct vraw_writer_slot *slot = NULL;
+	uint8_t *dst;
+	uint64_t start;
+
+	for (index = 0; index < self->cfg.uring_depth; index++) {
+		if (!self->slots[index].busy) {
+			slot = &self->slots[index];
+			break;
+		}
+	}
+	if (slot == NULL)
+		return -EAGAIN;
+
+	/* Pack the frame into the registered buffer */
+	start = get_time_ns();
+	dst = slot->buf;
+	if (self->cfg.y4m) {
+		memcpy(dst, Y4M_FRAME_HEADER, Y4M_FRAME_HEADER_SIZE);
+		dst += Y4M_FRAME_HEADER_SIZE;
+	}
+	(void)vraw_writer_frame_pack(self, frame, dst);
+	self->stats.copy_time_ns += get_time_ns() - start;
+
+	slot->done = 0;
+	slot->offset = self->offset;
+	res = uring_slot_submit(self, index);
+	if (res < 0)
+		return res;
+
+	slot->busy = true;
+	self->inflight++;
+	self->offset += self->frame_file_size;
+
+	return 0;
+}
+
+
+static int frame_write_uring(struct vraw_writer *self,
+			     const struct vraw_frame *frame)
+{
+	int res;
+
+	if (self->inflight == self->cfg.uring_depth) {
+		res = vraw_writer_uring_complete(self, 1);
+		if (res < 0)
+			return res;
+	}
+
+	res = vraw_writer_uring_frame_submit(self, frame);
+	if (res < 0)
+		return res;
+
+	res = vraw_writer_uring_complete(self, self->inflight);
+	return (res < 0) ? res : 0;
+}
+
+
+static int frames_write_uring(struct vraw_writer *self,
+			      const struct vraw_frame *frames,
+			      unsigned int count)
+{
+	int res;
+
+	/* Keep the ring full, and only wait for the whole batch */
+	for (unsigned int i = 0; i < count; i++) {
+		if (self->inflight == self->cfg.uring_depth) {
+			res = vraw_writer_uring_complete(self, 1);
+			if (res < 0)
+				return res;
+		}
+		res = vraw_writer_uring_frame_submit(self, &frames[i]);
+		if (res < 0)
+			return res;
+	}
+
+	res = vraw_writer_uring_complete(self, self->inflight);
+	return (res < 0) ? res : 0;
+}
+
+
+static int uring_drain(struct vraw_writer *self)
+{
+	int res;
+
+	if (self->inflight == 0)
+		return 0;
+
+	res = vraw_writer_uring_complete(self, self->inflight);
+	return (res < 0) ? res : 0;
+}
+
+
+static void uring_cleanup(struct vraw_writer *self)
+{
+	if (self->uring != NULL)
+		vraw_uring_destroy(self->uring);
+	if (self->slots != NULL) {
+		for (unsigned int i = 0; i < self->cfg.uring_depth; i++)
+			free(self->slots[i].buf);
+		free(self->slots);
+	}
+}
+
+
+const struct vraw_writer_ops vraw_writer_uring_ops = {
+	.setup = &uring_setup,
+	.frame_write = &frame_write_uring,
+	.frames_write = &frames_write_uring,
+	.drain = &uring_drain,
+	.cleanup = &uring_cleanup,
+};
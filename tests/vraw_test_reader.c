@@ -713,6 +713,589 @@ static void test_vraw_reader_loop(void)
 }
 
 
+static void test_vraw_reader_frame_step(void)
+{
+	unsigned int STEP_LIST[] = {2, 3, 10};
+	for (size_t i = 0; i < ARRAY_SIZE(s_assets_map); i++) {
+		for (size_t j = 0; j < ARRAY_SIZE(STEP_LIST); j++) {
+			int ret = 0;
+			unsigned int width;
+			uint8_t *data = NULL;
+			uint8_t *ref_data = NULL;
+			uint8_t *ref_row = NULL;
+			ssize_t size = 0;
+			struct vraw_reader *reader = NULL;
+			struct vraw_reader *ref_reader = NULL;
+			struct vraw_frame frame = {0};
+			struct vraw_reader_config config = {0};
+			enum vdef_resolution resolution =
+				s_assets_map[i].resolution;
+			const struct vdef_raw_format *format =
+				s_assets_map[i].format;
+			unsigned int step = STEP_LIST[j];
+			unsigned int expected_count =
+				(s_assets_map[i].frame_count + step - 1) / step;
+
+			const char *path = get_path(i);
+
+			/* Reference reader: read all frames */
+			fill_config(&config, resolution, format);
+			ret = vraw_reader_new(path, &config, &ref_reader);
+			CU_ASSERT_EQUAL(ret, 0);
+
+			/* Decimated reader */
+			config.frame_step = step;
+			ret = vraw_reader_new(path, &config, &reader);
+			CU_ASSERT_EQUAL(ret, 0);
+
+			size = vraw_reader_get_min_buf_size(reader);
+			width = config.info.resolution.width;
+			data = calloc(1, size);
+			ref_data = calloc(1, size);
+			ref_row = calloc(1, width);
+
+			for (unsigned int k = 0; k < expected_count; k++) {
+				uint64_t expected_timestamp =
+					(1000000ULL * config.info.framerate.den /
+					 config.info.framerate.num) *
+					k * step;
+
+				/* Skip frames on the reference reader */
+				for (unsigned int l = 0; l < step; l++) {
+					if (k * step + l >=
+					    s_assets_map[i].frame_count)
+						break;
+					ret = vraw_reader_frame_read(ref_reader,
+								     ref_data,
+								     size,
+								     &frame);
+					CU_ASSERT_EQUAL(ret, 0);
+					if (l == 0)
+						memcpy(ref_row, ref_data, width);
+				}
+
+				memset(&frame, 0, sizeof(frame));
+				ret = vraw_reader_frame_read(
+					reader, data, size, &frame);
+				CU_ASSERT_EQUAL(ret, 0);
+
+				/* Check frame info */
+				CU_ASSERT_EQUAL(frame.frame.info.index, k);
+				CU_ASSERT_EQUAL(frame.frame.info.timestamp,
+						expected_timestamp);
+
+				/* Check that frame k * step was read */
+				ret = memcmp(data, ref_row, width);
+				CU_ASSERT_EQUAL(ret, 0);
+			}
+
+			/* EOF reached */
+			ret = vraw_reader_frame_read(
+				reader, data, size, &frame);
+			CU_ASSERT_EQUAL(ret, -ENOENT);
+
+			(void)vraw_reader_destroy(reader);
+			(void)vraw_reader_destroy(ref_reader);
+
+			free(data);
+			free(ref_data);
+			free(ref_row);
+		}
+	}
+}
+
+
+static void test_vraw_reader_plane_mask(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(s_assets_map); i++) {
+		int ret = 0;
+		unsigned int plane_count;
+		uint8_t *data = NULL;
+		uint8_t *ref_data = NULL;
+		ssize_t size = 0, ref_size = 0, expected_size;
+		struct vraw_reader *reader = NULL;
+		struct vraw_reader *ref_reader = NULL;
+		struct vraw_frame frame = {0};
+		struct vraw_frame ref_frame = {0};
+		struct vraw_reader_config config = {0};
+		enum vdef_resolution resolution = s_assets_map[i].resolution;
+		const struct vdef_raw_format *format = s_assets_map[i].format;
+		size_t plane_size[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+
+		const char *path = get_path(i);
+		fill_config(&config, resolution, format);
+		plane_count = vdef_get_raw_frame_plane_count(format);
+		vdef_calc_raw_frame_size(format,
+					 &config.info.resolution,
+					 NULL,
+					 NULL,
+					 NULL,
+					 NULL,
+					 plane_size,
+					 NULL);
+
+		/* Reference reader: read all planes */
+		ret = vraw_reader_new(path, &config, &ref_reader);
+		CU_ASSERT_EQUAL(ret, 0);
+		ref_size = vraw_reader_get_min_buf_size(ref_reader);
+		ref_data = calloc(1, ref_size);
+
+		/* Invalid plane mask */
+		config.plane_mask = 1 << plane_count;
+		ret = vraw_reader_new(path, &config, &reader);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+
+		/* Luma only, or chroma only if there are chroma planes */
+		config.plane_mask = (plane_count > 1) && (i % 2) ? ~1 : 1;
+		ret = vraw_reader_new(path, &config, &reader);
+		CU_ASSERT_EQUAL(ret, 0);
+
+		expected_size = 0;
+		for (unsigned int p = 0; p < plane_count; ++p) {
+			if (config.plane_mask & (1 << p))
+				expected_size += plane_size[p];
+		}
+		size = vraw_reader_get_min_buf_size(reader);
+		CU_ASSERT_EQUAL(size, expected_size);
+		data = calloc(1, size);
+
+		for (unsigned int k = 0; k < 5; k++) {
+			ret = vraw_reader_frame_read(
+				ref_reader, ref_data, ref_size, &ref_frame);
+			CU_ASSERT_EQUAL(ret, 0);
+
+			ret = vraw_reader_frame_read(reader, data, size, &frame);
+			CU_ASSERT_EQUAL(ret, 0);
+
+			/* Check that only the selected planes were read */
+			for (unsigned int p = 0; p < plane_count; ++p) {
+				if (!(config.plane_mask & (1 << p))) {
+					CU_ASSERT_PTR_NULL(frame.data[p]);
+					continue;
+				}
+				CU_ASSERT_PTR_NOT_NULL(frame.data[p]);
+				ret = memcmp(frame.data[p],
+					     ref_frame.data[p],
+					     plane_size[p]);
+				CU_ASSERT_EQUAL(ret, 0);
+			}
+		}
+
+		(void)vraw_reader_destroy(reader);
+		(void)vraw_reader_destroy(ref_reader);
+
+		free(data);
+		free(ref_data);
+	}
+}
+
+
+static void check_decimated_plane(const uint8_t *data,
+				  size_t stride,
+				  const uint8_t *ref_data,
+				  size_t ref_stride,
+				  size_t row_bytes,
+				  size_t rows,
+				  size_t elem_size,
+				  unsigned int factor)
+{
+	for (size_t y = 0; y < rows; y++) {
+		const uint8_t *row = data + y * stride;
+		const uint8_t *ref_row = ref_data + y * factor * ref_stride;
+		for (size_t x = 0; x < row_bytes; x++) {
+			size_t ref_x = (x / elem_size) * factor * elem_size +
+				       x % elem_size;
+			CU_ASSERT_EQUAL(row[x], ref_row[ref_x]);
+		}
+	}
+}
+
+
+static void test_vraw_reader_subsample(void)
+{
+	unsigned int FACTOR_LIST[] = {2, 4};
+	for (size_t i = 0; i < ARRAY_SIZE(s_assets_map); i++) {
+		for (size_t j = 0; j < ARRAY_SIZE(FACTOR_LIST); j++) {
+			int ret = 0;
+			unsigned int plane_count;
+			uint8_t *data = NULL;
+			uint8_t *ref_data = NULL;
+			ssize_t size = 0, ref_size = 0, expected_size;
+			struct vraw_reader *reader = NULL;
+			struct vraw_reader *ref_reader = NULL;
+			struct vraw_frame frame = {0};
+			struct vraw_frame ref_frame = {0};
+			struct vraw_reader_config config = {0};
+			struct vdef_dim dim;
+			enum vdef_resolution resolution =
+				s_assets_map[i].resolution;
+			const struct vdef_raw_format *format =
+				s_assets_map[i].format;
+			unsigned int factor = FACTOR_LIST[j];
+			size_t plane_size[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+			size_t plane_scanline[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+			size_t plane_stride[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+
+			const char *path = get_path(i);
+			fill_config(&config, resolution, format);
+			plane_count = vdef_get_raw_frame_plane_count(format);
+			dim.width = config.info.resolution.width / factor;
+			dim.height = config.info.resolution.height / factor;
+			vdef_calc_raw_frame_size(format,
+						 &dim,
+						 plane_stride,
+						 NULL,
+						 plane_scanline,
+						 NULL,
+						 plane_size,
+						 NULL);
+
+			/* Reference reader: full resolution */
+			ret = vraw_reader_new(path, &config, &ref_reader);
+			CU_ASSERT_EQUAL(ret, 0);
+			ref_size = vraw_reader_get_min_buf_size(ref_reader);
+			ref_data = calloc(1, ref_size);
+
+			config.subsample = factor;
+			ret = vraw_reader_new(path, &config, &reader);
+			CU_ASSERT_EQUAL(ret, 0);
+
+			expected_size = 0;
+			for (unsigned int p = 0; p < plane_count; ++p)
+				expected_size += plane_size[p];
+			size = vraw_reader_get_min_buf_size(reader);
+			CU_ASSERT_EQUAL(size, expected_size);
+			data = calloc(1, size);
+
+			for (unsigned int k = 0; k < 5; k++) {
+				ret = vraw_reader_frame_read(ref_reader,
+							     ref_data,
+							     ref_size,
+							     &ref_frame);
+				CU_ASSERT_EQUAL(ret, 0);
+
+				ret = vraw_reader_frame_read(
+					reader, data, size, &frame);
+				CU_ASSERT_EQUAL(ret, 0);
+				CU_ASSERT_TRUE(vdef_dim_cmp(
+					&frame.frame.info.resolution, &dim));
+
+				/* Check that the frame is decimated (chroma
+				 * planes of semi-planar formats contain pairs
+				 * of samples) */
+				for (unsigned int p = 0; p < plane_count; ++p) {
+					check_decimated_plane(
+						frame.data[p],
+						frame.frame.plane_stride[p],
+						ref_frame.data[p],
+						ref_frame.frame.plane_stride[p],
+						plane_stride[p],
+						plane_scanline[p],
+						(plane_count == 2 && p == 1) ? 2 : 1,
+						factor);
+				}
+			}
+
+			(void)vraw_reader_destroy(reader);
+			(void)vraw_reader_destroy(ref_reader);
+
+			free(data);
+			free(ref_data);
+		}
+	}
+}
+
+
+static void append_byte(const char *path)
+{
+	FILE *file = fopen(path, "ab");
+	CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+	CU_ASSERT_EQUAL(fputc(0, file), 0);
+	fclose(file);
+}
+
+
+static void test_vraw_reader_segments(void)
+{
+	int ret = 0;
+	ssize_t size = 0, count;
+	uint8_t *data = NULL;
+	uint8_t *ref_data = NULL;
+	struct vraw_reader *reader = NULL;
+	struct vraw_reader *ref_reader = NULL;
+	struct vraw_frame frame = {0};
+	struct vraw_reader_config config = {0};
+	enum vdef_resolution resolution = s_assets_map[1].resolution;
+	const struct vdef_raw_format *format = s_assets_map[1].format;
+	unsigned int segment_frames[] = {10, 0, 1, 19};
+	const char *segments[] = {
+		"/tmp/vraw_test_segment_0.yuv",
+		"/tmp/vraw_test_segment_1.yuv",
+		"/tmp/vraw_test_segment_2.yuv",
+		"/tmp/vraw_test_segment_3.yuv",
+	};
+	unsigned int total = 0;
+
+	const char *path = get_path(1);
+	fill_config(&config, resolution, format);
+
+	ret = vraw_reader_new(path, &config, &ref_reader);
+	CU_ASSERT_EQUAL(ret, 0);
+	size = vraw_reader_get_min_buf_size(ref_reader);
+	data = calloc(1, size);
+	ref_data = calloc(1, size);
+
+	/* Split the beginning of the file into segments */
+	for (size_t s = 0; s < ARRAY_SIZE(segments); s++) {
+		FILE *file = fopen(segments[s], "wb");
+		CU_ASSERT_PTR_NOT_NULL(file);
+		for (unsigned int k = 0; k < segment_frames[s]; k++) {
+			ret = vraw_reader_frame_read(
+				ref_reader, ref_data, size, &frame);
+			CU_ASSERT_EQUAL(ret, 0);
+			CU_ASSERT_EQUAL(fwrite(ref_data, size, 1, file), 1);
+		}
+		fclose(file);
+		total += segment_frames[s];
+	}
+	(void)vraw_reader_destroy(ref_reader);
+
+	/* Bad args */
+	ret = vraw_reader_new_segments(NULL, 1, &config, &reader);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+
+	ret = vraw_reader_new_segments(segments, 0, &config, &reader);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+
+	ret = vraw_reader_new_glob(NULL, &config, &reader);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+
+	ret = vraw_reader_new_glob("/tmp/vraw_test_no_segment_*.yuv",
+				   &config,
+				   &reader);
+	CU_ASSERT_EQUAL(ret, -ENOENT);
+
+	/* Read forwards then backwards across the segment boundaries */
+	config.loop = -1;
+	ret = vraw_reader_new_glob(
+		"/tmp/vraw_test_segment_*.yuv", &config, &reader);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	count = vraw_reader_get_file_frame_count(reader);
+	CU_ASSERT_EQUAL(count, total);
+
+	/* Reference reader: same frames in the original file */
+	config.max_count = total;
+	ret = vraw_reader_new(path, &config, &ref_reader);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	for (unsigned int k = 0; k < 3 * total; k++) {
+		uint64_t expected_timestamp =
+			(1000000ULL * config.info.framerate.den /
+			 config.info.framerate.num) *
+			k;
+
+		ret = vraw_reader_frame_read(
+			ref_reader, ref_data, size, &frame);
+		CU_ASSERT_EQUAL(ret, 0);
+
+		memset(&frame, 0, sizeof(frame));
+		ret = vraw_reader_frame_read(reader, data, size, &frame);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(frame.frame.info.index, k);
+		CU_ASSERT_EQUAL(frame.frame.info.timestamp,
+				expected_timestamp);
+
+		ret = memcmp(data, ref_data, size);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	(void)vraw_reader_destroy(reader);
+	(void)vraw_reader_destroy(ref_reader);
+
+	/* Unpadded segment indexes are sorted by value: the 1-frame
+	 * segment 9 is read before segment 10 */
+	CU_ASSERT_EQUAL(link(segments[2], "/tmp/vraw_test_useg_9.yuv"), 0);
+	CU_ASSERT_EQUAL(link(segments[3], "/tmp/vraw_test_useg_10.yuv"), 0);
+	config.loop = 0;
+	config.max_count = 0;
+	ret = vraw_reader_new(segments[2], &config, &ref_reader);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = vraw_reader_frame_read(ref_reader, ref_data, size, &frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	(void)vraw_reader_destroy(ref_reader);
+	ret = vraw_reader_new_glob(
+		"/tmp/vraw_test_useg_*.yuv", &config, &reader);
+	CU_ASSERT_EQUAL(ret, 0);
+	count = vraw_reader_get_file_frame_count(reader);
+	CU_ASSERT_EQUAL(count, segment_frames[2] + segment_frames[3]);
+	ret = vraw_reader_frame_read(reader, data, size, &frame);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(memcmp(data, ref_data, size), 0);
+	(void)vraw_reader_destroy(reader);
+	unlink("/tmp/vraw_test_useg_9.yuv");
+	unlink("/tmp/vraw_test_useg_10.yuv");
+
+	/* A partial frame is only ignored at the end of the last segment */
+	config.loop = 0;
+	config.max_count = 0;
+	append_byte(segments[3]);
+	ret = vraw_reader_new(segments[3], &config, &reader);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	ret = vraw_reader_new_segments(
+		segments, ARRAY_SIZE(segments), &config, &reader);
+	CU_ASSERT_EQUAL(ret, 0);
+	count = vraw_reader_get_file_frame_count(reader);
+	CU_ASSERT_EQUAL(count, total);
+	(void)vraw_reader_destroy(reader);
+	append_byte(segments[0]);
+	ret = vraw_reader_new_segments(
+		segments, ARRAY_SIZE(segments), &config, &reader);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+
+	for (size_t s = 0; s < ARRAY_SIZE(segments); s++)
+		unlink(segments[s]);
+
+	free(data);
+	free(ref_data);
+}
+
+
+static void test_vraw_reader_stats(void)
+{
+	int LOOP_LIST[] = {0, 1, -1};
+	for (size_t i = 0; i < ARRAY_SIZE(s_assets_map); i++) {
+		for (size_t j = 0; j < ARRAY_SIZE(LOOP_LIST); j++) {
+			int ret = 0;
+			uint8_t *data = NULL;
+			ssize_t size = 0;
+			struct vraw_reader *reader = NULL;
+			struct vraw_frame frame = {0};
+			struct vraw_reader_config config = {0};
+			struct vraw_reader_stats stats = {0};
+			enum vdef_resolution resolution =
+				s_assets_map[i].resolution;
+			const struct vdef_raw_format *format =
+				s_assets_map[i].format;
+			size_t frame_count = s_assets_map[i].frame_count;
+			size_t read_count;
+
+			const char *path = get_path(i);
+
+			fill_config(&config, resolution, format);
+			config.loop = LOOP_LIST[j];
+			ret = vraw_reader_new(path, &config, &reader);
+			CU_ASSERT_EQUAL(ret, 0);
+
+			/* Bad args */
+			ret = vraw_reader_get_stats(NULL, &stats);
+			CU_ASSERT_EQUAL(ret, -EINVAL);
+
+			ret = vraw_reader_get_stats(reader, NULL);
+			CU_ASSERT_EQUAL(ret, -EINVAL);
+
+			/* Nothing read yet */
+			ret = vraw_reader_get_stats(reader, &stats);
+			CU_ASSERT_EQUAL(ret, 0);
+			CU_ASSERT_EQUAL(stats.frames, 0);
+			CU_ASSERT_EQUAL(stats.bytes, 0);
+			CU_ASSERT_EQUAL(stats.io_calls, 0);
+
+			/* Read the whole file, plus a few frames when
+			 * looping */
+			size = vraw_reader_get_min_buf_size(reader);
+			data = calloc(1, size);
+			read_count = (config.loop != 0) ? frame_count + 3
+							: frame_count;
+			for (size_t k = 0; k < read_count; k++) {
+				ret = vraw_reader_frame_read(
+					reader, data, size, &frame);
+				CU_ASSERT_EQUAL(ret, 0);
+			}
+
+			ret = vraw_reader_get_stats(reader, &stats);
+			CU_ASSERT_EQUAL(ret, 0);
+			CU_ASSERT_EQUAL(stats.frames, read_count);
+			CU_ASSERT_EQUAL(stats.bytes, read_count * size);
+			CU_ASSERT(stats.io_calls >= read_count);
+			CU_ASSERT_EQUAL(stats.copy_time_ns, 0);
+			CU_ASSERT_EQUAL(stats.loops, (config.loop > 0) ? 1 : 0);
+			CU_ASSERT_EQUAL(stats.reversals,
+					(config.loop < 0) ? 1 : 0);
+
+			/* A failed read is not counted as a frame */
+			if (config.loop == 0) {
+				ret = vraw_reader_frame_read(
+					reader, data, size, &frame);
+				CU_ASSERT_EQUAL(ret, -ENOENT);
+				ret = vraw_reader_get_stats(reader, &stats);
+				CU_ASSERT_EQUAL(ret, 0);
+				CU_ASSERT_EQUAL(stats.frames, read_count);
+			}
+
+			(void)vraw_reader_destroy(reader);
+
+			free(data);
+		}
+	}
+}
+
+
+static void test_vraw_reader_seek_ts(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(s_assets_map); i++) {
+		int ret = 0;
+		uint8_t *data = NULL;
+		ssize_t size = 0;
+		struct vraw_reader *reader = NULL;
+		struct vraw_frame frame = {0};
+		struct vraw_reader_config config = {0};
+		enum vdef_resolution resolution = s_assets_map[i].resolution;
+		const struct vdef_raw_format *format = s_assets_map[i].format;
+		unsigned int frame_count = s_assets_map[i].frame_count;
+		uint64_t duration;
+
+		const char *path = get_path(i);
+
+		fill_config(&config, resolution, format);
+		ret = vraw_reader_new(path, &config, &reader);
+		CU_ASSERT_EQUAL(ret, 0);
+		duration = 1000000ULL * config.info.framerate.den /
+			   config.info.framerate.num;
+		size = vraw_reader_get_min_buf_size(reader);
+		data = calloc(1, size);
+
+		ret = vraw_reader_seek_ts(NULL, 0);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+
+		/* Last frame at or before the timestamp */
+		for (unsigned int k = 0; k < frame_count; k += 7) {
+			ret = vraw_reader_seek_ts(
+				reader, k * duration + duration / 2);
+			CU_ASSERT_EQUAL(ret, 0);
+			ret = vraw_reader_frame_read(
+				reader, data, size, &frame);
+			CU_ASSERT_EQUAL(ret, 0);
+			CU_ASSERT_EQUAL(frame.frame.info.timestamp,
+					k * duration);
+		}
+
+		/* Past the end: last frame */
+		ret = vraw_reader_seek_ts(reader, UINT64_MAX / 2);
+		CU_ASSERT_EQUAL(ret, 0);
+		ret = vraw_reader_frame_read(reader, data, size, &frame);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(frame.frame.info.timestamp,
+				(frame_count - 1) * duration);
+		ret = vraw_reader_frame_read(reader, data, size, &frame);
+		CU_ASSERT_EQUAL(ret, -ENOENT);
+
+		(void)vraw_reader_destroy(reader);
+		free(data);
+	}
+}
+
+
 CU_TestInfo g_vraw_test_reader[] = {
 	{FN("vraw-reader-new"), &test_vraw_reader_new},
 	{FN("vraw-reader-get-config"), &test_vraw_reader_get_config},
@@ -725,6 +1308,12 @@ CU_TestInfo g_vraw_test_reader[] = {
 	{FN("vraw-reader-api"), &test_vraw_reader_api},
 	{FN("vraw-reader-max-count"), &test_vraw_reader_max_count},
 	{FN("vraw-reader-loop"), &test_vraw_reader_loop},
+	{FN("vraw-reader-frame-step"), &test_vraw_reader_frame_step},
+	{FN("vraw-reader-plane-mask"), &test_vraw_reader_plane_mask},
+	{FN("vraw-reader-subsample"), &test_vraw_reader_subsample},
+	{FN("vraw-reader-segments"), &test_vraw_reader_segments},
+	{FN("vraw-reader-stats"), &test_vraw_reader_stats},
+	{FN("vraw-reader-seek-ts"), &test_vraw_reader_seek_ts},
 
 	CU_TEST_INFO_NULL,
 };
@@ -312,9 +312,3027 @@ static void test_vraw_writer_frame_write(void)
 }
 
 
+static void test_vraw_writer_stats(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(s_assets_map); i++) {
+		int ret = 0;
+		struct vraw_writer *writer = NULL;
+		struct vraw_writer_config config = {0};
+		struct vraw_writer_stats stats = {0};
+		struct vraw_frame frame = {0};
+		uint8_t *frame_data = NULL;
+		size_t frame_size;
+		enum vdef_resolution resolution = s_assets_map[i].resolution;
+		const struct vdef_raw_format *format = s_assets_map[i].format;
+		size_t plane_size[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+
+		const char *path = get_path(format);
+		fill_config(&config, resolution, format);
+
+		vdef_calc_raw_frame_size(format,
+					 &config.info.resolution,
+					 NULL,
+					 NULL,
+					 NULL,
+					 NULL,
+					 plane_size,
+					 NULL);
+		frame_size = 0;
+		for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; ++p)
+			frame_size += plane_size[p];
+
+		frame_data = calloc(1, frame_size);
+
+		ret = vraw_writer_new(path, &config, &writer);
+		CU_ASSERT_EQUAL(ret, 0);
+
+		/* Bad args */
+		ret = vraw_writer_get_stats(NULL, &stats);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+
+		ret = vraw_writer_get_stats(writer, NULL);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+
+		/* Nothing written yet */
+		ret = vraw_writer_get_stats(writer, &stats);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(stats.frames, 0);
+		CU_ASSERT_EQUAL(stats.bytes, 0);
+
+		/* A rejected frame is not counted */
+		fill_frame(&frame, resolution, format);
+		ret = vraw_writer_frame_write(writer, &frame);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+
+		frame.cdata[0] = frame_data;
+		frame.cdata[1] = frame_data;
+		frame.cdata[2] = frame_data;
+		for (unsigned int k = 0; k < 5; k++) {
+			ret = vraw_writer_frame_write(writer, &frame);
+			CU_ASSERT_EQUAL(ret, 0);
+		}
+
+		ret = vraw_writer_get_stats(writer, &stats);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(stats.frames, 5);
+		CU_ASSERT_EQUAL(stats.bytes, 5 * frame_size);
+		CU_ASSERT(stats.io_calls >= 5);
+
+		(void)vraw_writer_destroy(writer);
+
+		free(frame_data);
+	}
+}
+
+
+static size_t get_file_size(const char *path)
+{
+	struct stat st;
+	int ret = stat(path, &st);
+	CU_ASSERT_EQUAL(ret, 0);
+	return (ret == 0) ? (size_t)st.st_size : 0;
+}
+
+
+static void test_vraw_writer_flush(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(s_assets_map); i++) {
+		int ret = 0;
+		struct vraw_writer *writer = NULL;
+		struct vraw_writer_config config = {0};
+		struct vraw_writer_config invalid_config = {0};
+		struct vraw_frame frame = {0};
+		uint8_t *frame_data = NULL;
+		size_t frame_size;
+		enum vdef_resolution resolution = s_assets_map[i].resolution;
+		const struct vdef_raw_format *format = s_assets_map[i].format;
+		size_t plane_size[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+
+		const char *path = get_path(format);
+		fill_config(&config, resolution, format);
+
+		vdef_calc_raw_frame_size(format,
+					 &config.info.resolution,
+					 NULL,
+					 NULL,
+					 NULL,
+					 NULL,
+					 plane_size,
+					 NULL);
+		frame_size = 0;
+		for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; ++p)
+			frame_size += plane_size[p];
+
+		frame_data = calloc(1, frame_size);
+
+		/* invalid config: flush policy */
+		invalid_config = config;
+		invalid_config.flush = VRAW_WRITER_FLUSH_ON_DESTROY + 1;
+		ret = vraw_writer_new(path, &invalid_config, &writer);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+
+		/* invalid config: no frame period */
+		invalid_config = config;
+		invalid_config.flush = VRAW_WRITER_FLUSH_EVERY_N_FRAMES;
+		ret = vraw_writer_new(path, &invalid_config, &writer);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+
+		/* invalid config: no byte period */
+		invalid_config = config;
+		invalid_config.flush = VRAW_WRITER_FLUSH_EVERY_N_BYTES;
+		ret = vraw_writer_new(path, &invalid_config, &writer);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+
+		fill_frame(&frame, resolution, format);
+		frame.cdata[0] = frame_data;
+		frame.cdata[1] = frame_data;
+		frame.cdata[2] = frame_data;
+
+		/* Flush every 3 frames, the buffer holds more than that */
+		config.flush = VRAW_WRITER_FLUSH_EVERY_N_FRAMES;
+		config.flush_frames = 3;
+		config.buffer_size = 4 * frame_size;
+		ret = vraw_writer_new(path, &config, &writer);
+		CU_ASSERT_EQUAL(ret, 0);
+		for (unsigned int k = 1; k <= 7; k++) {
+			ret = vraw_writer_frame_write(writer, &frame);
+			CU_ASSERT_EQUAL(ret, 0);
+			CU_ASSERT_EQUAL(get_file_size(path),
+					(k - k % 3) * frame_size);
+		}
+		ret = vraw_writer_destroy(writer);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(get_file_size(path), 7 * frame_size);
+
+		/* Flush every 2 frames worth of bytes */
+		config.flush = VRAW_WRITER_FLUSH_EVERY_N_BYTES;
+		config.flush_bytes = 2 * frame_size;
+		ret = vraw_writer_new(path, &config, &writer);
+		CU_ASSERT_EQUAL(ret, 0);
+		for (unsigned int k = 1; k <= 5; k++) {
+			ret = vraw_writer_frame_write(writer, &frame);
+			CU_ASSERT_EQUAL(ret, 0);
+			CU_ASSERT_EQUAL(get_file_size(path),
+					(k - k % 2) * frame_size);
+		}
+		ret = vraw_writer_destroy(writer);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(get_file_size(path), 5 * frame_size);
+
+		/* Flush on destroy only */
+		config.flush = VRAW_WRITER_FLUSH_ON_DESTROY;
+		ret = vraw_writer_new(path, &config, &writer);
+		CU_ASSERT_EQUAL(ret, 0);
+		for (unsigned int k = 1; k <= 3; k++) {
+			ret = vraw_writer_frame_write(writer, &frame);
+			CU_ASSERT_EQUAL(ret, 0);
+			CU_ASSERT_EQUAL(get_file_size(path), 0);
+		}
+		ret = vraw_writer_destroy(writer);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(get_file_size(path), 3 * frame_size);
+
+		free(frame_data);
+	}
+}
+
+
+static void write_strided_frames(const char *path,
+				 struct vraw_writer_config *config,
+				 enum vdef_resolution resolution,
+				 const struct vdef_raw_format *format)
+{
+	int ret;
+	struct vraw_writer *writer = NULL;
+	struct vraw_frame frame = {0};
+	uint8_t *plane_data[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+	size_t plane_size[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+	size_t lines[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+
+	fill_frame(&frame, resolution, format);
+	vdef_calc_raw_frame_size(format,
+				 &frame.frame.info.resolution,
+				 NULL,
+				 NULL,
+				 NULL,
+				 NULL,
+				 plane_size,
+				 NULL);
+
+	/* Padded rows, the padding must not be written */
+	for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++) {
+		if (frame.frame.plane_stride[p] == 0)
+			continue;
+		lines[p] = plane_size[p] / frame.frame.plane_stride[p];
+		frame.frame.plane_stride[p] += 64;
+		plane_data[p] = malloc(lines[p] * frame.frame.plane_stride[p]);
+		frame.cdata[p] = plane_data[p];
+	}
+
+	ret = vraw_writer_new(path, config, &writer);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	for (unsigned int k = 0; k < 3; k++) {
+		for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++) {
+			size_t len = lines[p] * frame.frame.plane_stride[p];
+			for (size_t j = 0; j < len; j++)
+				plane_data[p][j] = (uint8_t)(j * 7 + p + k);
+		}
+		ret = vraw_writer_frame_write(writer, &frame);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	ret = vraw_writer_destroy(writer);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++)
+		free(plane_data[p]);
+}
+
+
+static void check_same_files(const char *path1, const char *path2)
+{
+	size_t size1, size2;
+	uint8_t *data1 = NULL, *data2 = NULL;
+	FILE *file;
+
+	size1 = get_file_size(path1);
+	size2 = get_file_size(path2);
+	CU_ASSERT_EQUAL(size1, size2);
+	CU_ASSERT_NOT_EQUAL(size1, 0);
+	if ((size1 != size2) || (size1 == 0))
+		return;
+
+	data1 = malloc(size1);
+	data2 = malloc(size2);
+	file = fopen(path1, "rb");
+	CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+	CU_ASSERT_EQUAL(fread(data1, size1, 1, file), 1);
+	(void)fclose(file);
+	file = fopen(path2, "rb");
+	CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+	CU_ASSERT_EQUAL(fread(data2, size2, 1, file), 1);
+	(void)fclose(file);
+
+	CU_ASSERT_EQUAL(memcmp(data1, data2, size1), 0);
+
+	free(data1);
+	free(data2);
+}
+
+
+static void test_vraw_writer_pwritev(void)
+{
+	const char *path_pwritev = "/tmp/vraw_test_writer_pwritev.yuv";
+	for (size_t i = 0; i < ARRAY_SIZE(s_assets_map); i++) {
+		for (int y4m = 0; y4m <= 1; y4m++) {
+			int ret = 0;
+			struct vraw_writer *writer = NULL;
+			struct vraw_writer_config config = {0};
+			enum vdef_resolution resolution =
+				s_assets_map[i].resolution;
+			const struct vdef_raw_format *format =
+				s_assets_map[i].format;
+
+			const char *path = get_path(format);
+			fill_config(&config, resolution, format);
+
+			/* y4m is only supported for I420 */
+			if (y4m && !vdef_raw_format_cmp(format, &vdef_i420))
+				continue;
+			config.y4m = y4m;
+
+			/* invalid config: backend */
+			config.backend = VRAW_WRITER_BACKEND_DIRECT + 1;
+			ret = vraw_writer_new(path, &config, &writer);
+			CU_ASSERT_EQUAL(ret, -EINVAL);
+
+			/* Reference file */
+			config.backend = VRAW_WRITER_BACKEND_STDIO;
+			write_strided_frames(path, &config, resolution, format);
+
+			config.backend = VRAW_WRITER_BACKEND_PWRITEV;
+			write_strided_frames(
+				path_pwritev, &config, resolution, format);
+
+			/* Both files must be identical */
+			check_same_files(path, path_pwritev);
+		}
+	}
+
+	unlink(path_pwritev);
+}
+
+
+/* Same data as write_strided_frames(), from contiguous planes, in a
+ * single buffer if single is set */
+static void write_contiguous_frames(const char *path,
+				    struct vraw_writer_config *config,
+				    enum vdef_resolution resolution,
+				    const struct vdef_raw_format *format,
+				    bool single,
+				    struct vraw_writer_stats *stats)
+{
+	int ret;
+	struct vraw_writer *writer = NULL;
+	struct vraw_frame frame = {0};
+	uint8_t *frame_data = NULL;
+	uint8_t *plane_data[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+	size_t plane_size[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+	size_t frame_size = 0, offset = 0;
+
+	fill_frame(&frame, resolution, format);
+	vdef_calc_raw_frame_size(format,
+				 &frame.frame.info.resolution,
+				 NULL,
+				 NULL,
+				 NULL,
+				 NULL,
+				 plane_size,
+				 NULL);
+	for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++)
+		frame_size += plane_size[p];
+
+	if (single)
+		frame_data = malloc(frame_size);
+	for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++) {
+		if (plane_size[p] == 0)
+			continue;
+		if (single) {
+			plane_data[p] = frame_data + offset;
+			offset += plane_size[p];
+		} else {
+			plane_data[p] = malloc(plane_size[p]);
+		}
+		frame.cdata[p] = plane_data[p];
+	}
+
+	ret = vraw_writer_new(path, config, &writer);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	for (unsigned int k = 0; k < 3; k++) {
+		for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++) {
+			size_t stride = frame.frame.plane_stride[p];
+			for (size_t j = 0; j < plane_size[p]; j++) {
+				/* Position in the padded rows */
+				size_t pos = (j / stride) * (stride + 64) +
+					     j % stride;
+				plane_data[p][j] = (uint8_t)(pos * 7 + p + k);
+			}
+		}
+		ret = vraw_writer_frame_write(writer, &frame);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	ret = vraw_writer_get_stats(writer, stats);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = vraw_writer_destroy(writer);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	if (single) {
+		free(frame_data);
+	} else {
+		for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++)
+			free(plane_data[p]);
+	}
+}
+
+
+static void test_vraw_writer_contiguous(void)
+{
+	const char *path_contiguous = "/tmp/vraw_test_writer_contiguous.yuv";
+	enum vraw_writer_backend backends[] = {
+		VRAW_WRITER_BACKEND_STDIO,
+		VRAW_WRITER_BACKEND_PWRITEV,
+		VRAW_WRITER_BACKEND_IO_URING,
+		VRAW_WRITER_BACKEND_DIRECT,
+	};
+	for (size_t i = 0; i < ARRAY_SIZE(s_assets_map); i++) {
+		struct vraw_writer_config config = {0};
+		struct vraw_writer_stats stats = {0};
+		enum vdef_resolution resolution = s_assets_map[i].resolution;
+		const struct vdef_raw_format *format = s_assets_map[i].format;
+		unsigned int plane_count =
+			vdef_get_raw_frame_plane_count(format);
+
+		const char *path = get_path(format);
+		fill_config(&config, resolution, format);
+
+		/* Reference file */
+		write_strided_frames(path, &config, resolution, format);
+
+		for (size_t b = 0; b < ARRAY_SIZE(backends); b++) {
+			for (int single = 0; single <= 1; single++) {
+				config.backend = backends[b];
+				config.flush = VRAW_WRITER_FLUSH_ON_DESTROY;
+				write_contiguous_frames(path_contiguous,
+							&config,
+							resolution,
+							format,
+							single,
+							&stats);
+				check_same_files(path, path_contiguous);
+
+				/* One call per frame or per plane */
+				if (backends[b] == VRAW_WRITER_BACKEND_STDIO) {
+					CU_ASSERT_EQUAL(
+						stats.io_calls,
+						single ? 3 : 3 * plane_count);
+				} else if (backends[b] ==
+					   VRAW_WRITER_BACKEND_PWRITEV) {
+					CU_ASSERT_EQUAL(stats.io_calls, 3);
+				}
+			}
+		}
+	}
+
+	unlink(path_contiguous);
+}
+
+
+/* Check the lines of a plane written by write_strided_frames() */
+static size_t check_plane_lines(const uint8_t *data,
+				size_t width,
+				size_t lines,
+				unsigned int seed)
+{
+	int errors = 0;
+
+	for (size_t h = 0; h < lines; h++) {
+		for (size_t j = 0; j < width; j++) {
+			size_t n = h * (width + 64) + j;
+			if (data[h * width + j] != (uint8_t)(n * 7 + seed))
+				errors++;
+		}
+	}
+	CU_ASSERT_EQUAL(errors, 0);
+
+	return width * lines;
+}
+
+
+static void test_vraw_writer_geometry(void)
+{
+	const char *path = "/tmp/vraw_test_writer_geometry.yuv";
+	const struct vdef_raw_format *formats[] = {
+		&vdef_nv21_10_packed,
+		&vdef_nv21_hisi_tile,
+		&vdef_nv21_hisi_tile_10_packed,
+	};
+	enum vraw_writer_backend backends[] = {
+		VRAW_WRITER_BACKEND_STDIO,
+		VRAW_WRITER_BACKEND_PWRITEV,
+		VRAW_WRITER_BACKEND_IO_URING,
+	};
+	for (size_t i = 0; i < ARRAY_SIZE(formats); i++) {
+		const struct vdef_raw_format *format = formats[i];
+		struct vraw_writer_config config = {0};
+		struct vraw_writer *writer = NULL;
+		struct vraw_frame frame = {0};
+		size_t stride[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+		size_t scanline[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+		size_t frame_size = 0;
+		unsigned int plane_count =
+			vdef_get_raw_frame_plane_count(format);
+		uint8_t *data;
+		FILE *f;
+		int ret;
+
+		fill_config(&config, VDEF_RESOLUTION_144P, format);
+		fill_frame(&frame, VDEF_RESOLUTION_144P, format);
+		vdef_calc_raw_frame_size(format,
+					 &frame.frame.info.resolution,
+					 stride,
+					 NULL,
+					 scanline,
+					 NULL,
+					 NULL,
+					 NULL);
+		for (unsigned int p = 0; p < plane_count; p++)
+			frame_size += stride[p] * scanline[p];
+		data = malloc(frame_size);
+
+		for (size_t b = 0; b < ARRAY_SIZE(backends); b++) {
+			config.backend = backends[b];
+			write_strided_frames(
+				path, &config, VDEF_RESOLUTION_144P, format);
+			CU_ASSERT_EQUAL(get_file_size(path), 3 * frame_size);
+
+			/* Lines from vdef_calc_raw_frame_size(), without the
+			 * row padding */
+			f = fopen(path, "rb");
+			CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+			for (unsigned int k = 0; k < 3; k++) {
+				size_t off = 0;
+				ret = fread(data, frame_size, 1, f);
+				CU_ASSERT_EQUAL(ret, 1);
+				for (unsigned int p = 0; p < plane_count; p++) {
+					off += check_plane_lines(data + off,
+								 stride[p],
+								 scanline[p],
+								 p + k);
+				}
+			}
+			fclose(f);
+		}
+
+		/* Rows shorter than the lines are rejected */
+		ret = vraw_writer_new(path, &config, &writer);
+		CU_ASSERT_EQUAL(ret, 0);
+		for (unsigned int p = 0; p < plane_count; p++)
+			frame.cdata[p] = data;
+		frame.frame.plane_stride[plane_count - 1] -= 1;
+		ret = vraw_writer_frame_write(writer, &frame);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		ret = vraw_writer_destroy(writer);
+		CU_ASSERT_EQUAL(ret, 0);
+
+		free(data);
+	}
+
+	unlink(path);
+}
+
+
+/* Write 3 frames with contiguous planes */
+static void write_frames(struct vraw_writer *writer,
+			 enum vdef_resolution resolution,
+			 const struct vdef_raw_format *format)
+{
+	int ret;
+	struct vraw_frame frame = {0};
+	uint8_t *frame_data = NULL;
+	size_t plane_size[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+	size_t frame_size = 0, offset = 0;
+
+	fill_frame(&frame, resolution, format);
+	vdef_calc_raw_frame_size(format,
+				 &frame.frame.info.resolution,
+				 NULL,
+				 NULL,
+				 NULL,
+				 NULL,
+				 plane_size,
+				 NULL);
+	for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++)
+		frame_size += plane_size[p];
+	frame_data = malloc(frame_size);
+	for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++) {
+		if (plane_size[p] == 0)
+			continue;
+		frame.cdata[p] = frame_data + offset;
+		offset += plane_size[p];
+	}
+
+	for (unsigned int k = 0; k < 3; k++) {
+		for (size_t j = 0; j < frame_size; j++)
+			frame_data[j] = (uint8_t)(j * 13 + k);
+		ret = vraw_writer_frame_write(writer, &frame);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	free(frame_data);
+}
+
+
+struct sink_ctx {
+	uint8_t *data;
+	size_t len;
+	unsigned int flush_count;
+};
+
+
+static int sink_write(struct vraw_writer *writer,
+		      const void *buf,
+		      size_t len,
+		      void *userdata)
+{
+	struct sink_ctx *ctx = userdata;
+	uint8_t *data = realloc(ctx->data, ctx->len + len);
+	if (data == NULL)
+		return -ENOMEM;
+	memcpy(data + ctx->len, buf, len);
+	ctx->data = data;
+	ctx->len += len;
+	return 0;
+}
+
+
+static int sink_flush(struct vraw_writer *writer, void *userdata)
+{
+	struct sink_ctx *ctx = userdata;
+	ctx->flush_count++;
+	return 0;
+}
+
+
+struct pipe_ctx {
+	int fd;
+	struct sink_ctx sink;
+};
+
+
+static void *pipe_read_thread(void *ptr)
+{
+	struct pipe_ctx *ctx = ptr;
+	uint8_t buf[4096];
+	ssize_t len;
+
+	/* Read slowly until the write end is closed, so that the writer
+	 * has to wait for its buffers to be consumed before reusing them */
+	while ((len = read(ctx->fd, buf, sizeof(buf))) > 0) {
+		(void)sink_write(NULL, buf, len, &ctx->sink);
+		usleep(1000);
+	}
+
+	return NULL;
+}
+
+
+static void check_same_data(const char *path, const uint8_t *data, size_t len)
+{
+	size_t size;
+	uint8_t *file_data = NULL;
+	FILE *file;
+
+	size = get_file_size(path);
+	CU_ASSERT_EQUAL(size, len);
+	CU_ASSERT_NOT_EQUAL(size, 0);
+	if ((size != len) || (size == 0))
+		return;
+
+	file_data = malloc(size);
+	file = fopen(path, "rb");
+	CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+	CU_ASSERT_EQUAL(fread(file_data, size, 1, file), 1);
+	(void)fclose(file);
+
+	CU_ASSERT_EQUAL(memcmp(file_data, data, size), 0);
+
+	free(file_data);
+}
+
+
+static void test_vraw_writer_fd_sink(void)
+{
+	const char *path_fd = "/tmp/vraw_test_writer_fd.yuv";
+	for (size_t i = 0; i < ARRAY_SIZE(s_assets_map); i++) {
+		for (int y4m = 0; y4m <= 1; y4m++) {
+			int ret = 0, fd;
+			struct vraw_writer *writer = NULL;
+			struct vraw_writer_config config = {0};
+			struct vraw_writer_sink sink = {0};
+			struct sink_ctx ctx = {0};
+			struct pipe_ctx pipe_ctx = {0};
+			int fds[2];
+			pthread_t thread;
+			enum vdef_resolution resolution =
+				s_assets_map[i].resolution;
+			const struct vdef_raw_format *format =
+				s_assets_map[i].format;
+
+			const char *path = get_path(format);
+			fill_config(&config, resolution, format);
+
+			/* y4m is only supported for I420 */
+			if (y4m && !vdef_raw_format_cmp(format, &vdef_i420))
+				continue;
+			config.y4m = y4m;
+
+			/* Reference file */
+			ret = vraw_writer_new(path, &config, &writer);
+			CU_ASSERT_EQUAL(ret, 0);
+			write_frames(writer, resolution, format);
+			ret = vraw_writer_destroy(writer);
+			CU_ASSERT_EQUAL(ret, 0);
+
+			/* invalid params */
+			ret = vraw_writer_new_from_fd(-1, &config, &writer);
+			CU_ASSERT_EQUAL(ret, -EINVAL);
+			ret = vraw_writer_new_sink(NULL, &config, &writer);
+			CU_ASSERT_EQUAL(ret, -EINVAL);
+			ret = vraw_writer_new_sink(&sink, &config, &writer);
+			CU_ASSERT_EQUAL(ret, -EINVAL);
+			sink.write = &sink_write;
+			sink.flush = &sink_flush;
+			sink.userdata = &ctx;
+			config.backend = VRAW_WRITER_BACKEND_PWRITEV;
+			ret = vraw_writer_new_sink(&sink, &config, &writer);
+			CU_ASSERT_EQUAL(ret, -EINVAL);
+			config.backend = VRAW_WRITER_BACKEND_STDIO;
+			config.segment_frames = 1;
+			ret = vraw_writer_new_sink(&sink, &config, &writer);
+			CU_ASSERT_EQUAL(ret, -EINVAL);
+			config.segment_frames = 0;
+
+			/* Regular file descriptor, with positional writes */
+			fd = open(path_fd, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			CU_ASSERT_FATAL(fd >= 0);
+			config.backend = VRAW_WRITER_BACKEND_DIRECT;
+			ret = vraw_writer_new_from_fd(fd, &config, &writer);
+			CU_ASSERT_EQUAL(ret, -EINVAL);
+			config.backend = VRAW_WRITER_BACKEND_PWRITEV;
+			ret = vraw_writer_new_from_fd(fd, &config, &writer);
+			CU_ASSERT_EQUAL(ret, 0);
+			write_frames(writer, resolution, format);
+			ret = vraw_writer_destroy(writer);
+			CU_ASSERT_EQUAL(ret, 0);
+			/* The file descriptor is not closed by the writer */
+			CU_ASSERT_EQUAL(close(fd), 0);
+			check_same_files(path, path_fd);
+
+			/* Sink */
+			config.backend = VRAW_WRITER_BACKEND_STDIO;
+			ret = vraw_writer_new_sink(&sink, &config, &writer);
+			CU_ASSERT_EQUAL(ret, 0);
+			write_frames(writer, resolution, format);
+			ret = vraw_writer_destroy(writer);
+			CU_ASSERT_EQUAL(ret, 0);
+			CU_ASSERT_EQUAL(ctx.flush_count, 4);
+			check_same_data(path, ctx.data, ctx.len);
+			free(ctx.data);
+
+			/* Pipe, with a small pipe size so that the writer
+			 * buffers are reused */
+			ret = pipe(fds);
+			CU_ASSERT_EQUAL_FATAL(ret, 0);
+			pipe_ctx.fd = fds[0];
+			ret = pthread_create(
+				&thread, NULL, &pipe_read_thread, &pipe_ctx);
+			CU_ASSERT_EQUAL_FATAL(ret, 0);
+			config.backend = VRAW_WRITER_BACKEND_PWRITEV;
+			ret = vraw_writer_new_from_fd(fds[1], &config, &writer);
+			CU_ASSERT_EQUAL(ret, -EINVAL);
+			config.backend = VRAW_WRITER_BACKEND_STDIO;
+			config.pipe_size = 16384;
+			config.flush = VRAW_WRITER_FLUSH_ON_DESTROY;
+			ret = vraw_writer_new_from_fd(fds[1], &config, &writer);
+			CU_ASSERT_EQUAL(ret, 0);
+			write_frames(writer, resolution, format);
+			ret = vraw_writer_destroy(writer);
+			CU_ASSERT_EQUAL(ret, 0);
+			close(fds[1]);
+			pthread_join(thread, NULL);
+			close(fds[0]);
+			check_same_data(
+				path, pipe_ctx.sink.data, pipe_ctx.sink.len);
+			free(pipe_ctx.sink.data);
+		}
+	}
+
+	unlink(path_fd);
+}
+
+
+struct async_ctx {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	unsigned int done_count;
+	unsigned int error_count;
+	bool hold;
+	bool holding;
+};
+
+
+static void async_frame_done(struct vraw_writer *writer,
+			     const struct vraw_frame *frame,
+			     int status,
+			     void *userdata)
+{
+	struct async_ctx *ctx = userdata;
+
+	pthread_mutex_lock(&ctx->mutex);
+	ctx->done_count++;
+	if (status != 0)
+		ctx->error_count++;
+	/* Block the writer thread until released */
+	ctx->holding = true;
+	pthread_cond_broadcast(&ctx->cond);
+	while (ctx->hold)
+		pthread_cond_wait(&ctx->cond, &ctx->mutex);
+	ctx->holding = false;
+	pthread_mutex_unlock(&ctx->mutex);
+}
+
+
+static void test_vraw_writer_async(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(s_assets_map); i++) {
+		int ret = 0;
+		struct vraw_writer *writer = NULL;
+		struct vraw_writer_config config = {0};
+		struct vraw_writer_stats stats = {0};
+		struct vraw_frame frame = {0};
+		struct async_ctx ctx = {0};
+		uint8_t *frame_data[20] = {0};
+		uint8_t *frame_data_in_file = NULL;
+		size_t frame_size;
+		FILE *file;
+		enum vdef_resolution resolution = s_assets_map[i].resolution;
+		const struct vdef_raw_format *format = s_assets_map[i].format;
+		size_t plane_size[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+
+		const char *path = get_path(format);
+		fill_config(&config, resolution, format);
+
+		vdef_calc_raw_frame_size(format,
+					 &config.info.resolution,
+					 NULL,
+					 NULL,
+					 NULL,
+					 NULL,
+					 plane_size,
+					 NULL);
+		frame_size = 0;
+		for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; ++p)
+			frame_size += plane_size[p];
+
+		pthread_mutex_init(&ctx.mutex, NULL);
+		pthread_cond_init(&ctx.cond, NULL);
+		frame_data_in_file = malloc(frame_size);
+		for (unsigned int k = 0; k < ARRAY_SIZE(frame_data); k++) {
+			frame_data[k] = malloc(frame_size);
+			memset(frame_data[k], k, frame_size);
+		}
+
+		/* invalid config: queue full policy */
+		config.queue_depth = 4;
+		config.queue_full = VRAW_WRITER_QUEUE_FULL_DROP + 1;
+		ret = vraw_writer_new(path, &config, &writer);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+
+		/* Blocking queue: all frames are written in order */
+		config.queue_full = VRAW_WRITER_QUEUE_FULL_BLOCK;
+		config.cbs.frame_done = &async_frame_done;
+		config.userdata = &ctx;
+		ret = vraw_writer_new(path, &config, &writer);
+		CU_ASSERT_EQUAL(ret, 0);
+
+		fill_frame(&frame, resolution, format);
+		for (unsigned int k = 0; k < ARRAY_SIZE(frame_data); k++) {
+			frame.cdata[0] = frame_data[k];
+			frame.cdata[1] = frame_data[k];
+			frame.cdata[2] = frame_data[k];
+			ret = vraw_writer_frame_write(writer, &frame);
+			CU_ASSERT_EQUAL(ret, 0);
+		}
+
+		ret = vraw_writer_get_stats(writer, &stats);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT(stats.queue_max_depth >= 1);
+		CU_ASSERT(stats.queue_max_depth <= config.queue_depth);
+		CU_ASSERT_EQUAL(stats.dropped, 0);
+
+		ret = vraw_writer_destroy(writer);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(ctx.done_count, ARRAY_SIZE(frame_data));
+		CU_ASSERT_EQUAL(ctx.error_count, 0);
+		CU_ASSERT_EQUAL(get_file_size(path),
+				ARRAY_SIZE(frame_data) * frame_size);
+
+		file = fopen(path, "rb");
+		CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+		for (unsigned int k = 0; k < ARRAY_SIZE(frame_data); k++) {
+			ret = fread(frame_data_in_file, frame_size, 1, file);
+			CU_ASSERT_EQUAL(ret, 1);
+			ret = memcmp(
+				frame_data_in_file, frame_data[k], frame_size);
+			CU_ASSERT_EQUAL(ret, 0);
+		}
+		(void)fclose(file);
+
+		/* Drop policy: hold the writer thread in the callback of
+		 * the first frame, then fill the queue */
+		ctx.done_count = 0;
+		ctx.hold = true;
+		config.queue_depth = 2;
+		config.queue_full = VRAW_WRITER_QUEUE_FULL_DROP;
+		ret = vraw_writer_new(path, &config, &writer);
+		CU_ASSERT_EQUAL(ret, 0);
+
+		frame.cdata[0] = frame_data[0];
+		frame.cdata[1] = frame_data[0];
+		frame.cdata[2] = frame_data[0];
+		ret = vraw_writer_frame_write(writer, &frame);
+		CU_ASSERT_EQUAL(ret, 0);
+
+		pthread_mutex_lock(&ctx.mutex);
+		while (!ctx.holding)
+			pthread_cond_wait(&ctx.cond, &ctx.mutex);
+		pthread_mutex_unlock(&ctx.mutex);
+
+		for (unsigned int k = 0; k < 3; k++) {
+			ret = vraw_writer_frame_write(writer, &frame);
+			CU_ASSERT_EQUAL(ret, (k < 2) ? 0 : -EAGAIN);
+		}
+
+		ret = vraw_writer_get_stats(writer, &stats);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(stats.frames, 1);
+		CU_ASSERT_EQUAL(stats.queue_depth, 2);
+		CU_ASSERT_EQUAL(stats.queue_max_depth, 2);
+		CU_ASSERT_EQUAL(stats.dropped, 1);
+
+		pthread_mutex_lock(&ctx.mutex);
+		ctx.hold = false;
+		pthread_cond_broadcast(&ctx.cond);
+		pthread_mutex_unlock(&ctx.mutex);
+
+		ret = vraw_writer_destroy(writer);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(ctx.done_count, 3);
+		CU_ASSERT_EQUAL(get_file_size(path), 3 * frame_size);
+
+		for (unsigned int k = 0; k < ARRAY_SIZE(frame_data); k++)
+			free(frame_data[k]);
+		free(frame_data_in_file);
+		pthread_cond_destroy(&ctx.cond);
+		pthread_mutex_destroy(&ctx.mutex);
+	}
+}
+
+
+static void test_vraw_writer_io_uring(void)
+{
+	const char *path_uring = "/tmp/vraw_test_writer_io_uring.yuv";
+	for (size_t i = 0; i < ARRAY_SIZE(s_assets_map); i++) {
+		for (int y4m = 0; y4m <= 1; y4m++) {
+			int ret = 0;
+			struct vraw_writer *writer = NULL;
+			struct vraw_writer_config config = {0};
+			struct vraw_writer_stats stats = {0};
+			struct vraw_frame frame = {0};
+			enum vdef_resolution resolution =
+				s_assets_map[i].resolution;
+			const struct vdef_raw_format *format =
+				s_assets_map[i].format;
+			uint8_t *frame_data = NULL;
+			size_t frame_size;
+			size_t plane_size[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+
+			const char *path = get_path(format);
+			fill_config(&config, resolution, format);
+
+			/* y4m is only supported for I420 */
+			if (y4m && !vdef_raw_format_cmp(format, &vdef_i420))
+				continue;
+			config.y4m = y4m;
+
+			/* Synchronous writes, compared to stdio */
+			config.backend = VRAW_WRITER_BACKEND_STDIO;
+			write_strided_frames(path, &config, resolution, format);
+
+			config.backend = VRAW_WRITER_BACKEND_IO_URING;
+			write_strided_frames(
+				path_uring, &config, resolution, format);
+
+			check_same_files(path, path_uring);
+
+			/* Not available with other backends */
+			config.backend = VRAW_WRITER_BACKEND_STDIO;
+			ret = vraw_writer_new(path, &config, &writer);
+			CU_ASSERT_EQUAL(ret, 0);
+			fill_frame(&frame, resolution, format);
+			ret = vraw_writer_frame_submit(writer, &frame);
+			CU_ASSERT_EQUAL(ret, -EPROTO);
+			ret = vraw_writer_frame_complete(writer, 1);
+			CU_ASSERT_EQUAL(ret, -EPROTO);
+			(void)vraw_writer_destroy(writer);
+
+			/* Submit/complete */
+			vdef_calc_raw_frame_size(format,
+						 &config.info.resolution,
+						 NULL,
+						 NULL,
+						 NULL,
+						 NULL,
+						 plane_size,
+						 NULL);
+			frame_size = 0;
+			for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT;
+			     ++p)
+				frame_size += plane_size[p];
+			frame_data = calloc(1, frame_size);
+			frame.cdata[0] = frame_data;
+			frame.cdata[1] = frame_data;
+			frame.cdata[2] = frame_data;
+
+			config.backend = VRAW_WRITER_BACKEND_IO_URING;
+			config.uring_depth = 3;
+			ret = vraw_writer_new(path_uring, &config, &writer);
+			CU_ASSERT_EQUAL(ret, 0);
+
+			/* Fallback to pwritev if io_uring is not available */
+			ret = vraw_writer_frame_complete(writer, 0);
+			if (ret == -EPROTO) {
+				(void)vraw_writer_destroy(writer);
+				free(frame_data);
+				continue;
+			}
+			CU_ASSERT_EQUAL(ret, 0);
+
+			for (unsigned int k = 0; k < 3; k++) {
+				ret = vraw_writer_frame_submit(writer, &frame);
+				CU_ASSERT_EQUAL(ret, 0);
+			}
+			ret = vraw_writer_frame_submit(writer, &frame);
+			CU_ASSERT_EQUAL(ret, -EAGAIN);
+
+			ret = vraw_writer_frame_complete(writer, 3);
+			CU_ASSERT_EQUAL(ret, 3);
+			ret = vraw_writer_frame_complete(writer, 1);
+			CU_ASSERT_EQUAL(ret, 0);
+
+			/* Mixed with synchronous writes */
+			ret = vraw_writer_frame_submit(writer, &frame);
+			CU_ASSERT_EQUAL(ret, 0);
+			ret = vraw_writer_frame_write(writer, &frame);
+			CU_ASSERT_EQUAL(ret, 0);
+
+			ret = vraw_writer_get_stats(writer, &stats);
+			CU_ASSERT_EQUAL(ret, 0);
+			CU_ASSERT_EQUAL(stats.frames, 5);
+
+			ret = vraw_writer_destroy(writer);
+			CU_ASSERT_EQUAL(ret, 0);
+			CU_ASSERT_EQUAL(get_file_size(path_uring), stats.bytes);
+			if (!y4m)
+				CU_ASSERT_EQUAL(stats.bytes, 5 * frame_size);
+
+			free(frame_data);
+		}
+	}
+
+	unlink(path_uring);
+}
+
+
+static void test_vraw_writer_direct(void)
+{
+	const char *path_direct = "/tmp/vraw_test_writer_direct.yuv";
+	for (size_t i = 0; i < ARRAY_SIZE(s_assets_map); i++) {
+		for (int y4m = 0; y4m <= 1; y4m++) {
+			struct vraw_writer_config config = {0};
+			enum vdef_resolution resolution =
+				s_assets_map[i].resolution;
+			const struct vdef_raw_format *format =
+				s_assets_map[i].format;
+
+			const char *path = get_path(format);
+			fill_config(&config, resolution, format);
+
+			/* y4m is only supported for I420 */
+			if (y4m && !vdef_raw_format_cmp(format, &vdef_i420))
+				continue;
+			config.y4m = y4m;
+
+			/* Reference file */
+			config.backend = VRAW_WRITER_BACKEND_STDIO;
+			write_strided_frames(path, &config, resolution, format);
+
+			/* Default staging buffer, flush every frame */
+			config.backend = VRAW_WRITER_BACKEND_DIRECT;
+			write_strided_frames(
+				path_direct, &config, resolution, format);
+			check_same_files(path, path_direct);
+
+			/* Staging buffer larger than the file, flush on
+			 * destroy */
+			config.flush = VRAW_WRITER_FLUSH_ON_DESTROY;
+			config.buffer_size = 1024 * 1024;
+			write_strided_frames(
+				path_direct, &config, resolution, format);
+			check_same_files(path, path_direct);
+
+			/* Staging buffer smaller than a frame, flush every
+			 * 2 frames */
+			config.flush = VRAW_WRITER_FLUSH_EVERY_N_FRAMES;
+			config.flush_frames = 2;
+			config.buffer_size = 4096;
+			write_strided_frames(
+				path_direct, &config, resolution, format);
+			check_same_files(path, path_direct);
+		}
+	}
+
+	unlink(path_direct);
+}
+
+
+static size_t get_file_allocated_size(const char *path)
+{
+	struct stat st;
+	int ret = stat(path, &st);
+	CU_ASSERT_EQUAL(ret, 0);
+	return (ret == 0) ? (size_t)st.st_blocks * 512 : 0;
+}
+
+
+static void test_vraw_writer_prealloc(void)
+{
+	const char *path_prealloc = "/tmp/vraw_test_writer_prealloc.yuv";
+	enum vraw_writer_backend backends[] = {
+		VRAW_WRITER_BACKEND_STDIO,
+		VRAW_WRITER_BACKEND_PWRITEV,
+		VRAW_WRITER_BACKEND_IO_URING,
+		VRAW_WRITER_BACKEND_DIRECT,
+	};
+	for (size_t i = 0; i < ARRAY_SIZE(s_assets_map); i++) {
+		int ret = 0;
+		struct vraw_writer *writer = NULL;
+		struct vraw_writer_config config = {0};
+		struct vraw_frame frame = {0};
+		enum vdef_resolution resolution = s_assets_map[i].resolution;
+		const struct vdef_raw_format *format = s_assets_map[i].format;
+		uint8_t *frame_data = NULL;
+		size_t frame_size;
+		size_t plane_size[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+
+		const char *path = get_path(format);
+		fill_config(&config, resolution, format);
+
+		vdef_calc_raw_frame_size(format,
+					 &config.info.resolution,
+					 NULL,
+					 NULL,
+					 NULL,
+					 NULL,
+					 plane_size,
+					 NULL);
+		frame_size = 0;
+		for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; ++p)
+			frame_size += plane_size[p];
+		frame_data = calloc(1, frame_size);
+
+		/* The space is allocated up front, the file size is the
+		 * size of the data, and the unused space is released */
+		config.expected_frame_count = 20;
+		ret = vraw_writer_new(path_prealloc, &config, &writer);
+		CU_ASSERT_EQUAL(ret, 0);
+		fill_frame(&frame, resolution, format);
+		frame.cdata[0] = frame_data;
+		frame.cdata[1] = frame_data;
+		frame.cdata[2] = frame_data;
+		for (unsigned int k = 0; k < 2; k++) {
+			ret = vraw_writer_frame_write(writer, &frame);
+			CU_ASSERT_EQUAL(ret, 0);
+		}
+		CU_ASSERT_EQUAL(get_file_size(path_prealloc), 2 * frame_size);
+		CU_ASSERT(get_file_allocated_size(path_prealloc) >=
+			  20 * frame_size);
+		ret = vraw_writer_destroy(writer);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(get_file_size(path_prealloc), 2 * frame_size);
+		CU_ASSERT(get_file_allocated_size(path_prealloc) <
+			  20 * frame_size);
+
+		/* Expectations exceeded, with all backends */
+		config.expected_frame_count = 0;
+		config.expected_bytes = frame_size;
+		for (size_t j = 0; j < ARRAY_SIZE(backends); j++) {
+			for (int y4m = 0; y4m <= 1; y4m++) {
+				/* y4m is only supported for I420 */
+				if (y4m &&
+				    !vdef_raw_format_cmp(format, &vdef_i420))
+					continue;
+				config.y4m = y4m;
+				config.backend = VRAW_WRITER_BACKEND_STDIO;
+				config.expected_bytes = 0;
+				write_strided_frames(
+					path, &config, resolution, format);
+				config.backend = backends[j];
+				config.expected_bytes = frame_size;
+				write_strided_frames(path_prealloc,
+						     &config,
+						     resolution,
+						     format);
+				check_same_files(path, path_prealloc);
+			}
+		}
+
+		free(frame_data);
+	}
+
+	unlink(path_prealloc);
+}
+
+
+static void test_vraw_writer_ring(void)
+{
+	const char *path_ring = "/tmp/vraw_test_writer_ring.yuv";
+	enum vraw_writer_backend backends[] = {
+		VRAW_WRITER_BACKEND_STDIO,
+		VRAW_WRITER_BACKEND_PWRITEV,
+	};
+	/* Written frame counts, for 4 slots */
+	unsigned int counts[] = {6, 2};
+	for (size_t i = 0; i < ARRAY_SIZE(s_assets_map); i++) {
+		int ret = 0;
+		struct vraw_writer *writer = NULL;
+		struct vraw_writer_config config = {0};
+		struct vraw_reader *reader = NULL;
+		struct vraw_reader_config reader_config = {0};
+		struct vraw_frame frame = {0};
+		enum vdef_resolution resolution = s_assets_map[i].resolution;
+		const struct vdef_raw_format *format = s_assets_map[i].format;
+		uint8_t *frame_data = NULL, *read_data = NULL;
+		size_t frame_size;
+		ssize_t read_size;
+		size_t plane_size[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+
+		fill_config(&config, resolution, format);
+
+		vdef_calc_raw_frame_size(format,
+					 &config.info.resolution,
+					 NULL,
+					 NULL,
+					 NULL,
+					 NULL,
+					 plane_size,
+					 NULL);
+		frame_size = 0;
+		for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; ++p)
+			frame_size += plane_size[p];
+		frame_data = calloc(1, frame_size);
+
+		/* Invalid configurations */
+		config.ring_slots = 4;
+		config.y4m = 1;
+		ret = vraw_writer_new(path_ring, &config, &writer);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		config.y4m = 0;
+		config.backend = VRAW_WRITER_BACKEND_IO_URING;
+		ret = vraw_writer_new(path_ring, &config, &writer);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+
+		reader_config.ring = 1;
+		reader_config.format = *format;
+		reader_config.info.resolution = config.info.resolution;
+
+		for (size_t j = 0; j < ARRAY_SIZE(backends); j++) {
+			/* Written frame k is filled with k */
+			for (size_t c = 0; c < ARRAY_SIZE(counts); c++) {
+				unsigned int n = counts[c];
+				unsigned int first = (n > 4) ? n - 4 : 0;
+
+				config.backend = backends[j];
+				ret = vraw_writer_new(
+					path_ring, &config, &writer);
+				CU_ASSERT_EQUAL(ret, 0);
+				if (ret != 0)
+					break;
+				CU_ASSERT_EQUAL(get_file_size(path_ring),
+						4 * frame_size + 32 + 4 * 8);
+				fill_frame(&frame, resolution, format);
+				frame.cdata[0] = frame_data;
+				frame.cdata[1] = frame_data;
+				frame.cdata[2] = frame_data;
+				for (unsigned int k = 0; k < n; k++) {
+					memset(frame_data, k, frame_size);
+					frame.frame.info.timestamp = k * 33333;
+					ret = vraw_writer_frame_write(writer,
+								      &frame);
+					CU_ASSERT_EQUAL(ret, 0);
+				}
+				ret = vraw_writer_destroy(writer);
+				CU_ASSERT_EQUAL(ret, 0);
+				CU_ASSERT_EQUAL(get_file_size(path_ring),
+						4 * frame_size + 32 + 4 * 8);
+
+				/* The frames are read from the oldest one */
+				ret = vraw_reader_new(
+					path_ring, &reader_config, &reader);
+				CU_ASSERT_EQUAL(ret, 0);
+				if (ret != 0)
+					break;
+				CU_ASSERT_EQUAL(
+					vraw_reader_get_file_frame_count(
+						reader),
+					n - first);
+				read_size =
+					vraw_reader_get_min_buf_size(reader);
+				read_data = malloc(read_size);
+				for (unsigned int k = first; k < n; k++) {
+					ret = vraw_reader_frame_read(reader,
+								     read_data,
+								     read_size,
+								     &frame);
+					CU_ASSERT_EQUAL(ret, 0);
+					if (ret != 0)
+						break;
+					CU_ASSERT_EQUAL(frame.cdata[0][0], k);
+					CU_ASSERT_EQUAL(
+						read_data[read_size - 1], k);
+					CU_ASSERT_EQUAL(
+						frame.frame.info.timestamp,
+						k * 33333);
+				}
+				ret = vraw_reader_frame_read(
+					reader, read_data, read_size, &frame);
+				CU_ASSERT_EQUAL(ret, -ENOENT);
+				free(read_data);
+				ret = vraw_reader_destroy(reader);
+				CU_ASSERT_EQUAL(ret, 0);
+			}
+		}
+
+		/* Not a ring file */
+		config.ring_slots = 0;
+		config.backend = VRAW_WRITER_BACKEND_STDIO;
+		write_strided_frames(path_ring, &config, resolution, format);
+		ret = vraw_reader_new(path_ring, &reader_config, &reader);
+		CU_ASSERT_EQUAL(ret, -EPROTO);
+
+		free(frame_data);
+	}
+
+	unlink(path_ring);
+}
+
+
+#define SEGMENT_PATH "/tmp/vraw_test_writer_seg_"
+
+
+static void segment_files_remove(void)
+{
+	char path[64];
+
+	for (unsigned int k = 0; k < 4; k++) {
+		snprintf(path, sizeof(path), SEGMENT_PATH "%02u.yuv", k);
+		unlink(path);
+		snprintf(path, sizeof(path), SEGMENT_PATH "%02u.y4m", k);
+		unlink(path);
+	}
+}
+
+
+static void write_read_segments(struct vraw_writer_config *config,
+				enum vdef_resolution resolution,
+				const struct vdef_raw_format *format,
+				size_t frame_size)
+{
+	int ret;
+	struct vraw_writer *writer = NULL;
+	struct vraw_writer_stats stats = {0};
+	struct vraw_reader *reader = NULL;
+	struct vraw_reader_config reader_config = {0};
+	struct vraw_frame frame = {0};
+	uint8_t *frame_data = NULL, *read_data = NULL;
+	ssize_t read_size;
+	const char *ext = config->y4m ? "y4m" : "yuv";
+	char pattern[64], path[64];
+
+	segment_files_remove();
+
+	/* Written frame k is filled with k */
+	snprintf(pattern, sizeof(pattern), SEGMENT_PATH "%%02u.%s", ext);
+	ret = vraw_writer_new(pattern, config, &writer);
+	CU_ASSERT_EQUAL(ret, 0);
+	if (ret != 0)
+		return;
+	frame_data = calloc(1, frame_size);
+	fill_frame(&frame, resolution, format);
+	frame.cdata[0] = frame_data;
+	frame.cdata[1] = frame_data;
+	frame.cdata[2] = frame_data;
+	for (unsigned int k = 0; k < 5; k++) {
+		memset(frame_data, k, frame_size);
+		frame.frame.info.timestamp = k * 50000;
+		ret = vraw_writer_frame_write(writer, &frame);
+		CU_ASSERT_EQUAL(ret, 0);
+		/* The frame buffer is reused: wait for the writer thread
+		 * (asynchronous mode) */
+		ret = vraw_writer_get_stats(writer, &stats);
+		CU_ASSERT_EQUAL(ret, 0);
+		while (stats.queue_depth > 0) {
+			usleep(1000);
+			ret = vraw_writer_get_stats(writer, &stats);
+			CU_ASSERT_EQUAL(ret, 0);
+		}
+	}
+	CU_ASSERT_EQUAL(stats.frames, 5);
+	CU_ASSERT_EQUAL(stats.segments, 2);
+	ret = vraw_writer_destroy(writer);
+	CU_ASSERT_EQUAL(ret, 0);
+	free(frame_data);
+
+	/* 2 frames per segment; the pre-created next segment is removed */
+	if (!config->y4m) {
+		CU_ASSERT_EQUAL(get_file_size(SEGMENT_PATH "00.yuv"),
+				2 * frame_size);
+		CU_ASSERT_EQUAL(get_file_size(SEGMENT_PATH "02.yuv"),
+				frame_size);
+	}
+	snprintf(path, sizeof(path), SEGMENT_PATH "03.%s", ext);
+	CU_ASSERT_NOT_EQUAL(access(path, F_OK), 0);
+
+	/* Each segment is a valid file */
+	snprintf(pattern, sizeof(pattern), SEGMENT_PATH "*.%s", ext);
+	reader_config.y4m = config->y4m;
+	reader_config.format = *format;
+	reader_config.info.resolution = config->info.resolution;
+	ret = vraw_reader_new_glob(pattern, &reader_config, &reader);
+	CU_ASSERT_EQUAL(ret, 0);
+	if (ret != 0)
+		return;
+	CU_ASSERT_EQUAL(vraw_reader_get_file_frame_count(reader), 5);
+	read_size = vraw_reader_get_min_buf_size(reader);
+	read_data = malloc(read_size);
+	for (unsigned int k = 0; k < 5; k++) {
+		ret = vraw_reader_frame_read(
+			reader, read_data, read_size, &frame);
+		CU_ASSERT_EQUAL(ret, 0);
+		if (ret != 0)
+			break;
+		CU_ASSERT_EQUAL(frame.cdata[0][0], k);
+	}
+	free(read_data);
+	ret = vraw_reader_destroy(reader);
+	CU_ASSERT_EQUAL(ret, 0);
+}
+
+
+static void test_vraw_writer_segments(void)
+{
+	enum vraw_writer_backend backends[] = {
+		VRAW_WRITER_BACKEND_STDIO,
+		VRAW_WRITER_BACKEND_PWRITEV,
+		VRAW_WRITER_BACKEND_IO_URING,
+		VRAW_WRITER_BACKEND_DIRECT,
+	};
+	for (size_t i = 0; i < ARRAY_SIZE(s_assets_map); i++) {
+		int ret = 0;
+		struct vraw_writer *writer = NULL;
+		struct vraw_writer_config config = {0};
+		enum vdef_resolution resolution = s_assets_map[i].resolution;
+		const struct vdef_raw_format *format = s_assets_map[i].format;
+		size_t frame_size;
+		size_t plane_size[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+		bool uring;
+
+		fill_config(&config, resolution, format);
+
+		vdef_calc_raw_frame_size(format,
+					 &config.info.resolution,
+					 NULL,
+					 NULL,
+					 NULL,
+					 NULL,
+					 plane_size,
+					 NULL);
+		frame_size = 0;
+		for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; ++p)
+			frame_size += plane_size[p];
+
+		/* Invalid patterns and configurations */
+		config.segment_frames = 2;
+		ret = vraw_writer_new(SEGMENT_PATH ".yuv", &config, &writer);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		ret = vraw_writer_new(SEGMENT_PATH "%s.yuv", &config, &writer);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		ret = vraw_writer_new(
+			SEGMENT_PATH "%u_%u.yuv", &config, &writer);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		config.ring_slots = 4;
+		ret = vraw_writer_new(
+			SEGMENT_PATH "%02u.yuv", &config, &writer);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		config.ring_slots = 0;
+
+		/* Rotation every 2 frames by frame count, size or duration
+		 * (50 ms between frames), 5 frames thus give 3 segments */
+		for (size_t j = 0; j < ARRAY_SIZE(backends); j++) {
+			config.backend = backends[j];
+			config.segment_frames = 2;
+			write_read_segments(
+				&config, resolution, format, frame_size);
+			if (vdef_raw_format_cmp(format, &vdef_i420)) {
+				config.y4m = 1;
+				write_read_segments(&config,
+						    resolution,
+						    format,
+						    frame_size);
+				config.y4m = 0;
+			}
+			config.segment_frames = 0;
+			config.segment_bytes = 2 * frame_size + 1;
+			write_read_segments(
+				&config, resolution, format, frame_size);
+			config.segment_bytes = 0;
+			config.segment_duration_us = 100000;
+			write_read_segments(
+				&config, resolution, format, frame_size);
+			config.segment_duration_us = 0;
+		}
+
+		/* Asynchronous mode */
+		config.backend = VRAW_WRITER_BACKEND_PWRITEV;
+		config.queue_depth = 4;
+		config.segment_frames = 2;
+		write_read_segments(&config, resolution, format, frame_size);
+		config.segment_frames = 0;
+		config.queue_depth = 0;
+
+		/* Submissions refused because all the io_uring slots are
+		 * busy are not counted in the segments */
+		config.backend = VRAW_WRITER_BACKEND_IO_URING;
+		config.uring_depth = 1;
+		config.segment_frames = 2;
+		segment_files_remove();
+		ret = vraw_writer_new(
+			SEGMENT_PATH "%02u.yuv", &config, &writer);
+		CU_ASSERT_EQUAL_FATAL(ret, 0);
+		/* Fallback to pwritev if io_uring is not available */
+		uring = (vraw_writer_frame_complete(writer, 0) == 0);
+		if (uring) {
+			struct vraw_frame frame = {0};
+			uint8_t *frame_data = calloc(1, frame_size);
+			fill_frame(&frame, resolution, format);
+			frame.cdata[0] = frame_data;
+			frame.cdata[1] = frame_data;
+			frame.cdata[2] = frame_data;
+			for (unsigned int k = 0; k < 3; k++) {
+				ret = vraw_writer_frame_submit(writer, &frame);
+				CU_ASSERT_EQUAL(ret, 0);
+				ret = vraw_writer_frame_submit(writer, &frame);
+				CU_ASSERT_EQUAL(ret, -EAGAIN);
+				ret = vraw_writer_frame_complete(writer, 1);
+				CU_ASSERT_EQUAL(ret, 1);
+			}
+			free(frame_data);
+		}
+		ret = vraw_writer_destroy(writer);
+		CU_ASSERT_EQUAL(ret, 0);
+		if (uring) {
+			CU_ASSERT_EQUAL(get_file_size(SEGMENT_PATH "00.yuv"),
+					2 * frame_size);
+		}
+		config.segment_frames = 0;
+		config.uring_depth = 0;
+	}
+
+	segment_files_remove();
+}
+
+
+#define COMPRESSED_PATH "/tmp/vraw_test_writer_compressed.bin"
+
+
+static void check_compressed_frames(struct vraw_reader_config *config,
+				    const uint8_t *const *frames,
+				    const size_t *plane_size,
+				    unsigned int count)
+{
+	int ret;
+	struct vraw_reader *reader = NULL;
+	struct vraw_frame frame = {0};
+	uint8_t *read_data = NULL;
+	ssize_t read_size;
+	/* Bounce with loop = -1: 0, 1, ..., count - 1, count - 2, ... */
+	unsigned int expected;
+
+	ret = vraw_reader_new(COMPRESSED_PATH, config, &reader);
+	CU_ASSERT_EQUAL(ret, 0);
+	if (ret != 0)
+		return;
+	CU_ASSERT_EQUAL(vraw_reader_get_file_frame_count(reader), count);
+	read_size = vraw_reader_get_min_buf_size(reader);
+	read_data = malloc(read_size);
+	for (unsigned int k = 0; k < 2 * count - 1; k++) {
+		ret = vraw_reader_frame_read(
+			reader, read_data, read_size, &frame);
+		CU_ASSERT_EQUAL(ret, 0);
+		if (ret != 0)
+			break;
+		expected = (k < count) ? k : 2 * count - 2 - k;
+		for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++) {
+			if (frame.cdata[p] == NULL)
+				continue;
+			CU_ASSERT_EQUAL(memcmp(frame.cdata[p],
+					       frames[expected],
+					       plane_size[p]),
+					0);
+		}
+	}
+	free(read_data);
+	ret = vraw_reader_destroy(reader);
+	CU_ASSERT_EQUAL(ret, 0);
+}
+
+
+static void test_vraw_writer_compression(void)
+{
+	struct {
+		enum vdef_resolution resolution;
+		const struct vdef_raw_format *format;
+	} formats[ARRAY_SIZE(s_assets_map) + 1];
+	for (size_t i = 0; i < ARRAY_SIZE(s_assets_map); i++) {
+		formats[i].resolution = s_assets_map[i].resolution;
+		formats[i].format = s_assets_map[i].format;
+	}
+	/* 16-bit samples are byte-shuffled */
+	formats[ARRAY_SIZE(s_assets_map)].resolution = VDEF_RESOLUTION_144P;
+	formats[ARRAY_SIZE(s_assets_map)].format = &vdef_i420_10_16le;
+
+	for (size_t i = 0; i < ARRAY_SIZE(formats); i++) {
+		int ret = 0;
+		struct vraw_writer *writer = NULL;
+		struct vraw_writer_config config = {0};
+		struct vraw_writer_stats stats = {0};
+		struct vraw_reader_config reader_config = {0};
+		struct vraw_frame frame = {0};
+		enum vdef_resolution resolution = formats[i].resolution;
+		const struct vdef_raw_format *format = formats[i].format;
+		uint8_t *frames[5] = {0};
+		size_t frame_size, file_size;
+		size_t plane_size[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+
+		fill_config(&config, resolution, format);
+
+		vdef_calc_raw_frame_size(format,
+					 &config.info.resolution,
+					 NULL,
+					 NULL,
+					 NULL,
+					 NULL,
+					 plane_size,
+					 NULL);
+		frame_size = 0;
+		for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; ++p)
+			frame_size += plane_size[p];
+
+		/* Compressible frames: slow ramps of 10-bit samples, frame
+		 * k starting at 7 * k */
+		for (unsigned int k = 0; k < ARRAY_SIZE(frames); k++) {
+			frames[k] = malloc(frame_size);
+			for (size_t j = 0; j < frame_size; j++) {
+				if (format->data_size == 16) {
+					uint16_t v = (j / 8 + 7 * k) & 0x3ff;
+					frames[k][j] = (j & 1) ? v >> 8 : v;
+				} else {
+					frames[k][j] = (j / 4 + 7 * k) & 0xff;
+				}
+			}
+		}
+
+		/* Invalid configurations */
+		config.compression = VRAW_COMPRESSION_LZ4 + 1;
+		ret = vraw_writer_new(COMPRESSED_PATH, &config, &writer);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		config.compression = VRAW_COMPRESSION_LZ4;
+		config.backend = VRAW_WRITER_BACKEND_DIRECT;
+		ret = vraw_writer_new(COMPRESSED_PATH, &config, &writer);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		config.backend = VRAW_WRITER_BACKEND_STDIO;
+		config.ring_slots = 4;
+		ret = vraw_writer_new(COMPRESSED_PATH, &config, &writer);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		config.ring_slots = 0;
+		reader_config.compressed = 1;
+		reader_config.y4m = 1;
+		ret = vraw_reader_new(COMPRESSED_PATH, &reader_config, NULL);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		reader_config.y4m = 0;
+		reader_config.format = *format;
+		reader_config.info.resolution = config.info.resolution;
+		reader_config.loop = -1;
+
+		for (unsigned int threads = 1; threads <= 3; threads += 2) {
+			config.compression_threads = threads;
+			ret = vraw_writer_new(
+				COMPRESSED_PATH, &config, &writer);
+			CU_ASSERT_EQUAL(ret, 0);
+			if (ret != 0)
+				continue;
+			for (unsigned int k = 0; k < ARRAY_SIZE(frames); k++) {
+				fill_frame(&frame, resolution, format);
+				frame.cdata[0] = frames[k];
+				frame.cdata[1] = frames[k];
+				frame.cdata[2] = frames[k];
+				ret = vraw_writer_frame_write(writer, &frame);
+				CU_ASSERT_EQUAL(ret, 0);
+			}
+			ret = vraw_writer_get_stats(writer, &stats);
+			CU_ASSERT_EQUAL(ret, 0);
+			CU_ASSERT(stats.bytes <
+				  ARRAY_SIZE(frames) * frame_size);
+			ret = vraw_writer_destroy(writer);
+			CU_ASSERT_EQUAL(ret, 0);
+
+			/* Random access through the frame table */
+			check_compressed_frames(&reader_config,
+						(const uint8_t *const *)frames,
+						plane_size,
+						ARRAY_SIZE(frames));
+		}
+
+		/* Without the frame table (e.g. after a crash) the frames
+		 * are found by scanning the file, an incomplete frame is
+		 * ignored */
+		file_size = get_file_size(COMPRESSED_PATH);
+		ret = truncate(COMPRESSED_PATH,
+			       file_size - 24 - 16 * ARRAY_SIZE(frames) - 1);
+		CU_ASSERT_EQUAL(ret, 0);
+		check_compressed_frames(&reader_config,
+					(const uint8_t *const *)frames,
+					plane_size,
+					ARRAY_SIZE(frames) - 1);
+
+		for (unsigned int k = 0; k < ARRAY_SIZE(frames); k++)
+			free(frames[k]);
+	}
+
+	unlink(COMPRESSED_PATH);
+}
+
+
+#define DELTA_FRAMES 12
+#define DELTA_KEYFRAME_INTERVAL 4
+
+
+static size_t write_delta_frames(struct vraw_writer_config *config,
+				 enum vdef_resolution resolution,
+				 uint8_t *const *frames)
+{
+	int ret;
+	struct vraw_writer *writer = NULL;
+	struct vraw_writer_stats stats = {0};
+	struct vraw_frame frame = {0};
+
+	ret = vraw_writer_new(COMPRESSED_PATH, config, &writer);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	for (unsigned int k = 0; k < DELTA_FRAMES; k++) {
+		fill_frame(&frame, resolution, &config->format);
+		frame.cdata[0] = frames[k];
+		frame.cdata[1] = frames[k];
+		frame.cdata[2] = frames[k];
+		ret = vraw_writer_frame_write(writer, &frame);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	ret = vraw_writer_get_stats(writer, &stats);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = vraw_writer_destroy(writer);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	return stats.bytes;
+}
+
+
+static void test_vraw_writer_delta(void)
+{
+	const struct vdef_raw_format *formats[] = {
+		&vdef_i420,
+		/* 16-bit samples are byte-shuffled after the delta */
+		&vdef_i420_10_16le,
+	};
+	/* Random access order, through the keyframe table */
+	unsigned int order[] = {7, 2, 11, 5, 4, 0, 6, 6, 10};
+
+	for (size_t i = 0; i < ARRAY_SIZE(formats); i++) {
+		int ret = 0;
+		struct vraw_writer *writer = NULL;
+		struct vraw_writer_config config = {0};
+		struct vraw_reader *reader = NULL;
+		struct vraw_reader_config reader_config = {0};
+		struct vraw_frame frame = {0};
+		const struct vdef_raw_format *format = formats[i];
+		uint8_t *frames[DELTA_FRAMES] = {0}, *read_data;
+		size_t frame_size = 0, full_size, delta_size, file_size;
+		size_t plane_size[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+		ssize_t read_size;
+		uint32_t seed = 1;
+
+		fill_config(&config, VDEF_RESOLUTION_144P, format);
+		vdef_calc_raw_frame_size(format,
+					 &config.info.resolution,
+					 NULL,
+					 NULL,
+					 NULL,
+					 NULL,
+					 plane_size,
+					 NULL);
+		for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; ++p)
+			frame_size += plane_size[p];
+
+		/* Static scene: a noisy background which does not compress
+		 * on its own, with a few samples changing in each frame */
+		for (unsigned int k = 0; k < DELTA_FRAMES; k++) {
+			frames[k] = malloc(frame_size);
+			CU_ASSERT_PTR_NOT_NULL_FATAL(frames[k]);
+			if (k == 0) {
+				for (size_t j = 0; j < frame_size; j++) {
+					seed = seed * 1103515245 + 12345;
+					frames[k][j] = seed >> 16;
+				}
+			} else {
+				memcpy(frames[k], frames[k - 1], frame_size);
+			}
+			for (size_t j = 0; j < 64; j++) {
+				seed = seed * 1103515245 + 12345;
+				frames[k][(seed >> 8) % frame_size] ^= k;
+			}
+		}
+
+		/* Only with a compression codec */
+		config.keyframe_interval = DELTA_KEYFRAME_INTERVAL;
+		ret = vraw_writer_new(COMPRESSED_PATH, &config, &writer);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+
+		config.compression = VRAW_COMPRESSION_LZ4;
+		config.keyframe_interval = 0;
+		full_size = write_delta_frames(
+			&config, VDEF_RESOLUTION_144P, frames);
+
+		reader_config.compressed = 1;
+		reader_config.format = *format;
+		reader_config.info.resolution = config.info.resolution;
+		reader_config.loop = -1;
+
+		for (unsigned int threads = 1; threads <= 3; threads += 2) {
+			config.compression_threads = threads;
+			config.keyframe_interval = DELTA_KEYFRAME_INTERVAL;
+			delta_size = write_delta_frames(
+				&config, VDEF_RESOLUTION_144P, frames);
+			/* Only the keyframes take space */
+			CU_ASSERT(delta_size * 3 < full_size);
+
+			/* Sequential and reverse reads */
+			check_compressed_frames(&reader_config,
+						(const uint8_t *const *)frames,
+						plane_size,
+						DELTA_FRAMES);
+
+			/* Random access */
+			ret = vraw_reader_new(
+				COMPRESSED_PATH, &reader_config, &reader);
+			CU_ASSERT_EQUAL_FATAL(ret, 0);
+			read_size = vraw_reader_get_min_buf_size(reader);
+			read_data = malloc(read_size);
+			for (size_t j = 0; j < ARRAY_SIZE(order); j++) {
+				ret = vraw_reader_seek_ts(
+					reader, order[j] * (1000000 / 30));
+				CU_ASSERT_EQUAL(ret, 0);
+				ret = vraw_reader_frame_read(
+					reader, read_data, read_size, &frame);
+				CU_ASSERT_EQUAL(ret, 0);
+				CU_ASSERT_EQUAL(memcmp(read_data,
+						       frames[order[j]],
+						       plane_size[0]),
+						0);
+			}
+			free(read_data);
+			ret = vraw_reader_destroy(reader);
+			CU_ASSERT_EQUAL(ret, 0);
+		}
+
+		/* Without the frame table, the keyframes are found by
+		 * scanning the file */
+		file_size = get_file_size(COMPRESSED_PATH);
+		ret = truncate(COMPRESSED_PATH,
+			       file_size - 24 - 16 * DELTA_FRAMES - 1);
+		CU_ASSERT_EQUAL(ret, 0);
+		check_compressed_frames(&reader_config,
+					(const uint8_t *const *)frames,
+					plane_size,
+					DELTA_FRAMES - 1);
+
+		for (unsigned int k = 0; k < DELTA_FRAMES; k++)
+			free(frames[k]);
+	}
+
+	unlink(COMPRESSED_PATH);
+}
+
+
+static int slow_sink_write(struct vraw_writer *writer,
+			   const void *buf,
+			   size_t len,
+			   void *userdata)
+{
+	struct async_ctx *ctx = userdata;
+
+	/* Block the output writer thread until released */
+	pthread_mutex_lock(&ctx->mutex);
+	ctx->holding = true;
+	pthread_cond_broadcast(&ctx->cond);
+	while (ctx->hold)
+		pthread_cond_wait(&ctx->cond, &ctx->mutex);
+	ctx->holding = false;
+	pthread_mutex_unlock(&ctx->mutex);
+
+	return 0;
+}
+
+
+static void test_vraw_writer_fanout(void)
+{
+	const char *path_raw = "/tmp/vraw_test_writer_fanout.yuv";
+	const char *path_y4m_ref = "/tmp/vraw_test_writer_fanout_ref.y4m";
+	for (size_t i = 0; i < ARRAY_SIZE(s_assets_map); i++) {
+		int ret = 0;
+		struct vraw_fanout *fanout = NULL;
+		struct vraw_fanout_output outputs[3] = {0};
+		struct vraw_writer_config config = {0};
+		struct vraw_writer_stats stats = {0};
+		struct vraw_frame frame = {0};
+		struct sink_ctx ctx = {0};
+		struct async_ctx slow_ctx = {0};
+		enum vdef_resolution resolution = s_assets_map[i].resolution;
+		const struct vdef_raw_format *format = s_assets_map[i].format;
+		uint8_t *plane_data[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+		size_t plane_size[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+		size_t lines[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+		size_t stride;
+		int y4m = vdef_raw_format_cmp(format, &vdef_i420);
+
+		const char *path = get_path(format);
+		fill_config(&config, resolution, format);
+
+		/* Reference files */
+		write_strided_frames(path, &config, resolution, format);
+		config.y4m = y4m;
+		write_strided_frames(path_y4m_ref, &config, resolution, format);
+		config.y4m = 0;
+
+		/* invalid params */
+		ret = vraw_fanout_new(NULL, 1, &config, &fanout);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		ret = vraw_fanout_new(outputs, 0, &config, &fanout);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		ret = vraw_fanout_new(outputs, 1, NULL, &fanout);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		config.input_format = y4m ? vdef_nv12 : vdef_i420;
+		ret = vraw_fanout_new(outputs, 1, &config, &fanout);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		config.input_format = *format;
+		config.cbs.frame_done = &async_frame_done;
+		ret = vraw_fanout_new(outputs, 1, &config, &fanout);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		config.cbs.frame_done = NULL;
+
+		/* A raw file with positional writes, and a sink with the
+		 * y4m format if supported */
+		outputs[0].filename = path_raw;
+		outputs[0].backend = VRAW_WRITER_BACKEND_PWRITEV;
+		outputs[1].sink.write = &sink_write;
+		outputs[1].sink.userdata = &ctx;
+		outputs[1].y4m = y4m;
+		ret = vraw_fanout_new(outputs, 2, &config, &fanout);
+		CU_ASSERT_EQUAL(ret, 0);
+		if (ret != 0)
+			continue;
+
+		/* Same frames as write_strided_frames() */
+		fill_frame(&frame, resolution, format);
+		vdef_calc_raw_frame_size(format,
+					 &frame.frame.info.resolution,
+					 NULL,
+					 NULL,
+					 NULL,
+					 NULL,
+					 plane_size,
+					 NULL);
+		for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++) {
+			if (frame.frame.plane_stride[p] == 0)
+				continue;
+			lines[p] = plane_size[p] / frame.frame.plane_stride[p];
+			frame.frame.plane_stride[p] += 64;
+			plane_data[p] =
+				malloc(lines[p] * frame.frame.plane_stride[p]);
+			frame.cdata[p] = plane_data[p];
+		}
+		for (unsigned int k = 0; k < 3; k++) {
+			for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT;
+			     p++) {
+				size_t len =
+					lines[p] * frame.frame.plane_stride[p];
+				for (size_t j = 0; j < len; j++) {
+					plane_data[p][j] =
+						(uint8_t)(j * 7 + p + k);
+				}
+			}
+			ret = vraw_fanout_frame_write(fanout, &frame);
+			CU_ASSERT_EQUAL(ret, 0);
+		}
+		/* Rows shorter than a line are rejected */
+		stride = frame.frame.plane_stride[0];
+		frame.frame.plane_stride[0] = 8;
+		ret = vraw_fanout_frame_write(fanout, &frame);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		frame.frame.plane_stride[0] = stride;
+
+		ret = vraw_fanout_get_stats(fanout, 2, &stats);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		ret = vraw_fanout_destroy(fanout);
+		CU_ASSERT_EQUAL(ret, 0);
+
+		check_same_files(path, path_raw);
+		check_same_data(path_y4m_ref, ctx.data, ctx.len);
+		free(ctx.data);
+
+		/* A slow output drops frames without blocking the others */
+		pthread_mutex_init(&slow_ctx.mutex, NULL);
+		pthread_cond_init(&slow_ctx.cond, NULL);
+		slow_ctx.hold = true;
+		outputs[1].sink.write = &slow_sink_write;
+		outputs[1].sink.userdata = &slow_ctx;
+		outputs[1].y4m = 0;
+		config.queue_depth = 1;
+		config.queue_full = VRAW_WRITER_QUEUE_FULL_DROP;
+		ret = vraw_fanout_new(outputs, 2, &config, &fanout);
+		CU_ASSERT_EQUAL(ret, 0);
+		if (ret != 0)
+			goto out;
+		ret = vraw_fanout_frame_write(fanout, &frame);
+		CU_ASSERT_EQUAL(ret, 0);
+		pthread_mutex_lock(&slow_ctx.mutex);
+		while (!slow_ctx.holding)
+			pthread_cond_wait(&slow_ctx.cond, &slow_ctx.mutex);
+		pthread_mutex_unlock(&slow_ctx.mutex);
+		for (unsigned int k = 0; k < 3; k++) {
+			ret = vraw_fanout_get_stats(fanout, 0, &stats);
+			CU_ASSERT_EQUAL(ret, 0);
+			/* Wait for the fast output */
+			while (stats.queue_depth > 0) {
+				usleep(1000);
+				ret = vraw_fanout_get_stats(fanout, 0, &stats);
+				CU_ASSERT_EQUAL(ret, 0);
+			}
+			ret = vraw_fanout_frame_write(fanout, &frame);
+			CU_ASSERT_EQUAL(ret, -EAGAIN);
+		}
+		ret = vraw_fanout_get_stats(fanout, 1, &stats);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(stats.dropped, 3);
+		pthread_mutex_lock(&slow_ctx.mutex);
+		slow_ctx.hold = false;
+		pthread_cond_broadcast(&slow_ctx.cond);
+		pthread_mutex_unlock(&slow_ctx.mutex);
+		ret = vraw_fanout_destroy(fanout);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(get_file_size(path_raw),
+				4 * get_file_size(path) / 3);
+
+out:
+		pthread_cond_destroy(&slow_ctx.cond);
+		pthread_mutex_destroy(&slow_ctx.mutex);
+		for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++)
+			free(plane_data[p]);
+	}
+
+	unlink(path_raw);
+	unlink(path_y4m_ref);
+}
+
+
+/* Chroma sample of component comp (0: U, 1: V) of a YUV 4:2:0 frame */
+static uint8_t *chroma_sample(const struct vraw_frame *frame,
+			      const struct vdef_raw_format *format,
+			      unsigned int comp,
+			      unsigned int row,
+			      unsigned int col)
+{
+	size_t ss = format->data_size / 8;
+	unsigned int first = (format->pix_order == VDEF_RAW_PIX_ORDER_YUV)
+				     ? comp
+				     : 1 - comp;
+	if (format->data_layout == VDEF_RAW_DATA_LAYOUT_PLANAR_Y_U_V) {
+		return (uint8_t *)frame->cdata[1 + first] +
+		       row * frame->frame.plane_stride[1 + first] + col * ss;
+	} else {
+		return (uint8_t *)frame->cdata[1] +
+		       row * frame->frame.plane_stride[1] +
+		       (2 * col + first) * ss;
+	}
+}
+
+
+static void alloc_frame(struct vraw_frame *frame,
+			enum vdef_resolution resolution,
+			const struct vdef_raw_format *format,
+			size_t padding)
+{
+	size_t plane_size[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+
+	fill_frame(frame, resolution, format);
+	vdef_calc_raw_frame_size(format,
+				 &frame->frame.info.resolution,
+				 NULL,
+				 NULL,
+				 NULL,
+				 NULL,
+				 plane_size,
+				 NULL);
+	for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++) {
+		size_t stride = frame->frame.plane_stride[p];
+		if (stride == 0)
+			continue;
+		frame->frame.plane_stride[p] += padding;
+		frame->cdata[p] = calloc(plane_size[p] / stride,
+					 frame->frame.plane_stride[p]);
+	}
+}
+
+
+static void free_frame(struct vraw_frame *frame)
+{
+	for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++)
+		free((void *)frame->cdata[p]);
+}
+
+
+static void test_vraw_writer_conversion(void)
+{
+	const char *path_ref = "/tmp/vraw_test_writer_conv_ref.yuv";
+	const char *path_conv = "/tmp/vraw_test_writer_conv.yuv";
+	struct {
+		const struct vdef_raw_format *in;
+		const struct vdef_raw_format *out;
+		enum vdef_resolution resolution;
+	} convs[] = {
+		{&vdef_nv12, &vdef_i420, VDEF_RESOLUTION_144P},
+		{&vdef_nv21, &vdef_i420, VDEF_RESOLUTION_192X144},
+		{&vdef_i420, &vdef_nv12, VDEF_RESOLUTION_144P},
+		{&vdef_yv12, &vdef_nv12, VDEF_RESOLUTION_192X144},
+		{&vdef_nv12, &vdef_nv21, VDEF_RESOLUTION_144P},
+		{&vdef_i420, &vdef_yv12, VDEF_RESOLUTION_144P},
+		{&vdef_nv12_10_16le, &vdef_i420_10_16le, VDEF_RESOLUTION_144P},
+		{&vdef_i420_10_16le, &vdef_nv21_10_16le, VDEF_RESOLUTION_144P},
+	};
+	enum vraw_writer_backend backends[] = {
+		VRAW_WRITER_BACKEND_STDIO,
+		VRAW_WRITER_BACKEND_PWRITEV,
+		VRAW_WRITER_BACKEND_IO_URING,
+		VRAW_WRITER_BACKEND_DIRECT,
+	};
+
+	for (size_t i = 0; i < ARRAY_SIZE(convs); i++) {
+		int ret;
+		struct vraw_writer *writer = NULL;
+		struct vraw_writer_config config = {0};
+		struct vraw_frame in = {0}, out = {0};
+		size_t ss = convs[i].out->data_size / 8;
+		unsigned int width, height;
+		int y4m = vdef_raw_format_cmp(convs[i].out, &vdef_i420);
+
+		/* Padded input rows, packed expected output */
+		alloc_frame(&in, convs[i].resolution, convs[i].in, 64);
+		alloc_frame(&out, convs[i].resolution, convs[i].out, 0);
+		width = in.frame.info.resolution.width;
+		height = in.frame.info.resolution.height;
+		for (unsigned int r = 0; r < height; r++) {
+			uint8_t *src = (uint8_t *)in.cdata[0] +
+				       r * in.frame.plane_stride[0];
+			uint8_t *dst = (uint8_t *)out.cdata[0] +
+				       r * out.frame.plane_stride[0];
+			for (size_t j = 0; j < width * ss; j++)
+				src[j] = dst[j] = (uint8_t)(j * 3 + r);
+		}
+		for (unsigned int r = 0; r < height / 2; r++) {
+			for (unsigned int c = 0; c < width / 2; c++) {
+				for (unsigned int comp = 0; comp < 2; comp++) {
+					uint8_t *src = chroma_sample(
+						&in, convs[i].in, comp, r, c);
+					uint8_t *dst = chroma_sample(
+						&out, convs[i].out, comp, r, c);
+					for (size_t b = 0; b < ss; b++) {
+						src[b] = dst[b] = (uint8_t)(
+							c * 5 + r + comp * 100 +
+							b * 7);
+					}
+				}
+			}
+		}
+
+		for (int y = 0; y <= y4m; y++) {
+			/* Reference file */
+			fill_config(&config, convs[i].resolution, convs[i].out);
+			config.y4m = y;
+			ret = vraw_writer_new(path_ref, &config, &writer);
+			CU_ASSERT_EQUAL(ret, 0);
+			for (unsigned int k = 0; k < 2; k++) {
+				ret = vraw_writer_frame_write(writer, &out);
+				CU_ASSERT_EQUAL(ret, 0);
+			}
+			ret = vraw_writer_destroy(writer);
+			CU_ASSERT_EQUAL(ret, 0);
+
+			/* invalid input format */
+			config.input_format = vdef_nv21_10_packed;
+			ret = vraw_writer_new(path_conv, &config, &writer);
+			CU_ASSERT_EQUAL(ret, -EINVAL);
+			config.input_format = *convs[i].in;
+
+			for (size_t b = 0; b < ARRAY_SIZE(backends); b++) {
+				config.backend = backends[b];
+				ret = vraw_writer_new(
+					path_conv, &config, &writer);
+				CU_ASSERT_EQUAL(ret, 0);
+				if (ret != 0)
+					continue;
+				/* Converted frame, then a frame already in
+				 * the file format */
+				ret = vraw_writer_frame_write(writer, &in);
+				CU_ASSERT_EQUAL(ret, 0);
+				ret = vraw_writer_frame_write(writer, &out);
+				CU_ASSERT_EQUAL(ret, 0);
+				/* Other formats are rejected */
+				in.frame.format = vdef_gray;
+				ret = vraw_writer_frame_write(writer, &in);
+				CU_ASSERT_EQUAL(ret, -EINVAL);
+				in.frame.format = *convs[i].in;
+				/* Input rows shorter than a line too */
+				for (unsigned int p = 0; p < 2; p++) {
+					size_t s = in.frame.plane_stride[p];
+					in.frame.plane_stride[p] = 8;
+					ret = vraw_writer_frame_write(writer,
+								      &in);
+					CU_ASSERT_EQUAL(ret, -EINVAL);
+					in.frame.plane_stride[p] = s;
+				}
+				ret = vraw_writer_destroy(writer);
+				CU_ASSERT_EQUAL(ret, 0);
+
+				check_same_files(path_ref, path_conv);
+			}
+		}
+
+		free_frame(&in);
+		free_frame(&out);
+	}
+
+	unlink(path_ref);
+	unlink(path_conv);
+}
+
+
+#define BATCH_COUNT 5
+
+
+static void test_vraw_writer_batch(void)
+{
+	const char *path_ref = "/tmp/vraw_test_writer_batch_ref.yuv";
+	const char *path_batch = "/tmp/vraw_test_writer_batch.yuv";
+	enum vraw_writer_backend backends[] = {
+		VRAW_WRITER_BACKEND_STDIO,
+		VRAW_WRITER_BACKEND_PWRITEV,
+		VRAW_WRITER_BACKEND_IO_URING,
+		VRAW_WRITER_BACKEND_DIRECT,
+	};
+	struct vraw_frame frames[BATCH_COUNT];
+	size_t plane_size[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+	size_t frame_size = 0;
+	uint8_t *data;
+	int ret;
+
+	/* Frames following each other in a single buffer */
+	fill_frame(&frames[0], VDEF_RESOLUTION_144P, &vdef_i420);
+	vdef_calc_raw_frame_size(&vdef_i420,
+				 &frames[0].frame.info.resolution,
+				 NULL,
+				 NULL,
+				 NULL,
+				 NULL,
+				 plane_size,
+				 NULL);
+	for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++)
+		frame_size += plane_size[p];
+	data = malloc(BATCH_COUNT * frame_size);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(data);
+	for (size_t j = 0; j < BATCH_COUNT * frame_size; j++)
+		data[j] = (uint8_t)(j * 13 + j / frame_size);
+	for (unsigned int k = 0; k < BATCH_COUNT; k++) {
+		size_t offset = k * frame_size;
+		frames[k] = frames[0];
+		for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++) {
+			if (plane_size[p] == 0)
+				continue;
+			frames[k].cdata[p] = data + offset;
+			offset += plane_size[p];
+		}
+	}
+
+	for (int y4m = 0; y4m <= 1; y4m++) {
+		struct vraw_writer *writer = NULL;
+		struct vraw_writer_config config = {0};
+		struct vraw_writer_stats stats = {0};
+
+		/* Reference file, written frame by frame */
+		fill_config(&config, VDEF_RESOLUTION_144P, &vdef_i420);
+		config.y4m = y4m;
+		ret = vraw_writer_new(path_ref, &config, &writer);
+		CU_ASSERT_EQUAL(ret, 0);
+		for (unsigned int k = 0; k < BATCH_COUNT; k++) {
+			ret = vraw_writer_frame_write(writer, &frames[k]);
+			CU_ASSERT_EQUAL(ret, 0);
+		}
+		ret = vraw_writer_destroy(writer);
+		CU_ASSERT_EQUAL(ret, 0);
+
+		for (size_t b = 0; b < ARRAY_SIZE(backends); b++) {
+			config.backend = backends[b];
+			ret = vraw_writer_new(path_batch, &config, &writer);
+			CU_ASSERT_EQUAL(ret, 0);
+			ret = vraw_writer_frames_write(writer, frames, 2);
+			CU_ASSERT_EQUAL(ret, 0);
+			ret = vraw_writer_frames_write(
+				writer, &frames[2], BATCH_COUNT - 2);
+			CU_ASSERT_EQUAL(ret, 0);
+			ret = vraw_writer_get_stats(writer, &stats);
+			CU_ASSERT_EQUAL(ret, 0);
+			CU_ASSERT_EQUAL(stats.frames, BATCH_COUNT);
+			/* One gathered write per batch */
+			if ((backends[b] == VRAW_WRITER_BACKEND_PWRITEV) &&
+			    !y4m)
+				CU_ASSERT_EQUAL(stats.io_calls, 2);
+			ret = vraw_writer_destroy(writer);
+			CU_ASSERT_EQUAL(ret, 0);
+
+			check_same_files(path_ref, path_batch);
+		}
+
+		/* Nothing is written if a frame is invalid */
+		config.backend = VRAW_WRITER_BACKEND_PWRITEV;
+		ret = vraw_writer_new(path_batch, &config, &writer);
+		CU_ASSERT_EQUAL(ret, 0);
+		ret = vraw_writer_frames_write(writer, frames, 0);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		ret = vraw_writer_frames_write(writer, NULL, 1);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		frames[3].cdata[1] = NULL;
+		ret = vraw_writer_frames_write(writer, frames, BATCH_COUNT);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		frames[3].cdata[1] = frames[3].cdata[0] + plane_size[0];
+		ret = vraw_writer_get_stats(writer, &stats);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(stats.frames, 0);
+		ret = vraw_writer_destroy(writer);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	/* Asynchronous mode: a batch that does not fit is dropped */
+	{
+		struct vraw_writer *writer = NULL;
+		struct vraw_writer_config config = {0};
+		struct async_ctx ctx = {0};
+
+		pthread_mutex_init(&ctx.mutex, NULL);
+		pthread_cond_init(&ctx.cond, NULL);
+		fill_config(&config, VDEF_RESOLUTION_144P, &vdef_i420);
+		config.queue_depth = 2;
+		config.queue_full = VRAW_WRITER_QUEUE_FULL_DROP;
+		config.cbs.frame_done = async_frame_done;
+		config.userdata = &ctx;
+		ret = vraw_writer_new(path_batch, &config, &writer);
+		CU_ASSERT_EQUAL(ret, 0);
+		ret = vraw_writer_frames_write(writer, frames, BATCH_COUNT);
+		CU_ASSERT_EQUAL(ret, -EAGAIN);
+		ret = vraw_writer_frames_write(writer, frames, 2);
+		CU_ASSERT_EQUAL(ret, 0);
+		ret = vraw_writer_destroy(writer);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(ctx.done_count, 2);
+		CU_ASSERT_EQUAL(ctx.error_count, 0);
+		CU_ASSERT_EQUAL(get_file_size(path_batch), 2 * frame_size);
+		pthread_cond_destroy(&ctx.cond);
+		pthread_mutex_destroy(&ctx.mutex);
+	}
+
+	free(data);
+	unlink(path_ref);
+	unlink(path_batch);
+}
+
+
+static void test_vraw_writer_durability(void)
+{
+	const char *path_ref = "/tmp/vraw_test_writer_durability_ref.yuv";
+	const char *path = "/tmp/vraw_test_writer_durability.yuv";
+	enum vraw_writer_backend backends[] = {
+		VRAW_WRITER_BACKEND_STDIO,
+		VRAW_WRITER_BACKEND_PWRITEV,
+		VRAW_WRITER_BACKEND_IO_URING,
+		VRAW_WRITER_BACKEND_DIRECT,
+	};
+	struct vraw_writer *writer = NULL;
+	struct vraw_writer_config config = {0};
+	struct vraw_writer_stats stats = {0}, ref_stats = {0};
+	size_t plane_size[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+	size_t frame_size = 0;
+	int ret, fds[2];
+
+	fill_config(&config, VDEF_RESOLUTION_144P, &vdef_i420);
+	vdef_calc_raw_frame_size(&vdef_i420,
+				 &config.info.resolution,
+				 NULL,
+				 NULL,
+				 NULL,
+				 NULL,
+				 plane_size,
+				 NULL);
+	for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++)
+		frame_size += plane_size[p];
+
+	for (size_t b = 0; b < ARRAY_SIZE(backends); b++) {
+		fill_config(&config, VDEF_RESOLUTION_144P, &vdef_i420);
+		config.backend = backends[b];
+		config.flush = VRAW_WRITER_FLUSH_ON_DESTROY;
+
+		/* Reference file, without durability calls */
+		ret = vraw_writer_new(path_ref, &config, &writer);
+		CU_ASSERT_EQUAL(ret, 0);
+		write_frames(writer, VDEF_RESOLUTION_144P, &vdef_i420);
+		ret = vraw_writer_get_stats(writer, &ref_stats);
+		CU_ASSERT_EQUAL(ret, 0);
+		ret = vraw_writer_destroy(writer);
+		CU_ASSERT_EQUAL(ret, 0);
+
+		/* Writeback started on every frame, fdatasync every 2
+		 * frames, cache dropped */
+		config.sync_bytes = frame_size / 2;
+		config.sync_drop_cache = 1;
+		for (unsigned int sync_frames = 0; sync_frames <= 2;
+		     sync_frames += 2) {
+			config.sync_frames = sync_frames;
+			ret = vraw_writer_new(path, &config, &writer);
+			CU_ASSERT_EQUAL(ret, 0);
+			write_frames(writer, VDEF_RESOLUTION_144P, &vdef_i420);
+			ret = vraw_writer_get_stats(writer, &stats);
+			CU_ASSERT_EQUAL(ret, 0);
+			CU_ASSERT_EQUAL(stats.frames, ref_stats.frames);
+			CU_ASSERT_TRUE(stats.io_calls > ref_stats.io_calls);
+			CU_ASSERT_TRUE(stats.max_write_latency_ns > 0);
+			ret = vraw_writer_destroy(writer);
+			CU_ASSERT_EQUAL(ret, 0);
+
+			check_same_files(path_ref, path);
+		}
+	}
+
+	/* Not supported in flight recorder mode, nor on pipes */
+	fill_config(&config, VDEF_RESOLUTION_144P, &vdef_i420);
+	config.sync_bytes = frame_size;
+	config.ring_slots = 4;
+	ret = vraw_writer_new(path, &config, &writer);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	config.sync_bytes = 0;
+	config.ring_slots = 0;
+	config.sync_frames = 1;
+	ret = pipe(fds);
+	CU_ASSERT_EQUAL_FATAL(ret, 0);
+	ret = vraw_writer_new_from_fd(fds[1], &config, &writer);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	close(fds[0]);
+	close(fds[1]);
+
+	unlink(path_ref);
+	unlink(path);
+}
+
+
+#define WRITE_AT_THREADS 4
+#define WRITE_AT_FRAMES 16
+
+
+struct write_at_ctx {
+	struct vraw_writer *writer;
+	struct vraw_frame *frames;
+	unsigned int first;
+	int errors;
+};
+
+
+static void *write_at_thread(void *userdata)
+{
+	struct write_at_ctx *ctx = userdata;
+
+	/* Every WRITE_AT_THREADS-th frame, in reverse order */
+	for (int k = WRITE_AT_FRAMES - WRITE_AT_THREADS + ctx->first; k >= 0;
+	     k -= WRITE_AT_THREADS) {
+		if (vraw_writer_frame_write_at(
+			    ctx->writer, k, &ctx->frames[k]) != 0)
+			ctx->errors++;
+	}
+
+	return NULL;
+}
+
+
+static void test_vraw_writer_write_at(void)
+{
+	const char *path_ref = "/tmp/vraw_test_writer_write_at_ref.yuv";
+	const char *path = "/tmp/vraw_test_writer_write_at.yuv";
+	struct vraw_writer *writer = NULL;
+	struct vraw_writer_config config = {0};
+	struct vraw_writer_stats stats = {0};
+	struct vraw_frame frames[WRITE_AT_FRAMES];
+	struct write_at_ctx ctx[WRITE_AT_THREADS];
+	pthread_t threads[WRITE_AT_THREADS];
+	size_t plane_size[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+	size_t frame_size = 0, stride;
+	uint8_t *data;
+	int ret;
+
+	/* Padded rows for half of the frames */
+	fill_frame(&frames[0], VDEF_RESOLUTION_144P, &vdef_nv12);
+	vdef_calc_raw_frame_size(&vdef_nv12,
+				 &frames[0].frame.info.resolution,
+				 NULL,
+				 NULL,
+				 NULL,
+				 NULL,
+				 plane_size,
+				 NULL);
+	for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++)
+		frame_size += plane_size[p];
+	data = malloc(2 * WRITE_AT_FRAMES * frame_size);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(data);
+	for (size_t j = 0; j < 2 * WRITE_AT_FRAMES * frame_size; j++)
+		data[j] = (uint8_t)(j * 11 + j / frame_size);
+	for (unsigned int k = 0; k < WRITE_AT_FRAMES; k++) {
+		uint8_t *ptr = data + 2 * k * frame_size;
+		frames[k] = frames[0];
+		for (unsigned int p = 0; p < 2; p++) {
+			stride = frames[0].frame.plane_stride[p];
+			if (k & 1)
+				frames[k].frame.plane_stride[p] = 2 * stride;
+			frames[k].cdata[p] = ptr;
+			ptr += frames[k].frame.plane_stride[p] *
+			       (plane_size[p] / stride);
+		}
+	}
+
+	/* Reference file, written in order */
+	fill_config(&config, VDEF_RESOLUTION_144P, &vdef_nv12);
+	ret = vraw_writer_new(path_ref, &config, &writer);
+	CU_ASSERT_EQUAL(ret, 0);
+	for (unsigned int k = 0; k < WRITE_AT_FRAMES; k++) {
+		ret = vraw_writer_frame_write(writer, &frames[k]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	ret = vraw_writer_destroy(writer);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Not supported with buffered writes */
+	ret = vraw_writer_new(path, &config, &writer);
+	CU_ASSERT_EQUAL(ret, 0);
+	ret = vraw_writer_frame_write_at(writer, 0, &frames[0]);
+	CU_ASSERT_EQUAL(ret, -EPROTO);
+	ret = vraw_writer_destroy(writer);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	/* Concurrent writes, out of order; the preallocated space past
+	 * the last frame is released */
+	config.backend = VRAW_WRITER_BACKEND_PWRITEV;
+	config.expected_frame_count = 2 * WRITE_AT_FRAMES;
+	ret = vraw_writer_new(path, &config, &writer);
+	CU_ASSERT_EQUAL(ret, 0);
+	for (unsigned int t = 0; t < WRITE_AT_THREADS; t++) {
+		ctx[t].writer = writer;
+		ctx[t].frames = frames;
+		ctx[t].first = t;
+		ctx[t].errors = 0;
+		ret = pthread_create(
+			&threads[t], NULL, write_at_thread, &ctx[t]);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+	for (unsigned int t = 0; t < WRITE_AT_THREADS; t++) {
+		pthread_join(threads[t], NULL);
+		CU_ASSERT_EQUAL(ctx[t].errors, 0);
+	}
+	ret = vraw_writer_frame_write_at(writer, 0, NULL);
+	CU_ASSERT_EQUAL(ret, -EINVAL);
+	ret = vraw_writer_get_stats(writer, &stats);
+	CU_ASSERT_EQUAL(ret, 0);
+	CU_ASSERT_EQUAL(stats.frames, WRITE_AT_FRAMES);
+	CU_ASSERT_EQUAL(stats.bytes, WRITE_AT_FRAMES * frame_size);
+	ret = vraw_writer_destroy(writer);
+	CU_ASSERT_EQUAL(ret, 0);
+
+	check_same_files(path_ref, path);
+
+	free(data);
+	unlink(path_ref);
+	unlink(path);
+}
+
+
+#define TS_FRAMES 300
+
+
+/* Variable frame rate timestamps */
+static uint64_t vfr_ts(unsigned int k)
+{
+	return 1000 + 20000ULL * k + ((k % 3) ? 0 : 15000);
+}
+
+
+static void test_vraw_writer_timestamps(void)
+{
+	const char *path = "/tmp/vraw_test_writer_timestamps.yuv";
+	const char *ts_path = "/tmp/vraw_test_writer_timestamps.yuv.timestamps";
+	enum vraw_writer_backend backends[] = {
+		VRAW_WRITER_BACKEND_STDIO,
+		VRAW_WRITER_BACKEND_PWRITEV,
+		VRAW_WRITER_BACKEND_IO_URING,
+	};
+	struct vraw_frame frame = {0}, out = {0};
+	size_t plane_size[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+	size_t frame_size = 0, offset = 0;
+	uint8_t *frame_data, *data;
+	int ret;
+
+	fill_frame(&frame, VDEF_RESOLUTION_144P, &vdef_i420);
+	vdef_calc_raw_frame_size(&vdef_i420,
+				 &frame.frame.info.resolution,
+				 NULL,
+				 NULL,
+				 NULL,
+				 NULL,
+				 plane_size,
+				 NULL);
+	for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++)
+		frame_size += plane_size[p];
+	frame_data = calloc(1, frame_size);
+	data = calloc(1, frame_size);
+	for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++) {
+		if (plane_size[p] == 0)
+			continue;
+		frame.cdata[p] = frame_data + offset;
+		offset += plane_size[p];
+	}
+
+	for (size_t b = 0; b <= ARRAY_SIZE(backends); b++) {
+		struct vraw_writer *writer = NULL;
+		struct vraw_writer_config config = {0};
+		struct vraw_reader *reader = NULL;
+		struct vraw_reader_config rconfig = {0};
+		bool write_at = (b == ARRAY_SIZE(backends));
+
+		fill_config(&config, VDEF_RESOLUTION_144P, &vdef_i420);
+		config.backend = write_at ? VRAW_WRITER_BACKEND_PWRITEV
+					  : backends[b];
+		config.flush = VRAW_WRITER_FLUSH_ON_DESTROY;
+		config.timestamps = 1;
+		ret = vraw_writer_new(path, &config, &writer);
+		CU_ASSERT_EQUAL(ret, 0);
+		for (unsigned int n = 0; n < TS_FRAMES; n++) {
+			/* Out of order with write_at */
+			unsigned int k = write_at ? TS_FRAMES - 1 - n : n;
+			frame.frame.info.timestamp = vfr_ts(k);
+			frame.frame.info.capture_timestamp = 5000000 + k;
+			frame.frame.info.flags = k & 1;
+			frame.frame.info.index = 10 + k;
+			frame_data[0] = (uint8_t)k;
+			if (write_at)
+				ret = vraw_writer_frame_write_at(
+					writer, k, &frame);
+			else
+				ret = vraw_writer_frame_write(writer, &frame);
+			CU_ASSERT_EQUAL(ret, 0);
+		}
+		ret = vraw_writer_destroy(writer);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(get_file_size(ts_path), 16 + TS_FRAMES * 32);
+
+		/* Recorded information restored */
+		rconfig.format = vdef_i420;
+		rconfig.info = config.info;
+		rconfig.timestamps = 1;
+		ret = vraw_reader_new(path, &rconfig, &reader);
+		CU_ASSERT_EQUAL_FATAL(ret, 0);
+		for (unsigned int k = 0; k < TS_FRAMES; k++) {
+			ret = vraw_reader_frame_read(
+				reader, data, frame_size, &out);
+			CU_ASSERT_EQUAL(ret, 0);
+			CU_ASSERT_EQUAL(out.frame.info.timestamp, vfr_ts(k));
+			CU_ASSERT_EQUAL(out.frame.info.capture_timestamp,
+					5000000 + k);
+			CU_ASSERT_EQUAL(out.frame.info.flags, k & 1);
+			CU_ASSERT_EQUAL(out.frame.info.index, 10 + k);
+			CU_ASSERT_EQUAL(data[0], (uint8_t)k);
+		}
+
+		/* Timestamp seeks in the recorded timestamps */
+		for (unsigned int k = 0; k < TS_FRAMES; k += 13) {
+			ret = vraw_reader_seek_ts(reader, vfr_ts(k) + 1);
+			CU_ASSERT_EQUAL(ret, 0);
+			ret = vraw_reader_frame_read(
+				reader, data, frame_size, &out);
+			CU_ASSERT_EQUAL(ret, 0);
+			CU_ASSERT_EQUAL(out.frame.info.timestamp, vfr_ts(k));
+			CU_ASSERT_EQUAL(data[0], (uint8_t)k);
+		}
+		ret = vraw_reader_seek_ts(reader, 0);
+		CU_ASSERT_EQUAL(ret, 0);
+		ret = vraw_reader_frame_read(reader, data, frame_size, &out);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(out.frame.info.index, 10);
+
+		ret = vraw_reader_destroy(reader);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	/* Sidecar file shorter than the data file: seeks stop at the last
+	 * entry and the next frames follow the framerate */
+	{
+		struct vraw_reader *reader = NULL;
+		struct vraw_reader_config rconfig = {0};
+		struct vraw_writer_config config = {0};
+		uint64_t duration;
+		fill_config(&config, VDEF_RESOLUTION_144P, &vdef_i420);
+		rconfig.format = vdef_i420;
+		rconfig.info = config.info;
+		rconfig.timestamps = 1;
+		duration = 1000000ULL * config.info.framerate.den /
+			   config.info.framerate.num;
+		ret = truncate(ts_path, 16 + 10 * 32);
+		CU_ASSERT_EQUAL(ret, 0);
+		ret = vraw_reader_new(path, &rconfig, &reader);
+		CU_ASSERT_EQUAL_FATAL(ret, 0);
+		ret = vraw_reader_seek_ts(reader, vfr_ts(TS_FRAMES - 1));
+		CU_ASSERT_EQUAL(ret, 0);
+		ret = vraw_reader_frame_read(reader, data, frame_size, &out);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(out.frame.info.timestamp, vfr_ts(9));
+		CU_ASSERT_EQUAL(data[0], 9);
+		ret = vraw_reader_frame_read(reader, data, frame_size, &out);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(out.frame.info.timestamp,
+				vfr_ts(9) + duration);
+		CU_ASSERT_EQUAL(data[0], 10);
+		ret = vraw_reader_destroy(reader);
+		CU_ASSERT_EQUAL(ret, 0);
+	}
+
+	/* Named files only */
+	{
+		struct vraw_writer *writer = NULL;
+		struct vraw_writer_config config = {0};
+		fill_config(&config, VDEF_RESOLUTION_144P, &vdef_i420);
+		config.timestamps = 1;
+		config.ring_slots = 4;
+		ret = vraw_writer_new(path, &config, &writer);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		config.ring_slots = 0;
+		ret = vraw_writer_new_from_fd(1, &config, &writer);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+	}
+
+	free(frame_data);
+	free(data);
+	unlink(path);
+	unlink(ts_path);
+}
+
+
+#define SPLIT_PATH "/tmp/vraw_test_writer_split.yuv"
+
+
+static void split_files_remove(void)
+{
+	char path[100];
+
+	unlink(SPLIT_PATH);
+	for (unsigned int p = 0; p < VDEF_RAW_MAX_PLANE_COUNT; p++) {
+		snprintf(path, sizeof(path), SPLIT_PATH ".plane%u", p);
+		unlink(path);
+	}
+}
+
+
+/* Check that the plane files hold the planes of a raw file */
+static void check_split_files(const char *path_ref,
+			      const struct vraw_writer_config *config)
+{
+	size_t plane_size[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+	size_t size = get_file_size(path_ref), offset;
+	unsigned int count;
+	uint8_t *data, *plane;
+	char path[100];
+	FILE *file;
+
+	vdef_calc_raw_frame_size(&config->format,
+				 &config->info.resolution,
+				 NULL,
+				 NULL,
+				 NULL,
+				 NULL,
+				 plane_size,
+				 NULL);
+	count = size / (plane_size[0] + plane_size[1] + plane_size[2]);
+	CU_ASSERT_NOT_EQUAL(count, 0);
+	data = malloc(size);
+	file = fopen(path_ref, "rb");
+	CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+	CU_ASSERT_EQUAL(fread(data, size, 1, file), 1);
+	(void)fclose(file);
+
+	for (unsigned int p = 0; p < 3; p++) {
+		if (plane_size[p] == 0)
+			continue;
+		snprintf(path, sizeof(path), SPLIT_PATH ".plane%u", p);
+		CU_ASSERT_EQUAL(get_file_size(path), count * plane_size[p]);
+		plane = malloc(plane_size[p]);
+		file = fopen(path, "rb");
+		CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+		offset = 0;
+		for (unsigned int q = 0; q < p; q++)
+			offset += plane_size[q];
+		for (unsigned int k = 0; k < count; k++) {
+			CU_ASSERT_EQUAL(fread(plane, plane_size[p], 1, file),
+					1);
+			CU_ASSERT_EQUAL(memcmp(plane, data + offset,
+					       plane_size[p]),
+					0);
+			offset += size / count;
+		}
+		(void)fclose(file);
+		free(plane);
+	}
+
+	free(data);
+}
+
+
+static void test_vraw_writer_split_planes(void)
+{
+	const char *path_ref = "/tmp/vraw_test_writer_split_ref.yuv";
+	int ret;
+
+	for (size_t i = 0; i < ARRAY_SIZE(s_assets_map); i++) {
+		struct vraw_writer_config config = {0};
+		struct vraw_reader *reader = NULL, *reader_ref = NULL;
+		struct vraw_reader_config reader_config = {0};
+		struct vraw_reader_stats stats = {0};
+		struct vraw_frame frame = {0}, frame_ref = {0};
+		enum vdef_resolution resolution = s_assets_map[i].resolution;
+		const struct vdef_raw_format *format = s_assets_map[i].format;
+		size_t plane_size[VDEF_RAW_MAX_PLANE_COUNT] = {0};
+		unsigned int plane_count;
+		uint8_t *data, *data_ref;
+		ssize_t size;
+
+		plane_count = vdef_get_raw_frame_plane_count(format);
+
+		fill_config(&config, resolution, format);
+		vdef_calc_raw_frame_size(format,
+					 &config.info.resolution,
+					 NULL,
+					 NULL,
+					 NULL,
+					 NULL,
+					 plane_size,
+					 NULL);
+		write_strided_frames(path_ref, &config, resolution, format);
+		config.split_planes = 1;
+		write_strided_frames(SPLIT_PATH, &config, resolution, format);
+
+		/* Manifest, and one file per plane */
+		CU_ASSERT_EQUAL(get_file_size(SPLIT_PATH),
+				24 + 8 * plane_count);
+		check_split_files(path_ref, &config);
+
+		/* Full frames, recombined */
+		reader_config.format = *format;
+		reader_config.info.resolution = config.info.resolution;
+		ret = vraw_reader_new(path_ref, &reader_config, &reader_ref);
+		CU_ASSERT_EQUAL_FATAL(ret, 0);
+		reader_config.split_planes = 1;
+		ret = vraw_reader_new(SPLIT_PATH, &reader_config, &reader);
+		CU_ASSERT_EQUAL_FATAL(ret, 0);
+		CU_ASSERT_EQUAL(vraw_reader_get_file_frame_count(reader), 3);
+		size = vraw_reader_get_min_buf_size(reader);
+		data = malloc(size);
+		data_ref = malloc(size);
+		for (unsigned int k = 0; k < 3; k++) {
+			ret = vraw_reader_frame_read(
+				reader_ref, data_ref, size, &frame_ref);
+			CU_ASSERT_EQUAL(ret, 0);
+			ret = vraw_reader_frame_read(
+				reader, data, size, &frame);
+			CU_ASSERT_EQUAL(ret, 0);
+			CU_ASSERT_EQUAL(memcmp(data, data_ref, size), 0);
+		}
+		ret = vraw_reader_frame_read(reader, data, size, &frame);
+		CU_ASSERT_EQUAL(ret, -ENOENT);
+		(void)vraw_reader_destroy(reader);
+
+		/* Luma only: sequential reads in the luma file */
+		reader_config.plane_mask = 1 << 0;
+		ret = vraw_reader_new(SPLIT_PATH, &reader_config, &reader);
+		CU_ASSERT_EQUAL_FATAL(ret, 0);
+		for (unsigned int k = 0; k < 3; k++) {
+			ret = vraw_reader_frame_read(
+				reader, data, size, &frame);
+			CU_ASSERT_EQUAL(ret, 0);
+			CU_ASSERT_PTR_NULL(frame.data[1]);
+		}
+		CU_ASSERT_EQUAL(memcmp(data, data_ref, plane_size[0]), 0);
+		ret = vraw_reader_get_stats(reader, &stats);
+		CU_ASSERT_EQUAL(ret, 0);
+		CU_ASSERT_EQUAL(stats.seeks, 0);
+		CU_ASSERT_EQUAL(stats.bytes,
+				24 + 8 * plane_count + 3 * plane_size[0]);
+		(void)vraw_reader_destroy(reader);
+
+		/* The manifest must match the configuration */
+		reader_config.info.resolution.width += 16;
+		ret = vraw_reader_new(SPLIT_PATH, &reader_config, &reader);
+		CU_ASSERT_EQUAL(ret, -EPROTO);
+
+		(void)vraw_reader_destroy(reader_ref);
+		free(data);
+		free(data_ref);
+		unlink(path_ref);
+		split_files_remove();
+	}
+
+	/* Converted chroma planes, split in their own files */
+	{
+		struct vraw_writer_config config = {0};
+
+		fill_config(&config, VDEF_RESOLUTION_144P, &vdef_i420);
+		config.input_format = vdef_nv12;
+		write_strided_frames(
+			path_ref, &config, VDEF_RESOLUTION_144P, &vdef_nv12);
+		config.split_planes = 1;
+		write_strided_frames(
+			SPLIT_PATH, &config, VDEF_RESOLUTION_144P, &vdef_nv12);
+		check_split_files(path_ref, &config);
+		unlink(path_ref);
+		split_files_remove();
+	}
+
+	/* Unsupported configurations */
+	{
+		struct vraw_writer *writer = NULL;
+		struct vraw_writer_config config = {0};
+		struct vraw_reader *reader = NULL;
+		struct vraw_reader_config reader_config = {0};
+		struct vraw_frame frame = {0};
+
+		fill_config(&config, VDEF_RESOLUTION_144P, &vdef_i420);
+		config.split_planes = 1;
+		config.y4m = 1;
+		ret = vraw_writer_new(SPLIT_PATH, &config, &writer);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		config.y4m = 0;
+		config.backend = VRAW_WRITER_BACKEND_IO_URING;
+		ret = vraw_writer_new(SPLIT_PATH, &config, &writer);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		config.backend = VRAW_WRITER_BACKEND_PWRITEV;
+		config.ring_slots = 4;
+		ret = vraw_writer_new(SPLIT_PATH, &config, &writer);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+		config.ring_slots = 0;
+		ret = vraw_writer_new_from_fd(1, &config, &writer);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+
+		ret = vraw_writer_new(SPLIT_PATH, &config, &writer);
+		CU_ASSERT_EQUAL_FATAL(ret, 0);
+		fill_frame(&frame, VDEF_RESOLUTION_144P, &vdef_i420);
+		ret = vraw_writer_frame_write_at(writer, 0, &frame);
+		CU_ASSERT_EQUAL(ret, -EPROTO);
+		ret = vraw_writer_destroy(writer);
+		CU_ASSERT_EQUAL(ret, 0);
+
+		reader_config.format = vdef_i420;
+		reader_config.info.resolution = config.info.resolution;
+		reader_config.split_planes = 1;
+		reader_config.subsample = 2;
+		ret = vraw_reader_new(SPLIT_PATH, &reader_config, &reader);
+		CU_ASSERT_EQUAL(ret, -EINVAL);
+
+		split_files_remove();
+	}
+}
+
+
 CU_TestInfo g_vraw_test_writer[] = {
 	{FN("vraw-writer-new"), &test_vraw_writer_new},
 	{FN("vraw-writer-frame-write"), &test_vraw_writer_frame_write},
+	{FN("vraw-writer-stats"), &test_vraw_writer_stats},
+	{FN("vraw-writer-flush"), &test_vraw_writer_flush},
+	{FN("vraw-writer-pwritev"), &test_vraw_writer_pwritev},
+	{FN("vraw-writer-contiguous"), &test_vraw_writer_contiguous},
+	{FN("vraw-writer-geometry"), &test_vraw_writer_geometry},
+	{FN("vraw-writer-fd-sink"), &test_vraw_writer_fd_sink},
+	{FN("vraw-writer-async"), &test_vraw_writer_async},
+	{FN("vraw-writer-io-uring"), &test_vraw_writer_io_uring},
+	{FN("vraw-writer-direct"), &test_vraw_writer_direct},
+	{FN("vraw-writer-prealloc"), &test_vraw_writer_prealloc},
+	{FN("vraw-writer-ring"), &test_vraw_writer_ring},
+	{FN("vraw-writer-segments"), &test_vraw_writer_segments},
+	{FN("vraw-writer-compression"), &test_vraw_writer_compression},
+	{FN("vraw-writer-fanout"), &test_vraw_writer_fanout},
+	{FN("vraw-writer-conversion"), &test_vraw_writer_conversion},
+	{FN("vraw-writer-batch"), &test_vraw_writer_batch},
+	{FN("vraw-writer-durability"), &test_vraw_writer_durability},
+	{FN("vraw-writer-write-at"), &test_vraw_writer_write_at},
+	{FN("vraw-writer-timestamps"), &test_vraw_writer_timestamps},
+	{FN("vraw-writer-split-planes"), &test_vraw_writer_split_planes},
+	{FN("vraw-writer-delta"), &test_vraw_writer_delta},
 
 	CU_TEST_INFO_NULL,
 };
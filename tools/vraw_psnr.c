@@ -187,6 +187,7 @@ int main(int argc, char **argv)
 	memset(&reader_config_1, 0, sizeof(reader_config_1));
 	reader_config_1.format = format;
 	reader_config_1.info.resolution = resolution;
+	reader_config_1.frame_step = decimation;
 	if ((strlen(file_1) > 4) &&
 	    (strcmp(file_1 + strlen(file_1) - 4, ".y4m") == 0))
 		reader_config_1.y4m = 1;
@@ -210,6 +211,7 @@ int main(int argc, char **argv)
 	memset(&reader_config_2, 0, sizeof(reader_config_1));
 	reader_config_2.format = format2;
 	reader_config_2.info.resolution = resolution;
+	reader_config_2.frame_step = decimation2;
 	if ((strlen(file_2) > 4) &&
 	    (strcmp(file_2 + strlen(file_2) - 4, ".y4m") == 0))
 		reader_config_2.y4m = 1;
@@ -274,35 +276,23 @@ int main(int argc, char **argv)
 	memset(&frame_2, 0, sizeof(frame_2));
 
 	while (res != -ENOENT) {
-		do {
-			res = vraw_reader_frame_read(
-				reader_1, data_1, len, &frame_1);
-			if ((res < 0) && (res != -ENOENT)) {
-				ULOG_ERRNO("vraw_reader_frame_read", -res);
-				ret = EXIT_FAILURE;
-				break;
-			}
-			if (res == -ENOENT)
-				break;
-		} while ((frame_1.frame.info.index % decimation) ||
-			 (frame_1.frame.info.index / decimation != index));
+		res = vraw_reader_frame_read(reader_1, data_1, len, &frame_1);
 		if (res == -ENOENT)
 			break;
+		if (res < 0) {
+			ULOG_ERRNO("vraw_reader_frame_read", -res);
+			ret = EXIT_FAILURE;
+			break;
+		}
 
-		do {
-			res = vraw_reader_frame_read(
-				reader_2, data_2, len, &frame_2);
-			if ((res < 0) && (res != -ENOENT)) {
-				ULOG_ERRNO("vraw_reader_frame_read", -res);
-				ret = EXIT_FAILURE;
-				break;
-			}
-			if (res == -ENOENT)
-				break;
-		} while ((frame_2.frame.info.index % decimation2) ||
-			 (frame_2.frame.info.index / decimation2 != index));
+		res = vraw_reader_frame_read(reader_2, data_2, len, &frame_2);
 		if (res == -ENOENT)
 			break;
+		if (res < 0) {
+			ULOG_ERRNO("vraw_reader_frame_read", -res);
+			ret = EXIT_FAILURE;
+			break;
+		}
 
 		res = vraw_compute_psnr(&frame_1, &frame_2, psnr);
 		if (res < 0) {